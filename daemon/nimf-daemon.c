@@ -25,14 +25,43 @@
 #include <glib-unix.h>
 #include <syslog.h>
 #include "nimf-private.h"
+#include "nimf-trace.h"
 #include <glib/gi18n.h>
 
 gboolean syslog_initialized = FALSE;
 
+#ifdef NIMF_ENABLE_TRACING
+static gboolean
+on_dump_trace (gpointer user_data)
+{
+  gchar  *filename;
+  gchar  *basename;
+  GError *error = NULL;
+
+  basename = g_strdup_printf ("nimf-trace-%d.json", getpid ());
+  filename = g_build_filename (g_get_user_runtime_dir (), basename, NULL);
+
+  if (nimf_trace_dump (filename, &error))
+  {
+    g_message ("trace written to %s", filename);
+  }
+  else
+  {
+    g_warning ("%s", error->message);
+    g_clear_error (&error);
+  }
+
+  g_free (filename);
+  g_free (basename);
+
+  return G_SOURCE_CONTINUE;
+}
+#endif
+
 int
 main (int argc, char **argv)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfServer *server;
   GMainLoop  *loop;
@@ -41,12 +70,20 @@ main (int argc, char **argv)
   gboolean is_no_daemon = FALSE;
   gboolean is_debug     = FALSE;
   gboolean is_version   = FALSE;
+  gint     n_workers    = 0;
+#ifdef NIMF_ENABLE_TRACING
+  gboolean is_trace     = FALSE;
+#endif
 
   GOptionContext *context;
   GOptionEntry    entries[] = {
     {"no-daemon", 0, 0, G_OPTION_ARG_NONE, &is_no_daemon, N_("Do not daemonize"), NULL},
     {"debug", 0, 0, G_OPTION_ARG_NONE, &is_debug, N_("Log debugging message"), NULL},
     {"version", 0, 0, G_OPTION_ARG_NONE, &is_version, N_("Version"), NULL},
+    {"workers", 0, 0, G_OPTION_ARG_INT, &n_workers, N_("Read and write client sockets in N threads"), "N"},
+#ifdef NIMF_ENABLE_TRACING
+    {"trace", 0, 0, G_OPTION_ARG_NONE, &is_trace, N_("Record a trace, written out on SIGUSR1"), NULL},
+#endif
     {NULL}
   };
 
@@ -102,6 +139,9 @@ main (int argc, char **argv)
     return EXIT_FAILURE;
   }
 
+  if (n_workers > 0)
+    nimf_server_set_n_workers (server, n_workers);
+
   nimf_server_start (server);
 
   loop = g_main_loop_new (NULL, FALSE);
@@ -109,6 +149,14 @@ main (int argc, char **argv)
   g_unix_signal_add (SIGINT,  (GSourceFunc) g_main_loop_quit, loop);
   g_unix_signal_add (SIGTERM, (GSourceFunc) g_main_loop_quit, loop);
 
+#ifdef NIMF_ENABLE_TRACING
+  if (is_trace)
+  {
+    nimf_trace_set_enabled (TRUE);
+    g_unix_signal_add (SIGUSR1, on_dump_trace, NULL);
+  }
+#endif
+
   g_main_loop_run (loop);
 
   g_main_loop_unref (loop);
@@ -34,7 +34,7 @@ static gboolean syslog_initialized = FALSE;
 static void on_engine_menu (GtkWidget *widget,
                             NimfAgent *agent)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_agent_set_engine_by_id (agent, gtk_widget_get_name (widget));
 }
@@ -42,7 +42,7 @@ static void on_engine_menu (GtkWidget *widget,
 static void on_settings_menu (GtkWidget *widget,
                               gpointer   user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_spawn_command_line_async ("nimf-settings", NULL);
 }
@@ -50,7 +50,7 @@ static void on_settings_menu (GtkWidget *widget,
 static void on_about_menu (GtkWidget *widget,
                            gpointer   user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GtkWidget *about_dialog;
   GtkWidget *parent;
@@ -88,7 +88,7 @@ static void on_about_menu (GtkWidget *widget,
 static void on_exit_menu (GtkWidget *widget,
                           gpointer   user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   gtk_main_quit ();
 }
@@ -105,7 +105,7 @@ static void on_engine_changed (NimfAgent    *agent,
 static void on_disconnected (NimfAgent    *agent,
                              AppIndicator *indicator)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   app_indicator_set_icon_full (indicator,
                                "nimf-indicator-warning", "disconnected");
@@ -166,6 +166,7 @@ typedef struct _Xi18nClient
     int		sync;
     XIMPending  *pending;
     Xi18nOffsetCache offset_cache;
+    int		use_utf8_string; /* UTF8_STRING was negotiated */
     void *trans_rec;		/* contains transport specific data  */
     struct _Xi18nClient *next;
 } Xi18nClient;
@@ -502,6 +503,8 @@ typedef struct _Xi18nAddressRec
     /* clients table */
     Xi18nClient *clients;
     Xi18nClient *free_clients;
+    Xi18nClient **client_table;	/* indexed by connect_id */
+    int		client_table_size;
 } Xi18nAddressRec;
 
 typedef struct _Xi18nMethodsRec
@@ -47,6 +47,7 @@ typedef struct
 {
     Atom	xim_request;
     Atom	connect_request;
+    XContext	client_context;	/* accept_win -> Xi18nClient */
 } XSpecRec;
 
 #endif
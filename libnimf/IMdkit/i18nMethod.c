@@ -803,6 +803,7 @@ static Status xi18n_closeIM(XIMS ims)
     XFree (i18n_core->address.im_name);
     XFree (i18n_core->address.im_locale);
     XFree (i18n_core->address.im_addr);
+    free (i18n_core->address.client_table);
     XFree (i18n_core);
     return True;
 }
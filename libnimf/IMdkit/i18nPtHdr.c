@@ -1492,8 +1492,9 @@ static INT16 ChooseEncoding (Xi18n i18n_core,
     Xi18nAddressRec *address = (Xi18nAddressRec *) & i18n_core->address;
     XIMEncodings *p;
     int i, j;
-    int enc_index=0;
 
+    /* the first of ours the client supports, ours being in the order
+       of preference */
     p = (XIMEncodings *) &address->encoding_list;
     for (i = 0;  i < (int) p->count_encodings;  i++)
     {
@@ -1501,17 +1502,14 @@ static INT16 ChooseEncoding (Xi18n i18n_core,
         {
             if (strcmp (p->supported_encodings[i],
                         enc_nego->encoding[j].name) == 0)
-            {
-                enc_index = j;
-                break;
-            }
+                return (INT16) j;
             /*endif*/
         }
         /*endfor*/
     }
     /*endfor*/
 
-    return (INT16) enc_index;
+    return (INT16) 0;
 #if 0
     return (INT16) XIM_Default_Encoding_IDX;
 #endif
@@ -1594,6 +1592,20 @@ static void EncodingNegotiatonMessageProc (XIMS ims,
     enc_nego->enc_index = ChooseEncoding (i18n_core, enc_nego);
     enc_nego->category = 0;
 
+    /* a name, not the codeset of a locale: Xlib offers "UTF-8" yet
+       decodes only COMPOUND_TEXT */
+    if (enc_nego->enc_index < (int) enc_nego->encoding_number)
+    {
+        Xi18nClient *client = _Xi18nFindClient (i18n_core, connect_id);
+
+        if (client)
+            client->use_utf8_string =
+                strcmp (enc_nego->encoding[enc_nego->enc_index].name,
+                        "UTF8_STRING") == 0;
+        /*endif*/
+    }
+    /*endif*/
+
 #ifdef PROTOCOL_RICH
     if (i18n_core->address.improto)
     {
@@ -64,9 +64,43 @@ Xi18nClient *_Xi18nNewClient(Xi18n i18n_core)
     else
     {
         client = (Xi18nClient *) malloc (sizeof (Xi18nClient));
+        if (client == NULL)
+            return NULL;
+        /*endif*/
 	new_connect_id = ++connect_id;
     }
     /*endif*/
+    /* connect ids are reused, so the table stays as long as the most
+       clients connected at once */
+    if (new_connect_id >= i18n_core->address.client_table_size)
+    {
+        int size = i18n_core->address.client_table_size;
+        int new_size = size ? size * 2 : 16;
+        Xi18nClient **table;
+
+        while (new_size <= new_connect_id)
+            new_size *= 2;
+        /*endwhile*/
+        table = (Xi18nClient **) realloc (i18n_core->address.client_table,
+                                          new_size * sizeof (Xi18nClient *));
+        if (table == NULL)
+        {
+            /* keep the id for the next client */
+            client->connect_id = new_connect_id;
+            client->next = i18n_core->address.free_clients;
+            i18n_core->address.free_clients = client;
+            return NULL;
+        }
+        /*endif*/
+        i18n_core->address.client_table = table;
+        memset (i18n_core->address.client_table + size,
+                0,
+                (new_size - size) * sizeof (Xi18nClient *));
+        i18n_core->address.client_table_size = new_size;
+    }
+    /*endif*/
+    i18n_core->address.client_table[new_connect_id] = client;
+
     memset (client, 0, sizeof (Xi18nClient));
     client->connect_id = new_connect_id;
     client->pending = (XIMPending *) NULL;
@@ -82,16 +116,9 @@ Xi18nClient *_Xi18nNewClient(Xi18n i18n_core)
 
 Xi18nClient *_Xi18nFindClient (Xi18n i18n_core, CARD16 connect_id)
 {
-    Xi18nClient *client = i18n_core->address.clients;
-
-    while (client)
-    {
-        if (client->connect_id == connect_id)
-            return client;
-        /*endif*/
-        client = client->next;
-    }
-    /*endwhile*/
+    if (connect_id < i18n_core->address.client_table_size)
+        return i18n_core->address.client_table[connect_id];
+    /*endif*/
     return NULL;
 }
 
@@ -101,6 +128,11 @@ void _Xi18nDeleteClient (Xi18n i18n_core, CARD16 connect_id)
     Xi18nClient *ccp;
     Xi18nClient *ccp0;
 
+    if (target == NULL)
+        return;
+    /*endif*/
+    i18n_core->address.client_table[connect_id] = NULL;
+
     for (ccp = i18n_core->address.clients, ccp0 = NULL;
          ccp != NULL;
          ccp0 = ccp, ccp = ccp->next)
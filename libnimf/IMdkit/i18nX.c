@@ -35,6 +35,7 @@ IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <limits.h>
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
+#include <X11/Xutil.h>
 #include "FrameMgr.h"
 #include "IMdkit.h"
 #include "Xi18n.h"
@@ -53,10 +54,20 @@ static Bool WaitXIMProtocol (Display*, Window, XEvent*, XPointer);
 static XClient *NewXClient (Xi18n i18n_core, Window new_client)
 {
     Display *dpy = i18n_core->address.dpy;
+    XSpecRec *spec = (XSpecRec *) i18n_core->address.connect_addr;
     Xi18nClient *client = _Xi18nNewClient (i18n_core);
     XClient *x_client;
 
+    if (client == NULL)
+        return NULL;
+    /*endif*/
     x_client = (XClient *) malloc (sizeof (XClient));
+    if (x_client == NULL)
+    {
+        _Xi18nDeleteClient (i18n_core, client->connect_id);
+        return NULL;
+    }
+    /*endif*/
     x_client->client_win = new_client;
     x_client->accept_win = XCreateSimpleWindow (dpy,
                                                 DefaultRootWindow(dpy),
@@ -67,6 +78,10 @@ static XClient *NewXClient (Xi18n i18n_core, Window new_client)
                                                 1,
                                                 0,
                                                 0);
+    XSaveContext (dpy,
+                  x_client->accept_win,
+                  spec->client_context,
+                  (XPointer) client);
     client->trans_rec = x_client;
     return ((XClient *) x_client);
 }
@@ -76,21 +91,22 @@ static unsigned char *ReadXIMMessage (XIMS ims,
                                       int *connect_id)
 {
     Xi18n i18n_core = ims->protocol;
-    Xi18nClient *client = i18n_core->address.clients;
+    XSpecRec *spec = (XSpecRec *) i18n_core->address.connect_addr;
+    Xi18nClient *client = NULL;
     XClient *x_client = NULL;
     FrameMgr fm;
     extern XimFrameRec packet_header_fr[];
     unsigned char *p = NULL;
     unsigned char *p1;
 
-    while (client != NULL) {
-        x_client = (XClient *) client->trans_rec;
-        if (x_client->accept_win == ev->window) {
-            *connect_id = client->connect_id;
-            break;
-        }
-        client = client->next;
-    }
+    if (XFindContext (i18n_core->address.dpy,
+                      ev->window,
+                      spec->client_context,
+                      (XPointer *) &client) != 0)
+        return (unsigned char *) NULL;
+    /*endif*/
+    *connect_id = client->connect_id;
+    x_client = (XClient *) client->trans_rec;
 
     if (ev->format == 8) {
         /* ClientMessage only */
@@ -205,6 +221,9 @@ static void ReadXConnectMessage (XIMS ims, XClientMessageEvent *ev)
     CARD32 minor_version = ev->data.l[2];
     XClient *x_client = NewXClient (i18n_core, new_client);
 
+    if (x_client == NULL)
+        return; /* out of memory, the client sees no reply */
+    /*endif*/
     if (ev->window != i18n_core->address.im_window)
         return; /* incorrect connection request */
     /*endif*/
@@ -251,6 +270,7 @@ static Bool Xi18nXBegin (XIMS ims)
     spec->connect_request = XInternAtom (i18n_core->address.dpy,
                                          _XIM_XCONNECT,
                                          False);
+    spec->client_context = XUniqueContext ();
 
     _XRegisterFilterByType (dpy,
                             i18n_core->address.im_window,
@@ -303,35 +323,11 @@ static Bool Xi18nXSend (XIMS ims,
     {
         Atom atom;
         char atomName[16];
-        Atom actual_type_ret;
-        int actual_format_ret;
-        int return_code;
-        unsigned long nitems_ret;
-        unsigned long bytes_after_ret;
-        unsigned char *win_data;
 
         event.xclient.format = 32;
         atom = XInternAtom (i18n_core->address.dpy,
                             MakeNewAtom (connect_id, atomName),
                             False);
-        return_code = XGetWindowProperty (i18n_core->address.dpy,
-                                          x_client->client_win,
-                                          atom,
-                                          0L,
-                                          10000L,
-                                          False,
-                                          XA_STRING,
-                                          &actual_type_ret,
-                                          &actual_format_ret,
-                                          &nitems_ret,
-                                          &bytes_after_ret,
-                                          &win_data);
-        if (return_code != Success)
-            return False;
-        /*endif*/
-        if (win_data)
-            XFree ((char *) win_data);
-        /*endif*/
         XChangeProperty (i18n_core->address.dpy,
                          x_client->client_win,
                          atom,
@@ -363,7 +359,7 @@ static Bool Xi18nXSend (XIMS ims,
                 False,
                 NoEventMask,
                 &event);
-    XFlush (i18n_core->address.dpy);
+    /* flushed by the caller, once for all the messages it sends */
     return True;
 }
 
@@ -435,9 +431,11 @@ static Bool Xi18nXDisconnect (XIMS ims, CARD16 connect_id)
 {
     Xi18n i18n_core = ims->protocol;
     Display *dpy = i18n_core->address.dpy;
+    XSpecRec *spec = (XSpecRec *) i18n_core->address.connect_addr;
     Xi18nClient *client = _Xi18nFindClient (i18n_core, connect_id);
     XClient *x_client = (XClient *) client->trans_rec;
 
+    XDeleteContext (dpy, x_client->accept_win, spec->client_context);
     XDestroyWindow (dpy, x_client->accept_win);
     _XUnregisterFilter (dpy,
                         x_client->accept_win,
@@ -20,13 +20,12 @@
  */
 
 #include "nimf-agent.h"
+#include "nimf-trace.h"
 #include "nimf-private.h"
 #include <gio/gunixsocketaddress.h>
 #include "nimf-marshalers.h"
 #include <string.h>
 
-extern GMainContext      *nimf_client_socket_context;
-extern NimfResult        *nimf_client_result;
 extern GSocketConnection *nimf_client_connection;
 
 G_DEFINE_TYPE (NimfAgent, nimf_agent, NIMF_TYPE_CLIENT);
@@ -34,13 +33,13 @@ G_DEFINE_TYPE (NimfAgent, nimf_agent, NIMF_TYPE_CLIENT);
 static void
 nimf_agent_init (NimfAgent *agent)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 static void
 nimf_agent_finalize (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   G_OBJECT_CLASS (nimf_agent_parent_class)->finalize (object);
 }
@@ -48,7 +47,7 @@ nimf_agent_finalize (GObject *object)
 static void
 nimf_agent_class_init (NimfAgentClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GObjectClass *object_class = G_OBJECT_CLASS (class);
   object_class->finalize = nimf_agent_finalize;
@@ -57,7 +56,7 @@ nimf_agent_class_init (NimfAgentClass *class)
 NimfAgent *
 nimf_agent_new ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return g_object_new (NIMF_TYPE_AGENT,
                        "context-type", NIMF_CONTEXT_NIMF_AGENT, NULL);
@@ -67,7 +66,7 @@ void
 nimf_agent_set_engine_by_id (NimfAgent   *agent,
                              const gchar *id)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfClient *client = NIMF_CLIENT (agent);
 
@@ -81,11 +80,9 @@ nimf_agent_set_engine_by_id (NimfAgent   *agent,
 
   data = g_strdup (id);
 
-  nimf_send_message (socket, client->id, NIMF_MESSAGE_SET_ENGINE_BY_ID,
-                     data, data_len, g_free);
-  nimf_result_iteration_until (nimf_client_result, nimf_client_socket_context,
-                               client->id,
-                               NIMF_MESSAGE_SET_ENGINE_BY_ID_REPLY);
+  nimf_message_unref (nimf_client_call (socket, client->id,
+                                        NIMF_MESSAGE_SET_ENGINE_BY_ID,
+                                        data, data_len, g_free));
 }
 
 /**
@@ -97,7 +94,7 @@ nimf_agent_set_engine_by_id (NimfAgent   *agent,
 gchar **
 nimf_agent_get_loaded_engine_ids (NimfAgent *agent)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfClient *client = NIMF_CLIENT (agent);
 
@@ -108,13 +105,16 @@ nimf_agent_get_loaded_engine_ids (NimfAgent *agent)
 
   GSocket *socket = g_socket_connection_get_socket (nimf_client_connection);
 
-  nimf_send_message (socket, client->id, NIMF_MESSAGE_GET_LOADED_ENGINE_IDS,
-                     NULL, 0, NULL);
-  nimf_result_iteration_until (nimf_client_result, nimf_client_socket_context,
-                               client->id,
-                               NIMF_MESSAGE_GET_LOADED_ENGINE_IDS_REPLY);
-  if (nimf_client_result->reply == NULL)
+  NimfMessage  *reply;
+  gchar       **engine_ids;
+
+  reply = nimf_client_call (socket, client->id,
+                            NIMF_MESSAGE_GET_LOADED_ENGINE_IDS, NULL, 0, NULL);
+  if (reply == NULL)
     return NULL;
   /* 0x1e is RS (record separator) */
-  return g_strsplit (nimf_client_result->reply->data, "\x1e", -1);
+  engine_ids = g_strsplit (reply->data, "\x1e", -1);
+  nimf_message_unref (reply);
+
+  return engine_ids;
 }
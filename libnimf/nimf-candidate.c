@@ -20,6 +20,7 @@
  */
 
 #include "nimf-candidate.h"
+#include "nimf-trace.h"
 #include <gtk/gtk.h>
 
 static NimfCandidate *nimf_candidate_default = NULL;
@@ -57,7 +58,7 @@ on_tree_view_row_activated (GtkTreeView       *tree_view,
                             GtkTreeViewColumn *column,
                             NimfCandidate     *candidate)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfEngineClass *engine_class;
 
@@ -81,7 +82,7 @@ on_range_change_value (GtkRange      *range,
                        gdouble        value,
                        NimfCandidate *candidate)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (candidate->target &&
                         NIMF_IS_ENGINE (candidate->target->engine), FALSE);
@@ -113,7 +114,7 @@ on_entry_draw (GtkWidget *widget,
                cairo_t   *cr,
                gpointer   user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GtkStyleContext *style_context;
   PangoContext    *pango_context;
@@ -136,7 +137,7 @@ on_entry_draw (GtkWidget *widget,
 static void
 nimf_candidate_init (NimfCandidate *candidate)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GtkCellRenderer   *renderer;
   GtkTreeViewColumn *column[N_COLUMNS];
@@ -227,7 +228,7 @@ nimf_candidate_init (NimfCandidate *candidate)
 static void
 nimf_candidate_finalize (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   gtk_widget_destroy (NIMF_CANDIDATE (object)->window);
   G_OBJECT_CLASS (nimf_candidate_parent_class)->finalize (object);
@@ -236,7 +237,7 @@ nimf_candidate_finalize (GObject *object)
 static void
 nimf_candidate_class_init (NimfCandidateClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GObjectClass *object_class = G_OBJECT_CLASS (class);
 
@@ -246,7 +247,7 @@ nimf_candidate_class_init (NimfCandidateClass *class)
 void nimf_candidate_clear (NimfCandidate *candidate,
                            NimfContext   *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GtkTreeModel *model;
 
@@ -259,7 +260,7 @@ void nimf_candidate_append (NimfCandidate *candidate,
                             const gchar   *item1,
                             const gchar   *item2)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GtkTreeModel  *model;
   GtkTreeIter    iter;
@@ -282,7 +283,7 @@ void nimf_candidate_set_auxiliary_text (NimfCandidate *candidate,
                                         const gchar   *text,
                                         gint           cursor_pos)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   gtk_entry_set_text (GTK_ENTRY (candidate->entry), text);
   gtk_editable_set_position (GTK_EDITABLE (candidate->entry), cursor_pos);
@@ -294,7 +295,7 @@ void nimf_candidate_set_page_values (NimfCandidate *candidate,
                                      gint           n_pages,
                                      gint           page_size)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GtkRange *range = GTK_RANGE (candidate->scrollbar);
 
@@ -313,7 +314,7 @@ void nimf_candidate_show_window (NimfCandidate *candidate,
                                  NimfContext   *target,
                                  gboolean       show_entry)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GtkRequisition  natural_size;
   int             x, y, w, h;
@@ -345,14 +346,14 @@ void nimf_candidate_show_window (NimfCandidate *candidate,
 
 void nimf_candidate_hide_window (NimfCandidate *candidate)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   gtk_widget_hide (candidate->window);
 }
 
 gboolean nimf_candidate_is_window_visible (NimfCandidate *candidate)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return gtk_widget_is_visible (candidate->window);
 }
@@ -360,7 +361,7 @@ gboolean nimf_candidate_is_window_visible (NimfCandidate *candidate)
 void
 nimf_candidate_select_last_item_in_page (NimfCandidate *candidate)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GtkTreeModel     *model;
   GtkTreeSelection *selection;
@@ -379,7 +380,7 @@ void
 nimf_candidate_select_item_by_index_in_page (NimfCandidate *candidate,
                                              gint           index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GtkTreeModel     *model;
   GtkTreeSelection *selection;
@@ -395,7 +396,7 @@ nimf_candidate_select_item_by_index_in_page (NimfCandidate *candidate,
 void
 nimf_candidate_select_previous_item (NimfCandidate *candidate)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GtkTreeModel     *model;
   GtkTreeSelection *selection;
@@ -431,7 +432,7 @@ nimf_candidate_select_previous_item (NimfCandidate *candidate)
 void
 nimf_candidate_select_first_item_in_page (NimfCandidate *candidate)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GtkTreeModel     *model;
   GtkTreeSelection *selection;
@@ -447,7 +448,7 @@ nimf_candidate_select_first_item_in_page (NimfCandidate *candidate)
 void
 nimf_candidate_select_next_item (NimfCandidate *candidate)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GtkTreeModel     *model;
   GtkTreeSelection *selection;
@@ -482,21 +483,21 @@ nimf_candidate_select_next_item (NimfCandidate *candidate)
 
 NimfCandidate *nimf_candidate_get_default ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return nimf_candidate_default;
 }
 
 NimfCandidate *nimf_candidate_new ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return g_object_new (NIMF_TYPE_CANDIDATE, NULL);
 }
 
 gchar *nimf_candidate_get_selected_text (NimfCandidate *candidate)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GtkTreeIter   iter;
   GtkTreeModel *model;
@@ -513,7 +514,7 @@ gchar *nimf_candidate_get_selected_text (NimfCandidate *candidate)
 
 gint nimf_candidate_get_selected_index (NimfCandidate *candidate)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GtkTreeIter       iter;
   GtkTreeModel     *model;
@@ -19,7 +19,9 @@
  * along with this program;  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "config.h"
 #include "nimf-client.h"
+#include "nimf-trace.h"
 #include "nimf-im.h"
 #include "nimf-agent.h"
 #include "nimf-marshalers.h"
@@ -40,84 +42,34 @@ enum {
 };
 
 static guint       nimf_client_signals[LAST_SIGNAL] = { 0 };
-static GSource    *nimf_client_socket_source  = NULL;
-static GSource    *nimf_client_default_source = NULL;
-static GHashTable *nimf_client_table          = NULL;
-GMainContext      *nimf_client_socket_context = NULL;
-NimfResult        *nimf_client_result         = NULL;
-GSocketConnection *nimf_client_connection     = NULL;
+static GSource    *nimf_client_source     = NULL;
+static GHashTable *nimf_client_table      = NULL;
+/* seq of a request => its reply, NULL until the reply arrives */
+static GHashTable *nimf_client_pending    = NULL;
+GSocketConnection *nimf_client_connection = NULL;
 
 G_DEFINE_ABSTRACT_TYPE (NimfClient, nimf_client, G_TYPE_OBJECT);
 
 static gboolean
-on_incoming_message (GSocket      *socket,
-                     GIOCondition  condition,
-                     gpointer      user_data)
+nimf_client_emit_signal (NimfClient      *client,
+                         NimfMessageType  type,
+                         const gchar     *data,
+                         guint32          data_len)
 {
-  g_debug (G_STRLOC ": %s: socket fd:%d", G_STRFUNC, g_socket_get_fd (socket));
-
-  nimf_message_unref (nimf_client_result->reply);
-  nimf_client_result->is_dispatched = TRUE;
-
-  if (condition & (G_IO_HUP | G_IO_ERR))
-  {
-    /* Because two GSource is created over one socket,
-     * when G_IO_HUP | G_IO_ERR, callback can run two times.
-     * the following code avoid that callback runs two times. */
-    GSource *source = g_main_current_source ();
-
-    if (source == nimf_client_default_source)
-      g_source_destroy (nimf_client_socket_source);
-    else if (source == nimf_client_socket_source)
-      g_source_destroy (nimf_client_default_source);
-
-    if (!g_socket_is_closed (socket))
-      g_socket_close (socket, NULL);
-
-    nimf_client_result->reply = NULL;
+  NIMF_TRACE ();
 
-    if (nimf_client_table)
-    {
-      GHashTableIter iter;
-      gpointer       value;
-      g_hash_table_iter_init (&iter, nimf_client_table);
-
-      while (g_hash_table_iter_next (&iter, NULL, &value))
-        g_signal_emit_by_name (NIMF_CLIENT (value), "disconnected", NULL);
-    }
-
-    g_critical (G_STRLOC ": %s: G_IO_HUP | G_IO_ERR", G_STRFUNC);
+  gboolean retval = FALSE;
 
-    return G_SOURCE_REMOVE;
-  }
-
-  NimfMessage *message;
-  message = nimf_recv_message (socket);
-  nimf_client_result->reply = message;
-  gboolean retval;
+  if (G_UNLIKELY (client == NULL))
+    return FALSE;
 
-  if (G_UNLIKELY (message == NULL))
-  {
-    g_critical (G_STRLOC ": NULL message");
-    return G_SOURCE_CONTINUE;
-  }
-
-  NimfClient *client;
-  client = g_hash_table_lookup (nimf_client_table,
-                                GUINT_TO_POINTER (message->header->icid));
-
-  switch (message->header->type)
+  switch (type)
   {
-    /* signals */
     case NIMF_MESSAGE_PREEDIT_START:
       g_signal_emit_by_name (NIMF_IM (client), "preedit-start");
-      nimf_send_message (socket, client->id, NIMF_MESSAGE_PREEDIT_START_REPLY,
-                         NULL, 0, NULL);
       break;
     case NIMF_MESSAGE_PREEDIT_END:
       g_signal_emit_by_name (NIMF_IM (client), "preedit-end");
-      nimf_send_message (socket, client->id, NIMF_MESSAGE_PREEDIT_END_REPLY,
-                         NULL, 0, NULL);
       break;
     case NIMF_MESSAGE_PREEDIT_CHANGED:
       {
@@ -125,56 +77,159 @@ on_incoming_message (GSocket      *socket,
         gint    i;
 
         g_free (im->preedit_string);
-        im->preedit_string = g_strndup (message->data,
-                                        message->header->data_len - 1 - sizeof (gint));
+        im->preedit_string = g_strndup (data, data_len - 1 - sizeof (gint));
 
-        gint str_len = strlen (message->data);
-        gint n_attr = (message->header->data_len - str_len - 1 - sizeof (gint)) /
+        gint str_len = strlen (data);
+        gint n_attr = (data_len - str_len - 1 - sizeof (gint)) /
                        sizeof (NimfPreeditAttr);
 
         nimf_preedit_attr_freev (im->preedit_attrs);
         im->preedit_attrs = g_malloc0_n (n_attr + 1, sizeof (NimfPreeditAttr *));
 
         for (i = 0; i < n_attr; i++)
-          im->preedit_attrs[i] = g_memdup (message->data + str_len + 1 + i * sizeof (NimfPreeditAttr),
+          im->preedit_attrs[i] = g_memdup (data + str_len + 1 + i * sizeof (NimfPreeditAttr),
                                            sizeof (NimfPreeditAttr));
 
         im->preedit_attrs[n_attr] = NULL;
 
-        im->cursor_pos = *(gint *) (message->data +
-                                    message->header->data_len - sizeof (gint));
+        memcpy (&im->cursor_pos, data + data_len - sizeof (gint), sizeof (gint));
         g_signal_emit_by_name (im, "preedit-changed");
-        nimf_send_message (socket, client->id,
-                           NIMF_MESSAGE_PREEDIT_CHANGED_REPLY, NULL, 0, NULL);
       }
       break;
     case NIMF_MESSAGE_COMMIT:
-      nimf_message_ref (message);
-      g_signal_emit_by_name (NIMF_IM (client), "commit", (const gchar *) message->data);
-      nimf_message_unref (message);
-      nimf_send_message (socket, client->id, NIMF_MESSAGE_COMMIT_REPLY,
-                         NULL, 0, NULL);
+      g_signal_emit_by_name (NIMF_IM (client), "commit", data);
       break;
     case NIMF_MESSAGE_RETRIEVE_SURROUNDING:
       g_signal_emit_by_name (NIMF_IM (client), "retrieve-surrounding", &retval);
-      nimf_send_message (socket, client->id,
-                         NIMF_MESSAGE_RETRIEVE_SURROUNDING_REPLY,
-                         &retval, sizeof (gboolean), NULL);
       break;
     case NIMF_MESSAGE_DELETE_SURROUNDING:
-      nimf_message_ref (message);
       g_signal_emit_by_name (NIMF_IM (client), "delete-surrounding",
-                             ((gint *) message->data)[0],
-                             ((gint *) message->data)[1], &retval);
-      nimf_message_unref (message);
-      nimf_send_message (socket, client->id,
-                         NIMF_MESSAGE_DELETE_SURROUNDING_REPLY,
-                         &retval, sizeof (gboolean), NULL);
+                             ((gint *) data)[0], ((gint *) data)[1], &retval);
+      break;
+    default:
+      g_warning (G_STRLOC ": %s: Unknown signal type: %d", G_STRFUNC, type);
+      break;
+  }
+
+  return retval;
+}
+
+/* Replays the signals batched in a compound body.  Signal handlers may
+ * send requests of their own, so the caller must hold a reference to the
+ * message. */
+static void
+nimf_client_emit_compound (NimfMessage *message)
+{
+  NIMF_TRACE ();
+
+  NimfMessageHeader  header;
+  const gchar       *data;
+  guint32            offset = 0;
+
+  while (nimf_compound_next (message->data, message->header.data_len,
+                             &offset, &header, &data))
+  {
+    NimfClient *client;
+
+    client = g_hash_table_lookup (nimf_client_table,
+                                  GUINT_TO_POINTER (header.icid));
+    nimf_client_emit_signal (client, header.type, data, header.data_len);
+  }
+}
+
+static void
+nimf_client_disconnect (GSocket *socket)
+{
+  NIMF_TRACE ();
+
+  if (!g_socket_is_closed (socket))
+    g_socket_close (socket, NULL);
+
+  if (nimf_client_source)
+    g_source_destroy (nimf_client_source);
+
+  if (nimf_client_table)
+  {
+    GHashTableIter iter;
+    gpointer       value;
+    g_hash_table_iter_init (&iter, nimf_client_table);
+
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+      g_signal_emit_by_name (NIMF_CLIENT (value), "disconnected", NULL);
+  }
+}
+
+/* The server does not wait for signals which return nothing; their replies
+ * are only for servers which did not negotiate one-way messages. */
+static void
+nimf_client_acknowledge (GSocket         *socket,
+                         guint16          icid,
+                         NimfMessageType  type,
+                         guint32          seq)
+{
+  if (!(nimf_socket_get_capabilities (socket) & NIMF_CAPABILITY_ONE_WAY))
+    nimf_send_reply (socket, icid, type, seq, NULL, 0, NULL);
+}
+
+/* Handles a message from the server, whoever has read it: the source on
+ * the default main context or a request waiting for its reply. */
+static void
+nimf_client_dispatch (GSocket     *socket,
+                      NimfMessage *message)
+{
+  NIMF_TRACE ();
+
+  NimfClient *client;
+  guint16     icid = message->header.icid;
+  guint32     seq  = message->header.seq;
+  gboolean    retval;
+
+  NIMF_TRACE_MESSAGE (NIMF_TRACE_BEGIN, "dispatch", message->header.type, seq);
+
+  client = g_hash_table_lookup (nimf_client_table, GUINT_TO_POINTER (icid));
+
+  switch (message->header.type)
+  {
+    /* signals */
+    case NIMF_MESSAGE_PREEDIT_START:
+      nimf_client_emit_signal (client, NIMF_MESSAGE_PREEDIT_START, NULL, 0);
+      nimf_client_acknowledge (socket, icid, NIMF_MESSAGE_PREEDIT_START_REPLY, seq);
+      break;
+    case NIMF_MESSAGE_PREEDIT_END:
+      nimf_client_emit_signal (client, NIMF_MESSAGE_PREEDIT_END, NULL, 0);
+      nimf_client_acknowledge (socket, icid, NIMF_MESSAGE_PREEDIT_END_REPLY, seq);
+      break;
+    case NIMF_MESSAGE_PREEDIT_CHANGED:
+      nimf_client_emit_signal (client, NIMF_MESSAGE_PREEDIT_CHANGED,
+                               message->data, message->header.data_len);
+      nimf_client_acknowledge (socket, icid,
+                               NIMF_MESSAGE_PREEDIT_CHANGED_REPLY, seq);
+      break;
+    case NIMF_MESSAGE_COMMIT:
+      nimf_client_emit_signal (client, NIMF_MESSAGE_COMMIT,
+                               message->data, message->header.data_len);
+      nimf_client_acknowledge (socket, icid, NIMF_MESSAGE_COMMIT_REPLY, seq);
+      break;
+    case NIMF_MESSAGE_RETRIEVE_SURROUNDING:
+      retval = nimf_client_emit_signal (client,
+                                        NIMF_MESSAGE_RETRIEVE_SURROUNDING,
+                                        NULL, 0);
+      nimf_send_reply (socket, icid, NIMF_MESSAGE_RETRIEVE_SURROUNDING_REPLY,
+                       seq, &retval, sizeof (gboolean), NULL);
+      break;
+    case NIMF_MESSAGE_DELETE_SURROUNDING:
+      retval = nimf_client_emit_signal (client,
+                                        NIMF_MESSAGE_DELETE_SURROUNDING,
+                                        message->data,
+                                        message->header.data_len);
+      nimf_send_reply (socket, icid, NIMF_MESSAGE_DELETE_SURROUNDING_REPLY,
+                       seq, &retval, sizeof (gboolean), NULL);
+      break;
+    case NIMF_MESSAGE_COMPOUND:
+      nimf_client_emit_compound (message);
       break;
     /* for agent */
     case NIMF_MESSAGE_ENGINE_CHANGED:
-      nimf_message_ref (message);
-
       if (nimf_client_table)
       {
         GHashTableIter iter;
@@ -185,35 +240,163 @@ on_incoming_message (GSocket      *socket,
           g_signal_emit_by_name (NIMF_CLIENT (value), "engine-changed",
                                  (gchar *) message->data);
       }
-
-      nimf_message_unref (message);
       break;
     /* reply */
+    case NIMF_MESSAGE_FILTER_EVENT_REPLY:
+      /* signals of the event are replayed before the waiter returns */
+      nimf_client_emit_compound (message);
+      /* fall through */
     case NIMF_MESSAGE_CREATE_CONTEXT_REPLY:
     case NIMF_MESSAGE_DESTROY_CONTEXT_REPLY:
-    case NIMF_MESSAGE_FILTER_EVENT_REPLY:
     case NIMF_MESSAGE_RESET_REPLY:
-    case NIMF_MESSAGE_FOCUS_IN_REPLY:
-    case NIMF_MESSAGE_FOCUS_OUT_REPLY:
-    case NIMF_MESSAGE_SET_SURROUNDING_REPLY:
     case NIMF_MESSAGE_GET_SURROUNDING_REPLY:
-    case NIMF_MESSAGE_SET_CURSOR_LOCATION_REPLY:
-    case NIMF_MESSAGE_SET_USE_PREEDIT_REPLY:
     case NIMF_MESSAGE_GET_LOADED_ENGINE_IDS_REPLY:
     case NIMF_MESSAGE_SET_ENGINE_BY_ID_REPLY:
+    case NIMF_MESSAGE_SHM_ATTACH_REPLY:
+    case NIMF_MESSAGE_HELLO_REPLY:
+      if (g_hash_table_contains (nimf_client_pending, GUINT_TO_POINTER (seq)))
+        g_hash_table_insert (nimf_client_pending, GUINT_TO_POINTER (seq),
+                             nimf_message_ref (message));
+      else
+        g_warning (G_STRLOC ": %s: Unexpected reply: %u", G_STRFUNC, seq);
+      break;
+    case NIMF_MESSAGE_ACK:
+      /* of a one-way message, from a server which did not negotiate them;
+       * nobody waits for it */
       break;
     default:
-      g_warning (G_STRLOC ": %s: Unknown message type: %d", G_STRFUNC, message->header->type);
+      g_warning (G_STRLOC ": %s: Unknown message type: %d", G_STRFUNC, message->header.type);
       break;
   }
 
+  NIMF_TRACE_MESSAGE (NIMF_TRACE_END, "dispatch", message->header.type, seq);
+}
+
+static gboolean
+on_incoming_message (GSocket      *socket,
+                     GIOCondition  condition,
+                     gpointer      user_data)
+{
+  NIMF_TRACE ();
+
+  NimfMessage *message;
+
+  if (condition & (G_IO_HUP | G_IO_ERR))
+  {
+    nimf_client_disconnect (socket);
+    g_critical (G_STRLOC ": %s: G_IO_HUP | G_IO_ERR", G_STRFUNC);
+
+    return G_SOURCE_REMOVE;
+  }
+
+  message = nimf_recv_message (socket);
+
+  if (G_UNLIKELY (message == NULL))
+  {
+    nimf_client_disconnect (socket);
+
+    return G_SOURCE_REMOVE;
+  }
+
+  nimf_client_dispatch (socket, message);
+  nimf_message_unref (message);
+
   return G_SOURCE_CONTINUE;
 }
 
+/* Reads the socket until the reply of @seq arrives.  Everything read in
+ * the meantime is dispatched; replies of other requests, e.g. of an outer
+ * request whose signal handler made this one, are kept in the pending
+ * table for their own waiters. */
+static NimfMessage *
+nimf_client_wait (GSocket *socket,
+                  guint32  seq)
+{
+  NIMF_TRACE ();
+
+  NimfMessage *reply;
+
+  g_hash_table_insert (nimf_client_pending, GUINT_TO_POINTER (seq), NULL);
+
+  while ((reply = g_hash_table_lookup (nimf_client_pending,
+                                       GUINT_TO_POINTER (seq))) == NULL)
+  {
+    NimfMessage *message = nimf_recv_message (socket);
+
+    if (G_UNLIKELY (message == NULL))
+    {
+      nimf_client_disconnect (socket);
+      break;
+    }
+
+    nimf_client_dispatch (socket, message);
+    nimf_message_unref (message);
+  }
+
+  g_hash_table_steal (nimf_client_pending, GUINT_TO_POINTER (seq));
+
+  return reply;
+}
+
+/* Sends a request and returns its reply, or NULL if the connection is
+ * lost.  The reply must be freed with nimf_message_unref(). */
+NimfMessage *
+nimf_client_call (GSocket         *socket,
+                  guint16          icid,
+                  NimfMessageType  type,
+                  gpointer         data,
+                  guint32          data_len,
+                  GDestroyNotify   data_destroy_func)
+{
+  NIMF_TRACE ();
+
+  guint32 seq;
+
+  seq = nimf_send_message (socket, icid, type,
+                           data, data_len, data_destroy_func);
+  if (G_UNLIKELY (seq == 0))
+  {
+    nimf_client_disconnect (socket);
+    return NULL;
+  }
+
+  return nimf_client_wait (socket, seq);
+}
+
+static void
+nimf_client_hello (GSocket *socket,
+                   guint16  icid)
+{
+  NIMF_TRACE ();
+
+  NimfHello    hello;
+  NimfMessage *reply;
+
+  hello.version      = GUINT32_TO_LE (NIMF_PROTOCOL_VERSION);
+  hello.capabilities = GUINT32_TO_LE (NIMF_CAPABILITY_COMPOUND |
+                                      NIMF_CAPABILITY_ONE_WAY  |
+#if defined (HAVE_MEMFD_CREATE) && defined (HAVE_EVENTFD)
+                                      NIMF_CAPABILITY_SHM      |
+#endif
+                                      NIMF_CAPABILITY_LARGE_PAYLOAD);
+
+  reply = nimf_client_call (socket, icid, NIMF_MESSAGE_HELLO,
+                            &hello, sizeof (NimfHello), NULL);
+
+  if (reply && reply->header.data_len >= sizeof (NimfHello))
+  {
+    memcpy (&hello, reply->data, sizeof (NimfHello));
+    nimf_socket_set_capabilities (socket,
+                                  GUINT32_FROM_LE (hello.capabilities));
+  }
+
+  nimf_message_unref (reply);
+}
+
 gboolean
 nimf_client_is_connected ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return nimf_client_connection != NULL &&
          g_socket_connection_is_connected (nimf_client_connection);
@@ -222,9 +405,8 @@ nimf_client_is_connected ()
 static void
 nimf_client_init (NimfClient *client)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
-  static guint16 next_id = 0;
   guint16 id;
 
   if (nimf_client_table == NULL)
@@ -232,10 +414,10 @@ nimf_client_init (NimfClient *client)
                                                g_direct_equal,
                                                NULL,
                                                (GDestroyNotify) g_object_unref);
-  do
-    id = next_id++;
-  while (id == 0 || g_hash_table_contains (nimf_client_table,
-                                           GUINT_TO_POINTER (id)));
+  /* the lowest free id, so that the server's table of them stays short */
+  for (id = 1; g_hash_table_contains (nimf_client_table,
+                                      GUINT_TO_POINTER (id)); id++)
+    ;
   client->id = id;
 
   g_hash_table_insert (nimf_client_table,
@@ -246,7 +428,7 @@ nimf_client_init (NimfClient *client)
 static void
 nimf_client_constructed (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfClient *client = NIMF_CLIENT (object);
   GMutex mutex;
@@ -254,8 +436,10 @@ nimf_client_constructed (GObject *object)
   g_mutex_init (&mutex);
   g_mutex_lock (&mutex);
 
-  if (nimf_client_result == NULL)
-    nimf_client_result = g_slice_new0 (NimfResult);
+  if (nimf_client_pending == NULL)
+    nimf_client_pending =
+      g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                             (GDestroyNotify) nimf_message_unref);
 
   if (nimf_client_connection == NULL)
   {
@@ -303,22 +487,32 @@ nimf_client_constructed (GObject *object)
       return;
     }
 
-    if (G_UNLIKELY (nimf_client_socket_context == NULL))
+    if (nimf_client_source)
     {
-      nimf_client_socket_context = g_main_context_new ();
-
-      /* when g_main_context_iteration(), iterate only socket */
-      nimf_client_socket_source = g_socket_create_source (socket, G_IO_IN, NULL);
-      g_source_set_can_recurse (nimf_client_socket_source, TRUE);
-      g_source_set_callback (nimf_client_socket_source,
-                             (GSourceFunc) on_incoming_message, NULL, NULL);
-      g_source_attach (nimf_client_socket_source, nimf_client_socket_context);
-
-      nimf_client_default_source = g_socket_create_source (socket, G_IO_IN, NULL);
-      g_source_set_can_recurse (nimf_client_default_source, TRUE);
-      g_source_set_callback (nimf_client_default_source,
-                             (GSourceFunc) on_incoming_message, NULL, NULL);
-      g_source_attach (nimf_client_default_source, NULL);
+      g_source_destroy (nimf_client_source);
+      g_source_unref (nimf_client_source);
+    }
+
+    /* requests read their replies themselves; this source only picks up
+     * what arrives while nothing is waiting */
+    nimf_client_source = nimf_socket_source_new (socket);
+    g_source_set_callback (nimf_client_source,
+                           (GSourceFunc) on_incoming_message, NULL, NULL);
+    g_source_attach (nimf_client_source, NULL);
+
+    nimf_client_hello (socket, client->id);
+
+    if (nimf_socket_get_capabilities (socket) & NIMF_CAPABILITY_SHM)
+    {
+      guint32 seq = nimf_shm_offer (socket, client->id);
+
+      if (seq)
+      {
+        NimfMessage *reply = nimf_client_wait (socket, seq);
+
+        nimf_shm_complete (socket, reply && *(gboolean *) reply->data);
+        nimf_message_unref (reply);
+      }
     }
   }
   else
@@ -331,10 +525,10 @@ nimf_client_constructed (GObject *object)
     return;
   }
 
-  nimf_send_message (socket, client->id, NIMF_MESSAGE_CREATE_CONTEXT,
-                     &client->type, sizeof (NimfContextType), NULL);
-  nimf_result_iteration_until (nimf_client_result, nimf_client_socket_context,
-                               client->id, NIMF_MESSAGE_CREATE_CONTEXT_REPLY);
+  nimf_message_unref (nimf_client_call (socket, client->id,
+                                        NIMF_MESSAGE_CREATE_CONTEXT,
+                                        &client->type,
+                                        sizeof (NimfContextType), NULL));
 
   g_mutex_unlock (&mutex);
 
@@ -344,7 +538,7 @@ nimf_client_constructed (GObject *object)
 static void
 nimf_client_finalize (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfClient *client = NIMF_CLIENT (object);
 
@@ -358,28 +552,22 @@ nimf_client_finalize (GObject *object)
 
     if (socket && !g_socket_is_closed (socket))
     {
-      nimf_send_message (socket, client->id, NIMF_MESSAGE_DESTROY_CONTEXT,
-                         NULL, 0, NULL);
-      nimf_result_iteration_until (nimf_client_result, nimf_client_socket_context,
-                                   client->id, NIMF_MESSAGE_DESTROY_CONTEXT_REPLY);
+      nimf_message_unref (nimf_client_call (socket, client->id,
+                                            NIMF_MESSAGE_DESTROY_CONTEXT,
+                                            NULL, 0, NULL));
     }
 
     g_object_unref (nimf_client_connection);
 
     if (nimf_client_connection == NULL)
     {
-      g_source_destroy (nimf_client_socket_source);
-      g_source_destroy (nimf_client_default_source);
-      g_source_unref (nimf_client_socket_source);
-      g_source_unref (nimf_client_default_source);
-      g_main_context_unref (nimf_client_socket_context);
-      g_slice_free (NimfResult, nimf_client_result);
+      g_source_destroy (nimf_client_source);
+      g_source_unref (nimf_client_source);
+      g_hash_table_unref (nimf_client_pending);
       g_hash_table_unref (nimf_client_table);
-      nimf_client_socket_source  = NULL;
-      nimf_client_default_source = NULL;
-      nimf_client_socket_context = NULL;
-      nimf_client_result = NULL;
-      nimf_client_table  = NULL;
+      nimf_client_source  = NULL;
+      nimf_client_pending = NULL;
+      nimf_client_table   = NULL;
     }
   }
 
@@ -392,7 +580,7 @@ nimf_client_set_property (GObject      *object,
                           const GValue *value,
                           GParamSpec   *pspec)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfClient *client = NIMF_CLIENT (object);
 
@@ -413,7 +601,7 @@ nimf_client_get_property (GObject    *object,
                           GValue     *value,
                           GParamSpec *pspec)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfClient *client = NIMF_CLIENT (object);
 
@@ -431,7 +619,7 @@ nimf_client_get_property (GObject    *object,
 static void
 nimf_client_class_init (NimfClientClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GObjectClass *object_class = G_OBJECT_CLASS (class);
 
@@ -440,6 +628,10 @@ nimf_client_class_init (NimfClientClass *class)
   object_class->get_property = nimf_client_get_property;
   object_class->constructed  = nimf_client_constructed;
 
+  /* clients have no command line of ours to turn tracing on */
+  if (g_getenv ("NIMF_TRACE"))
+    nimf_trace_set_enabled (TRUE);
+
   g_object_class_install_property (object_class,
                                    PROP_CONTEXT_TYPE,
                                    g_param_spec_enum ("context-type",
@@ -20,6 +20,7 @@
  */
 
 #include "nimf-connection.h"
+#include "nimf-trace.h"
 #include "nimf-events.h"
 #include "nimf-marshalers.h"
 #include "nimf-private.h"
@@ -30,52 +31,397 @@
 
 G_DEFINE_TYPE (NimfConnection, nimf_connection, G_TYPE_OBJECT);
 
+/* a signal sent to the client, whose reply goes to @callback */
+typedef struct
+{
+  NimfEngine          *engine;
+  guint16              icid;
+  NimfEngineReplyFunc  callback;
+  gpointer             user_data;
+} NimfPendingReply;
+
+/* a message the main thread sends through the worker owning the socket */
+typedef struct
+{
+  NimfConnection *connection;
+  NimfMessage    *message;
+} NimfSendTask;
+
+static void
+nimf_send_task_run (NimfSendTask *task)
+{
+  NIMF_TRACE ();
+
+  GSocket     *socket  = task->connection->socket;
+  NimfMessage *message = task->message;
+
+  /* the client may have gone after it was posted */
+  if (g_socket_is_closed (socket))
+    return;
+
+  nimf_send_reply (socket, message->header.icid, message->header.type,
+                   message->header.seq, message->data,
+                   message->header.data_len, NULL);
+}
+
+static void
+nimf_send_task_free (NimfSendTask *task)
+{
+  g_object_unref (task->connection);
+  nimf_message_unref (task->message);
+  g_slice_free (NimfSendTask, task);
+}
+
+/* Only the thread which owns the socket writes to it.  Messages to a
+ * client of a worker are copied and posted to the worker, which sends
+ * them in the order they were posted. */
+gboolean
+nimf_connection_send_reply (NimfConnection  *connection,
+                            guint16          icid,
+                            NimfMessageType  type,
+                            guint32          seq,
+                            gconstpointer    data,
+                            guint32          data_len)
+{
+  NIMF_TRACE ();
+
+  NimfSendTask *task;
+
+  if (connection->worker == NULL)
+    return nimf_send_reply (connection->socket, icid, type, seq,
+                            (gpointer) data, data_len, NULL);
+
+  task = g_slice_new (NimfSendTask);
+  task->connection = g_object_ref (connection);
+  task->message = nimf_message_new_full (type, icid,
+                                         g_memdup (data, data_len), data_len,
+                                         g_free);
+  task->message->header.seq = seq;
+
+  nimf_server_invoke (connection->server, connection->worker,
+                      (NimfTaskFunc) nimf_send_task_run, task,
+                      (GDestroyNotify) nimf_send_task_free);
+
+  return TRUE;
+}
+
+/* Returns the sequence number of the message, or 0 if it could not be
+ * sent; see nimf_send_message(). */
+guint32
+nimf_connection_send_message (NimfConnection  *connection,
+                              guint16          icid,
+                              NimfMessageType  type,
+                              gconstpointer    data,
+                              guint32          data_len)
+{
+  NIMF_TRACE ();
+
+  guint32 seq;
+
+  if (connection->worker == NULL)
+    return nimf_send_message (connection->socket, icid, type,
+                              (gpointer) data, data_len, NULL);
+
+  seq = nimf_socket_next_seq (connection->socket);
+
+  if (!nimf_connection_send_reply (connection, icid, type, seq,
+                                   data, data_len))
+    return 0;
+
+  return seq;
+}
+
 void
 nimf_connection_set_engine_by_id (NimfConnection *connection,
                                   const gchar    *engine_id)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
-
-  GHashTableIter iter;
-  gpointer       context;
+  NIMF_TRACE ();
 
-  g_hash_table_iter_init (&iter, connection->contexts);
+  NimfContext *context;
+  guint        icid = 0;
 
-  while (g_hash_table_iter_next (&iter, NULL, &context))
-    if (((NimfContext *) context)->type != NIMF_CONTEXT_NIMF_AGENT)
+  while ((context = nimf_id_table_next (&connection->contexts, &icid)))
+    if (context->type != NIMF_CONTEXT_NIMF_AGENT)
       nimf_context_set_engine_by_id (context, engine_id);
 }
 
+void
+nimf_connection_begin_compound (NimfConnection *connection)
+{
+  NIMF_TRACE ();
+
+  /* A request dispatched while another waits for the client, e.g. for the
+   * surrounding text, joins its compound, which was flushed before the
+   * wait; it gives the compound back when it is done. */
+  if (connection->compound)
+  {
+    connection->compound_depth++;
+    return;
+  }
+
+  /* without it, signals are sent one by one as they are emitted */
+  if (!(nimf_socket_get_capabilities (connection->socket) &
+        NIMF_CAPABILITY_COMPOUND))
+    return;
+
+  if (connection->compound_buffer == NULL)
+    connection->compound_buffer = g_byte_array_sized_new (256);
+
+  connection->compound = connection->compound_buffer;
+  g_byte_array_set_size (connection->compound, NIMF_COMPOUND_PREFIX_SIZE);
+  memset (connection->compound->data, 0, NIMF_COMPOUND_PREFIX_SIZE);
+}
+
+void
+nimf_connection_end_compound (NimfConnection  *connection,
+                              guint16          icid,
+                              NimfMessageType  type,
+                              guint32          seq,
+                              gboolean         retval)
+{
+  NIMF_TRACE ();
+
+  GByteArray *compound = connection->compound;
+
+  if (compound == NULL)
+  {
+    gboolean prefix[NIMF_COMPOUND_PREFIX_SIZE / sizeof (gboolean)] = { retval };
+
+    nimf_connection_send_reply (connection, icid, type, seq,
+                                prefix, NIMF_COMPOUND_PREFIX_SIZE);
+    return;
+  }
+
+  *(gboolean *) compound->data = retval;
+
+  nimf_connection_send_reply (connection, icid, type, seq,
+                              compound->data, compound->len);
+
+  if (connection->compound_depth > 0)
+  {
+    connection->compound_depth--;
+    g_byte_array_set_size (compound, NIMF_COMPOUND_PREFIX_SIZE);
+    memset (compound->data, 0, NIMF_COMPOUND_PREFIX_SIZE);
+    return;
+  }
+
+  connection->compound = NULL;
+}
+
+/* Sends signals buffered so far, so that they reach the client before a
+ * message which must be sent right away, e.g. one waiting for a reply. */
+void
+nimf_connection_flush_compound (NimfConnection *connection,
+                                guint16         icid)
+{
+  NIMF_TRACE ();
+
+  GByteArray *compound = connection->compound;
+
+  if (compound == NULL || compound->len <= NIMF_COMPOUND_PREFIX_SIZE)
+    return;
+
+  nimf_connection_send_message (connection, icid, NIMF_MESSAGE_COMPOUND,
+                                compound->data, compound->len);
+  g_byte_array_set_size (compound, NIMF_COMPOUND_PREFIX_SIZE);
+}
+
+/* Ends a compound started for a one-way message, which has no reply to
+ * carry the signals. */
+void
+nimf_connection_finish_compound (NimfConnection *connection,
+                                 guint16         icid)
+{
+  NIMF_TRACE ();
+
+  if (connection->compound == NULL)
+    return;
+
+  nimf_connection_flush_compound (connection, icid);
+
+  if (connection->compound_depth > 0)
+    connection->compound_depth--;
+  else
+    connection->compound = NULL;
+}
+
+/* While the connection is collecting a compound reply, the signal is
+ * appended to it and sent along with the reply of the current request.
+ * Otherwise it is sent right away.  Either way the dispatcher goes on
+ * without waiting for the client; the reply of the client, if any, only
+ * acknowledges the signal and is ignored. */
+void
+nimf_connection_send_signal (NimfConnection  *connection,
+                             guint16          icid,
+                             NimfMessageType  type,
+                             gconstpointer    data,
+                             guint32          data_len)
+{
+  NIMF_TRACE ();
+
+  if (connection->compound)
+  {
+    if (connection->compound->len + sizeof (NimfMessageHeader) + data_len + 8 >
+        nimf_socket_get_max_data_len (connection->socket))
+      nimf_connection_flush_compound (connection, icid);
+
+    nimf_compound_append (connection->compound, icid, type, data, data_len);
+    return;
+  }
+
+  nimf_connection_send_message (connection, icid, type, data, data_len);
+}
+
+/* Remembers that a context of @connection used @engine, one shared by all
+ * contexts in singleton mode, so that only engines it used are reset when
+ * it goes. */
+void
+nimf_connection_touch_engine (NimfConnection *connection,
+                              NimfEngine     *engine)
+{
+  NIMF_TRACE ();
+
+  guint i;
+
+  if (G_UNLIKELY (connection->engines == NULL))
+    connection->engines = g_ptr_array_new ();
+
+  for (i = 0; i < connection->engines->len; i++)
+    if (g_ptr_array_index (connection->engines, i) == engine)
+      return;
+
+  g_ptr_array_add (connection->engines, engine);
+}
+
+void
+nimf_connection_add_pending_reply (NimfConnection      *connection,
+                                   guint32              seq,
+                                   NimfEngine          *engine,
+                                   guint16              icid,
+                                   NimfEngineReplyFunc  callback,
+                                   gpointer             user_data)
+{
+  NIMF_TRACE ();
+
+  NimfPendingReply *pending;
+
+  pending = g_slice_new (NimfPendingReply);
+  pending->engine    = g_object_ref (engine);
+  pending->icid      = icid;
+  pending->callback  = callback;
+  pending->user_data = user_data;
+
+  g_hash_table_insert (connection->pending_replies,
+                       GUINT_TO_POINTER (seq), pending);
+}
+
+static void
+nimf_pending_reply_invoke (NimfConnection   *connection,
+                           NimfPendingReply *pending,
+                           gboolean          retval)
+{
+  NimfContext *context;
+
+  /* NULL if the context has been destroyed meanwhile */
+  context = nimf_id_table_lookup (&connection->contexts, pending->icid);
+  pending->callback (pending->engine, context, context ? retval : FALSE,
+                     pending->user_data);
+
+  g_object_unref (pending->engine);
+  g_slice_free (NimfPendingReply, pending);
+}
+
+/* Passes the reply to the callback added for @seq, if any; a reply to a
+ * blocking emission has none. */
+void
+nimf_connection_complete_reply (NimfConnection *connection,
+                                guint32         seq,
+                                gboolean        retval)
+{
+  NIMF_TRACE ();
+
+  NimfPendingReply *pending;
+
+  pending = g_hash_table_lookup (connection->pending_replies,
+                                 GUINT_TO_POINTER (seq));
+  if (pending == NULL)
+    return;
+
+  g_hash_table_remove (connection->pending_replies, GUINT_TO_POINTER (seq));
+  nimf_pending_reply_invoke (connection, pending, retval);
+}
+
+/* Frees the contexts of @connection, whose client has gone, in the main
+ * thread, which runs their engines; callbacks get their contexts before
+ * they go. */
+void
+nimf_connection_close (NimfConnection *connection)
+{
+  NIMF_TRACE ();
+
+  NimfContext *context;
+  guint        icid;
+
+  while (g_hash_table_size (connection->pending_replies) > 0)
+  {
+    GList *pendings, *l;
+
+    pendings = g_hash_table_get_values (connection->pending_replies);
+    g_hash_table_remove_all (connection->pending_replies);
+
+    for (l = pendings; l; l = l->next)
+      nimf_pending_reply_invoke (connection, l->data, FALSE);
+
+    g_list_free (pendings);
+  }
+
+  for (icid = 0; (context = nimf_id_table_next (&connection->contexts, &icid)); )
+    nimf_context_free (context);
+
+  nimf_id_table_clear (&connection->contexts);
+}
+
 static void
 nimf_connection_init (NimfConnection *connection)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   connection->result = g_slice_new0 (NimfResult);
-  connection->contexts = g_hash_table_new_full (g_direct_hash, g_direct_equal,
-                                                NULL,
-                                                (GDestroyNotify) nimf_context_free);
+  nimf_id_table_init (&connection->contexts);
+  connection->pending_replies = g_hash_table_new (g_direct_hash,
+                                                  g_direct_equal);
 }
 
 static void
 nimf_connection_finalize (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfConnection *connection = NIMF_CONNECTION (object);
+
+  /* if still open, before the socket goes */
+  nimf_connection_close (connection);
   nimf_message_unref (connection->result->reply);
 
+  /* the socket set is shared with the other connections of the thread */
   if (connection->source)
   {
-    g_source_destroy (connection->source);
-    g_source_unref   (connection->source);
+    nimf_socket_set_remove (connection->source, connection->socket);
+    g_source_unref (connection->source);
   }
 
   if (connection->socket_connection)
     g_object_unref (connection->socket_connection);
 
   g_slice_free (NimfResult, connection->result);
-  g_hash_table_unref (connection->contexts);
+
+  g_hash_table_unref (connection->pending_replies);
+
+  if (connection->compound_buffer)
+    g_byte_array_unref (connection->compound_buffer);
+
+  if (connection->engines)
+    g_ptr_array_unref (connection->engines);
 
   G_OBJECT_CLASS (nimf_connection_parent_class)->finalize (object);
 }
@@ -83,7 +429,7 @@ nimf_connection_finalize (GObject *object)
 static void
 nimf_connection_class_init (NimfConnectionClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GObjectClass *object_class = G_OBJECT_CLASS (class);
   object_class->finalize = nimf_connection_finalize;
@@ -92,7 +438,7 @@ nimf_connection_class_init (NimfConnectionClass *class)
 NimfConnection *
 nimf_connection_new ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return g_object_new (NIMF_TYPE_CONNECTION, NULL);
 }
@@ -100,7 +446,7 @@ nimf_connection_new ()
 guint16
 nimf_connection_get_id (NimfConnection *connection)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_CONNECTION (connection), 0);
 
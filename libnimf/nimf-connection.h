@@ -30,6 +30,7 @@
 #include "nimf-engine.h"
 #include "nimf-server.h"
 #include "nimf-private.h"
+#include "nimf-worker.h"
 #include <X11/Xlib.h>
 
 G_BEGIN_DECLS
@@ -58,7 +59,13 @@ struct _NimfConnection
   NimfResult        *result;
   GSource           *source;
   GSocketConnection *socket_connection;
-  GHashTable        *contexts;
+  NimfIdTable        contexts;
+  GByteArray        *compound;
+  GByteArray        *compound_buffer; /* kept for the next compound */
+  guint              compound_depth; /* of requests nested in it */
+  GHashTable        *pending_replies; /* seq -> NimfPendingReply */
+  NimfWorker        *worker; /* owns the socket; NULL for the main context */
+  GPtrArray         *engines; /* shared engines its contexts used */
 };
 
 struct _NimfConnectionClass
@@ -71,6 +78,44 @@ NimfConnection *nimf_connection_new              (void);
 guint16         nimf_connection_get_id           (NimfConnection  *connection);
 void            nimf_connection_set_engine_by_id (NimfConnection  *connection,
                                                   const gchar     *engine_id);
+void            nimf_connection_begin_compound   (NimfConnection  *connection);
+void            nimf_connection_end_compound     (NimfConnection  *connection,
+                                                  guint16          icid,
+                                                  NimfMessageType  type,
+                                                  guint32          seq,
+                                                  gboolean         retval);
+void            nimf_connection_flush_compound   (NimfConnection  *connection,
+                                                  guint16          icid);
+void            nimf_connection_finish_compound  (NimfConnection  *connection,
+                                                  guint16          icid);
+gboolean        nimf_connection_send_reply       (NimfConnection  *connection,
+                                                  guint16          icid,
+                                                  NimfMessageType  type,
+                                                  guint32          seq,
+                                                  gconstpointer    data,
+                                                  guint32          data_len);
+guint32         nimf_connection_send_message     (NimfConnection  *connection,
+                                                  guint16          icid,
+                                                  NimfMessageType  type,
+                                                  gconstpointer    data,
+                                                  guint32          data_len);
+void            nimf_connection_send_signal      (NimfConnection  *connection,
+                                                  guint16          icid,
+                                                  NimfMessageType  type,
+                                                  gconstpointer    data,
+                                                  guint32          data_len);
+void            nimf_connection_touch_engine     (NimfConnection  *connection,
+                                                  NimfEngine      *engine);
+void            nimf_connection_add_pending_reply (NimfConnection     *connection,
+                                                   guint32             seq,
+                                                   NimfEngine         *engine,
+                                                   guint16             icid,
+                                                   NimfEngineReplyFunc callback,
+                                                   gpointer            user_data);
+void            nimf_connection_complete_reply    (NimfConnection     *connection,
+                                                   guint32             seq,
+                                                   gboolean            retval);
+void            nimf_connection_close             (NimfConnection     *connection);
 G_END_DECLS
 
 #endif /* __NIMF_CONNECTION_H__ */
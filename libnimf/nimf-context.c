@@ -20,7 +20,7 @@
  */
 
 #include "nimf-context.h"
-#include "nimf-module.h"
+#include "nimf-trace.h"
 #include <string.h>
 #include <X11/Xutil.h>
 #include "IMdkit/Xi18n.h"
@@ -28,7 +28,7 @@
 void
 nimf_context_emit_preedit_start (NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (G_UNLIKELY (!context))
     return;
@@ -40,11 +40,8 @@ nimf_context_emit_preedit_start (NimfContext *context)
                       context->preedit_state == NIMF_PREEDIT_STATE_END))
         return;
 
-      nimf_send_message (context->connection->socket, context->icid,
-                         NIMF_MESSAGE_PREEDIT_START, NULL, 0, NULL);
-      nimf_result_iteration_until (context->connection->result, NULL,
-                                   context->icid,
-                                   NIMF_MESSAGE_PREEDIT_START_REPLY);
+      nimf_connection_send_signal (context->connection, context->icid,
+                                   NIMF_MESSAGE_PREEDIT_START, NULL, 0);
       context->preedit_state = NIMF_PREEDIT_STATE_START;
       break;
     case NIMF_CONTEXT_XIM:
@@ -74,7 +71,7 @@ nimf_context_emit_preedit_changed (NimfContext      *context,
                                    NimfPreeditAttr **attrs,
                                    gint              cursor_pos)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (G_UNLIKELY (!context))
     return;
@@ -94,6 +91,7 @@ nimf_context_emit_preedit_changed (NimfContext      *context,
         return;
 
       {
+        gchar  buf[256]; /* most preedits fit, without an allocation */
         gchar *data;
         gsize  data_len;
         gint   str_len = strlen (preedit_string);
@@ -104,7 +102,8 @@ nimf_context_emit_preedit_changed (NimfContext      *context,
           n_attr++;
 
         data_len = str_len + 1 + n_attr * sizeof (NimfPreeditAttr) + sizeof (gint);
-        data = g_strndup (preedit_string, data_len - 1);
+        data = data_len <= sizeof (buf) ? buf : g_malloc (data_len);
+        memcpy (data, preedit_string, str_len + 1);
 
         for (i = 0; attrs[i] != NULL; i++)
           *(NimfPreeditAttr *)
@@ -112,12 +111,11 @@ nimf_context_emit_preedit_changed (NimfContext      *context,
 
         *(gint *) (data + data_len - sizeof (gint)) = cursor_pos;
 
-        nimf_send_message (context->connection->socket, context->icid,
-                           NIMF_MESSAGE_PREEDIT_CHANGED,
-                           data, data_len, g_free);
-        nimf_result_iteration_until (context->connection->result, NULL,
-                                     context->icid,
-                                     NIMF_MESSAGE_PREEDIT_CHANGED_REPLY);
+        nimf_connection_send_signal (context->connection, context->icid,
+                                     NIMF_MESSAGE_PREEDIT_CHANGED,
+                                     data, data_len);
+        if (data != buf)
+          g_free (data);
       }
       break;
     case NIMF_CONTEXT_XIM:
@@ -126,12 +124,30 @@ nimf_context_emit_preedit_changed (NimfContext      *context,
         IMPreeditCBStruct preedit_cb_data = {0};
         XIMText           text;
         XTextProperty     text_property;
-
-        static XIMFeedback *feedback;
-        gint i, j, len;
+        XIMFeedback      *feedback;
+        XIMFeedback      *drawn_feedback;
+        XIMFeedback       saved;
+        const gchar      *drawn;
+        const gchar      *p, *q;
+        gchar            *changed;
+        gint i, j, len, drawn_len, first, last;
 
         len = g_utf8_strlen (preedit_string, -1);
-        feedback = g_malloc0 (sizeof (XIMFeedback) * (len + 1));
+
+        /* one buffer for the feedback drawn last, one for the new one */
+        if (context->xim_feedback_size < len + 1)
+        {
+          context->xim_feedback_size = len + 1;
+          context->xim_feedback      = g_renew (XIMFeedback,
+                                                context->xim_feedback,
+                                                len + 1);
+          context->xim_feedback_next = g_renew (XIMFeedback,
+                                                context->xim_feedback_next,
+                                                len + 1);
+        }
+
+        feedback = context->xim_feedback_next;
+        memset (feedback, 0, sizeof (XIMFeedback) * (len + 1));
 
         for (i = 0; attrs[i]; i++)
         {
@@ -150,24 +166,62 @@ nimf_context_emit_preedit_changed (NimfContext      *context,
           }
         }
 
-        feedback[len] = 0;
+        /* only the characters between the common head and tail of what
+         * was drawn last and the new preedit are drawn again */
+        drawn          = context->xim_preedit_string ?
+                         context->xim_preedit_string : "";
+        drawn_len      = context->xim_preedit_length;
+        drawn_feedback = context->xim_feedback;
+
+        for (first = 0, p = drawn, q = preedit_string;
+             first < drawn_len && first < len;
+             first++, p = g_utf8_next_char (p), q = g_utf8_next_char (q))
+          if (g_utf8_get_char (p) != g_utf8_get_char (q) ||
+              drawn_feedback[first] != feedback[first])
+            break;
+
+        p = drawn + strlen (drawn);
+        q = preedit_string + strlen (preedit_string);
+
+        for (last = 0; first + last < drawn_len && first + last < len; last++)
+        {
+          const gchar *prev_p = g_utf8_prev_char (p);
+          const gchar *prev_q = g_utf8_prev_char (q);
+
+          if (g_utf8_get_char (prev_p) != g_utf8_get_char (prev_q) ||
+              drawn_feedback[drawn_len - last - 1] != feedback[len - last - 1])
+            break;
+
+          p = prev_p;
+          q = prev_q;
+        }
+
+        if (first == len && len == drawn_len)
+          break;
+
+        changed = g_strndup (g_utf8_offset_to_pointer (preedit_string, first),
+                             q - g_utf8_offset_to_pointer (preedit_string,
+                                                           first));
 
         preedit_cb_data.major_code = XIM_PREEDIT_DRAW;
         preedit_cb_data.connect_id = context->xim_connect_id;
         preedit_cb_data.icid = context->icid;
         preedit_cb_data.todo.draw.caret = len;
-        preedit_cb_data.todo.draw.chg_first = 0;
-        preedit_cb_data.todo.draw.chg_length = context->xim_preedit_length;
+        preedit_cb_data.todo.draw.chg_first = first;
+        preedit_cb_data.todo.draw.chg_length = drawn_len - first - last;
         preedit_cb_data.todo.draw.text = &text;
 
-        text.feedback = feedback;
+        /* the feedback of the span ends where the span does */
+        saved = feedback[len - last];
+        feedback[len - last] = 0;
+        text.feedback = feedback + first;
+        text.encoding_is_wchar = 0;
 
-        if (len > 0)
+        if (changed[0] && !context->xim_utf8_string)
         {
           Xutf8TextListToTextProperty (xims->core.display,
-                                       (char **) &preedit_string, 1,
+                                       &changed, 1,
                                        XCompoundTextStyle, &text_property);
-          text.encoding_is_wchar = 0;
           text.length = strlen ((char *) text_property.value);
           text.string.multi_byte = (char *) text_property.value;
           IMCallCallback (xims, (XPointer) &preedit_cb_data);
@@ -175,16 +229,19 @@ nimf_context_emit_preedit_changed (NimfContext      *context,
         }
         else
         {
-          text.encoding_is_wchar = 0;
-          text.length = 0;
-          text.string.multi_byte = "";
+          text.length = strlen (changed);
+          text.string.multi_byte = changed;
           IMCallCallback (xims, (XPointer) &preedit_cb_data);
-          len = 0;
         }
 
-        context->xim_preedit_length = len;
+        feedback[len - last] = saved;
+        g_free (changed);
 
-        g_free (feedback);
+        g_free (context->xim_preedit_string);
+        context->xim_preedit_string = g_strdup (preedit_string);
+        context->xim_preedit_length = len;
+        context->xim_feedback_next  = context->xim_feedback;
+        context->xim_feedback       = feedback;
       }
       break;
     default:
@@ -196,7 +253,7 @@ nimf_context_emit_preedit_changed (NimfContext      *context,
 void
 nimf_context_emit_preedit_end (NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (G_UNLIKELY (!context))
     return;
@@ -208,11 +265,8 @@ nimf_context_emit_preedit_end (NimfContext *context)
                       context->preedit_state == NIMF_PREEDIT_STATE_END))
         return;
 
-      nimf_send_message (context->connection->socket, context->icid,
-                         NIMF_MESSAGE_PREEDIT_END, NULL, 0, NULL);
-      nimf_result_iteration_until (context->connection->result, NULL,
-                                   context->icid,
-                                   NIMF_MESSAGE_PREEDIT_END_REPLY);
+      nimf_connection_send_signal (context->connection, context->icid,
+                                   NIMF_MESSAGE_PREEDIT_END, NULL, 0);
       context->preedit_state = NIMF_PREEDIT_STATE_END;
       break;
     case NIMF_CONTEXT_XIM:
@@ -228,6 +282,11 @@ nimf_context_emit_preedit_end (NimfContext *context)
         preedit_cb_data.connect_id = context->xim_connect_id;
         preedit_cb_data.icid       = context->icid;
         IMCallCallback (xims, (XPointer) &preedit_cb_data);
+
+        /* the client has dropped its preedit */
+        g_free (context->xim_preedit_string);
+        context->xim_preedit_string = NULL;
+        context->xim_preedit_length = 0;
       }
       break;
     default:
@@ -240,7 +299,7 @@ void
 nimf_context_emit_commit (NimfContext *context,
                           const gchar *text)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (G_UNLIKELY (!context))
     return;
@@ -248,30 +307,31 @@ nimf_context_emit_commit (NimfContext *context,
   switch (context->type)
   {
     case NIMF_CONTEXT_NIMF_IM:
-      nimf_send_message (context->connection->socket, context->icid,
-                         NIMF_MESSAGE_COMMIT,
-                         (gchar *) text, strlen (text) + 1, NULL);
-      nimf_result_iteration_until (context->connection->result, NULL,
-                                   context->icid,
-                                   NIMF_MESSAGE_COMMIT_REPLY);
+      nimf_connection_send_signal (context->connection, context->icid,
+                                   NIMF_MESSAGE_COMMIT,
+                                   (gchar *) text, strlen (text) + 1);
       break;
     case NIMF_CONTEXT_XIM:
       {
         XIMS xims = context->cb_user_data;
-        XTextProperty property;
-        Xutf8TextListToTextProperty (xims->core.display,
-                                     (char **)&text, 1, XCompoundTextStyle,
-                                     &property);
+        XTextProperty property = {0};
+
+        if (!context->xim_utf8_string)
+          Xutf8TextListToTextProperty (xims->core.display,
+                                       (char **)&text, 1, XCompoundTextStyle,
+                                       &property);
 
         IMCommitStruct commit_data = {0};
         commit_data.major_code = XIM_COMMIT;
         commit_data.connect_id = context->xim_connect_id;
         commit_data.icid       = context->icid;
         commit_data.flag       = XimLookupChars;
-        commit_data.commit_string = (gchar *) property.value;
+        commit_data.commit_string = property.value ? (gchar *) property.value
+                                                   : (gchar *) text;
         IMCommitString (xims, (XPointer) &commit_data);
 
-        XFree (property.value);
+        if (property.value)
+          XFree (property.value);
       }
       break;
     default:
@@ -280,19 +340,29 @@ nimf_context_emit_commit (NimfContext *context,
   }
 }
 
+/* The blocking forms below iterate the main context of the calling thread
+ * until the reply, so that other connections are dispatched inside the
+ * caller; the _async forms return at once and pass the reply to a
+ * callback. */
 gboolean
 nimf_context_emit_retrieve_surrounding (NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (G_UNLIKELY (!context))
     return FALSE;
 
-  nimf_send_message (context->connection->socket, context->icid,
-                     NIMF_MESSAGE_RETRIEVE_SURROUNDING, NULL, 0, NULL);
-  nimf_result_iteration_until (context->connection->result, NULL,
-                               context->icid,
-                               NIMF_MESSAGE_RETRIEVE_SURROUNDING_REPLY);
+  guint32 seq;
+
+  nimf_connection_flush_compound (context->connection, context->icid);
+  seq = nimf_connection_send_message (context->connection, context->icid,
+                                      NIMF_MESSAGE_RETRIEVE_SURROUNDING,
+                                      NULL, 0);
+  if (seq == 0)
+    return FALSE;
+
+  nimf_result_iteration_until (context->connection->result,
+                               g_main_context_get_thread_default (), seq);
 
   if (context->connection->result->reply == NULL)
     return FALSE;
@@ -305,21 +375,23 @@ nimf_context_emit_delete_surrounding (NimfContext *context,
                                       gint         offset,
                                       gint         n_chars)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (G_UNLIKELY (!context))
     return FALSE;
 
-  gint *data = g_malloc (2 * sizeof (gint));
-  data[0] = offset;
-  data[1] = n_chars;
+  gint    data[2] = { offset, n_chars };
+  guint32 seq;
 
-  nimf_send_message (context->connection->socket, context->icid,
-                     NIMF_MESSAGE_DELETE_SURROUNDING,
-                     data, 2 * sizeof (gint), g_free);
-  nimf_result_iteration_until (context->connection->result, NULL,
-                               context->icid,
-                               NIMF_MESSAGE_DELETE_SURROUNDING_REPLY);
+  nimf_connection_flush_compound (context->connection, context->icid);
+  seq = nimf_connection_send_message (context->connection, context->icid,
+                                      NIMF_MESSAGE_DELETE_SURROUNDING,
+                                      data, 2 * sizeof (gint));
+  if (seq == 0)
+    return FALSE;
+
+  nimf_result_iteration_until (context->connection->result,
+                               g_main_context_get_thread_default (), seq);
 
   if (context->connection->result->reply == NULL)
     return FALSE;
@@ -327,199 +399,337 @@ nimf_context_emit_delete_surrounding (NimfContext *context,
   return *(gboolean *) (context->connection->result->reply->data);
 }
 
+/* @callback may be called before this returns, if the signal can not be
+ * sent */
+void
+nimf_context_emit_retrieve_surrounding_async (NimfContext         *context,
+                                              NimfEngine          *engine,
+                                              NimfEngineReplyFunc  callback,
+                                              gpointer             user_data)
+{
+  NIMF_TRACE ();
+
+  guint32 seq = 0;
+
+  if (G_LIKELY (context && context->type == NIMF_CONTEXT_NIMF_IM))
+  {
+    nimf_connection_flush_compound (context->connection, context->icid);
+    seq = nimf_connection_send_message (context->connection, context->icid,
+                                        NIMF_MESSAGE_RETRIEVE_SURROUNDING,
+                                        NULL, 0);
+  }
+
+  if (seq == 0)
+  {
+    callback (engine, context, FALSE, user_data);
+    return;
+  }
+
+  nimf_connection_add_pending_reply (context->connection, seq, engine,
+                                     context->icid, callback, user_data);
+}
+
+void
+nimf_context_emit_delete_surrounding_async (NimfContext         *context,
+                                            NimfEngine          *engine,
+                                            gint                 offset,
+                                            gint                 n_chars,
+                                            NimfEngineReplyFunc  callback,
+                                            gpointer             user_data)
+{
+  NIMF_TRACE ();
+
+  guint32 seq = 0;
+
+  if (G_LIKELY (context && context->type == NIMF_CONTEXT_NIMF_IM))
+  {
+    gint data[2] = { offset, n_chars };
+
+    nimf_connection_flush_compound (context->connection, context->icid);
+    seq = nimf_connection_send_message (context->connection, context->icid,
+                                        NIMF_MESSAGE_DELETE_SURROUNDING,
+                                        data, 2 * sizeof (gint));
+  }
+
+  if (seq == 0)
+  {
+    callback (engine, context, FALSE, user_data);
+    return;
+  }
+
+  nimf_connection_add_pending_reply (context->connection, seq, engine,
+                                     context->icid, callback, user_data);
+}
+
 void
 nimf_context_emit_engine_changed (NimfContext *context,
                                   const gchar *name)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (G_UNLIKELY (!context))
     return;
 
-  gpointer       agent;
-  GHashTableIter iter;
+  nimf_server_emit_engine_changed (context->server, name);
+}
+
+/* The instance at @index owned by @context, taken from the pool of the
+ * server or created the first time the context uses the engine; it is of
+ * the type of the one the server has there. */
+static NimfEngine *
+nimf_context_get_nth_instance (NimfContext *context, guint index)
+{
+  NIMF_TRACE ();
+
+  NimfEngine *prototype;
+  GType       type;
+
+  if (G_UNLIKELY (context->engines == NULL))
+    context->engines = g_new0 (NimfEngine *, context->server->instances->len);
+
+  if (context->engines[index])
+    return context->engines[index];
 
-  g_hash_table_iter_init (&iter, context->server->agents);
+  prototype = g_ptr_array_index (context->server->instances, index);
+  type      = G_OBJECT_TYPE (prototype);
 
-  while (g_hash_table_iter_next (&iter, NULL, &agent))
-    nimf_send_message (((NimfContext *) agent)->connection->socket,
-                       ((NimfContext *) agent)->icid,
-                       NIMF_MESSAGE_ENGINE_CHANGED,
-                       (gchar *) name, strlen (name) + 1, NULL);
+  context->engines[index] = nimf_server_take_pooled_engine (context->server,
+                                                            type);
+  if (context->engines[index] == NULL)
+    context->engines[index] = g_object_new (type, "server", context->server,
+                                            NULL);
+
+  return context->engines[index];
 }
 
-void nimf_context_focus_in (NimfContext *context)
+static NimfEngine *
+nimf_context_get_instance (NimfContext *context, const gchar *engine_id)
 {
-  g_return_if_fail (context != NULL);
+  NIMF_TRACE ();
 
-  g_debug (G_STRLOC ": %s: context icid = %d", G_STRFUNC, context->icid);
+  gint index = nimf_server_get_instance_index (context->server, engine_id);
 
-  if (G_UNLIKELY (context->engine == NULL))
-    return;
+  if (index < 0)
+    return NULL;
 
-  nimf_engine_focus_in (context->engine, context);
-  nimf_context_emit_engine_changed (context,
-                                    nimf_engine_get_icon_name (context->engine));
+  return nimf_context_get_nth_instance (context, index);
 }
 
-void nimf_context_focus_out (NimfContext *context)
+/* Gives the engine instances of an idle context back to the pool of the
+ * server, keeping only the id of the engine in use; preedit buffers are
+ * shrunk too.  nimf_context_wake() undoes it. */
+void
+nimf_context_hibernate (NimfContext *context)
 {
-  g_return_if_fail (context != NULL);
+  NIMF_TRACE ();
 
-  g_debug (G_STRLOC ": %s: context icid = %d", G_STRFUNC, context->icid);
+  guint i;
 
-  if (G_UNLIKELY (context->engine == NULL))
+  if (context->engines == NULL)
     return;
 
-  nimf_engine_focus_out (context->engine, context);
-  nimf_context_emit_engine_changed (context, "nimf-indicator");
+  if (context->engine)
+    context->hibernated_engine =
+      nimf_server_get_instance_index (context->server,
+                                      nimf_engine_get_id (context->engine));
+
+  for (i = 0; i < context->server->instances->len; i++)
+  {
+    if (context->engines[i] == NULL)
+      continue;
+
+    nimf_engine_reset (context->engines[i], context);
+    nimf_server_pool_engine (context->server, context->engines[i]);
+  }
+
+  g_free (context->engines);
+  context->engines = NULL;
+  context->engine  = NULL;
+
+  g_free (context->preedit_string);
+  nimf_preedit_attr_freev (context->preedit_attrs);
+  context->preedit_string     = g_strdup ("");
+  context->preedit_attrs      = g_malloc0_n (1, sizeof (NimfPreeditAttr *));
+  context->preedit_cursor_pos = 0;
 }
 
-static gint
-on_comparing_engine_with_id (NimfEngine *engine, const gchar *id)
+static void
+nimf_context_wake (NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
+
+  if (G_LIKELY (context->hibernated_engine < 0))
+    return;
 
-  return g_strcmp0 (nimf_engine_get_id (engine), id);
+  context->engine = nimf_context_get_nth_instance (context,
+                                                   context->hibernated_engine);
+  context->hibernated_engine = -1;
+  nimf_engine_set_cursor_location (context->engine, &context->cursor_area);
 }
 
-static GList *
-nimf_context_create_engines (NimfContext *context)
+/* Switches to the engine selected for all contexts since @context last
+ * looked, see nimf_server_set_engine_by_id(). */
+static void
+nimf_context_sync_engine (NimfContext *context)
 {
-  GList *engines = NULL;
-  GHashTableIter iter;
-  gpointer       module;
+  NIMF_TRACE ();
 
-  g_hash_table_iter_init (&iter, context->server->modules);
+  NimfServer *server = context->server;
+  gint        epoch  = server->engine_epoch;
+  gint        index;
 
-  while (g_hash_table_iter_next (&iter, NULL, &module))
-  {
-    NimfEngine *engine;
-    engine = g_object_new (NIMF_MODULE (module)->type, "server",
-                           context->server, NULL);
-    engines = g_list_prepend (engines, engine);
-  }
+  if (G_LIKELY (context->engine_epoch == epoch) ||
+      context->type == NIMF_CONTEXT_NIMF_AGENT)
+    return;
 
-  return engines;
+  context->engine_epoch = epoch;
+  index = server->selected_engine;
+
+  if (server->use_singleton)
+    context->engine = g_ptr_array_index (server->instances, index);
+  else
+    context->engine = nimf_context_get_nth_instance (context, index);
 }
 
-static NimfEngine *
-nimf_context_get_instance (NimfContext *context, const gchar *engine_id)
+void nimf_context_focus_in (NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  g_return_if_fail (context != NULL);
 
-  GList *list;
+  g_debug (G_STRLOC ": %s: context icid = %d", G_STRFUNC, context->icid);
 
-  if (context->engines == NULL)
-    context->engines = nimf_context_create_engines (context);
+  nimf_context_wake (context);
+  nimf_context_sync_engine (context);
+  context->unfocused_since = 0;
 
-  list = g_list_find_custom (g_list_first (context->engines), engine_id,
-                             (GCompareFunc) on_comparing_engine_with_id);
-  if (list)
-    return list->data;
+  if (G_UNLIKELY (context->engine == NULL))
+    return;
 
-  return NULL;
+  nimf_engine_focus_in (context->engine, context);
+  nimf_context_emit_engine_changed (context,
+                                    nimf_engine_get_icon_name (context->engine));
 }
 
-static NimfEngine *
-nimf_context_get_next_instance (NimfContext *context, NimfEngine *engine)
+void nimf_context_focus_out (NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  g_return_if_fail (context != NULL);
 
-  GList *list;
+  g_debug (G_STRLOC ": %s: context icid = %d", G_STRFUNC, context->icid);
 
-  if (context->engines == NULL)
-    context->engines = nimf_context_create_engines (context);
+  context->unfocused_since = g_get_monotonic_time ();
 
-  context->engines = g_list_first (context->engines);
-  context->engines = g_list_find  (context->engines, engine);
+  if (G_UNLIKELY (context->engine == NULL))
+    return;
 
-  list = g_list_next (context->engines);
+  nimf_engine_focus_out (context->engine, context);
+  nimf_context_emit_engine_changed (context, "nimf-indicator");
+}
 
-  if (list == NULL)
-    list = g_list_first (context->engines);
+/* in the order of the instances of the server */
+static NimfEngine *
+nimf_context_get_next_instance (NimfContext *context, NimfEngine *engine)
+{
+  NIMF_TRACE ();
 
-  if (list)
-  {
-    context->engines = list;
-    return list->data;
-  }
+  gint index;
 
-  g_assert (list != NULL);
+  index = nimf_server_get_instance_index (context->server,
+                                          nimf_engine_get_id (engine));
 
-  return engine;
+  return nimf_context_get_nth_instance (context,
+                                        (index + 1) % context->server->instances->len);
 }
 
-gboolean nimf_context_filter_event (NimfContext *context,
-                                    NimfEvent   *event)
+/* Returns TRUE if @event is a trigger key or a hotkey, which switches the
+ * engine of @context instead of reaching it. */
+static gboolean
+nimf_context_filter_keys (NimfContext *context,
+                          NimfEvent   *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
-  g_return_val_if_fail (context != NULL, FALSE);
+  NimfKeyAction     *action;
+  NimfKeyActionType  type;
+  gchar             *trigger_id;
 
-  if (G_UNLIKELY (context->engine == NULL))
+  action = nimf_key_table_lookup (&context->server->keys, event);
+
+  if (action == NULL)
     return FALSE;
 
-  GHashTableIter iter;
-  gpointer       trigger_keys;
-  gpointer       engine_id;
+  /* the table may be rebuilt while the engine is reset */
+  type       = action->type;
+  trigger_id = g_strdup (action->engine_id);
 
-  g_hash_table_iter_init (&iter, context->server->trigger_keys);
+  if (event->key.type != NIMF_EVENT_KEY_PRESS)
+  {
+    g_free (trigger_id);
+    return TRUE;
+  }
 
-  while (g_hash_table_iter_next (&iter, &trigger_keys, &engine_id))
+  nimf_context_reset (context);
+
+  if (type == NIMF_KEY_ACTION_TRIGGER)
   {
-    if (nimf_event_matches (event, trigger_keys))
+    if (g_strcmp0 (nimf_engine_get_id (context->engine), trigger_id) != 0)
     {
-      if (event->key.type == NIMF_EVENT_KEY_PRESS)
-      {
-        nimf_context_reset (context);
+      if (context->server->use_singleton)
+        context->engine = nimf_server_get_instance (context->server,
+                                                    trigger_id);
+      else
+        context->engine = nimf_context_get_instance (context, trigger_id);
+    }
+    else
+    {
+      if (context->server->use_singleton)
+        context->engine = nimf_server_get_instance (context->server,
+                                                    "nimf-system-keyboard");
+      else
+        context->engine = nimf_context_get_instance (context,
+                                                     "nimf-system-keyboard");
+    }
+  }
+  else
+  {
+    if (context->server->use_singleton)
+      context->engine = nimf_server_get_next_instance (context->server,
+                                                       context->engine);
+    else
+      context->engine = nimf_context_get_next_instance (context,
+                                                        context->engine);
+  }
 
-        if (g_strcmp0 (nimf_engine_get_id (context->engine), engine_id) != 0)
-        {
-          if (context->server->use_singleton)
-            context->engine = nimf_server_get_instance (context->server,
-                                                        engine_id);
-          else
-            context->engine = nimf_context_get_instance (context, engine_id);
-        }
-        else
-        {
-          if (context->server->use_singleton)
-            context->engine = nimf_server_get_instance (context->server,
-                                                        "nimf-system-keyboard");
-          else
-            context->engine = nimf_context_get_instance (context,
-                                                         "nimf-system-keyboard");
-        }
+  nimf_context_emit_engine_changed (context,
+                                    nimf_engine_get_icon_name (context->engine));
+  g_free (trigger_id);
 
-        nimf_context_emit_engine_changed (context,
-                                          nimf_engine_get_icon_name (context->engine));
-      }
+  return TRUE;
+}
 
-      return TRUE;
-    }
-  }
+/* see nimf_connection_touch_engine() */
+static void
+nimf_context_touch_engine (NimfContext *context)
+{
+  if (context->server->use_singleton && context->connection &&
+      context->engine)
+    nimf_connection_touch_engine (context->connection, context->engine);
+}
 
-  if (nimf_event_matches (event,
-                          (const NimfKey **) context->server->hotkeys))
-  {
-    if (event->key.type == NIMF_EVENT_KEY_PRESS)
-    {
-      nimf_context_reset (context);
+gboolean nimf_context_filter_event (NimfContext *context,
+                                    NimfEvent   *event)
+{
+  NIMF_TRACE ();
 
-      if (context->server->use_singleton)
-        context->engine = nimf_server_get_next_instance (context->server,
-                                                         context->engine);
-      else
-        context->engine = nimf_context_get_next_instance (context,
-                                                          context->engine);
+  g_return_val_if_fail (context != NULL, FALSE);
 
-      nimf_context_emit_engine_changed (context,
-                                        nimf_engine_get_icon_name (context->engine));
-    }
+  nimf_context_wake (context);
+  nimf_context_sync_engine (context);
+  nimf_context_touch_engine (context);
 
+  if (G_UNLIKELY (context->engine == NULL))
+    return FALSE;
+
+  if (nimf_context_filter_keys (context, event))
     return TRUE;
-  }
 
   return nimf_engine_filter_event (context->engine, context, event);
 }
@@ -530,7 +740,7 @@ nimf_context_set_surrounding (NimfContext *context,
                               gint         len,
                               gint         cursor_index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (context != NULL);
 
@@ -545,7 +755,7 @@ nimf_context_get_surrounding (NimfContext  *context,
                               gchar       **text,
                               gint         *cursor_index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (context != NULL, FALSE);
 
@@ -560,7 +770,7 @@ void
 nimf_context_set_use_preedit (NimfContext *context,
                               gboolean     use_preedit)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (context != NULL);
 
@@ -594,14 +804,16 @@ void
 nimf_context_set_cursor_location (NimfContext         *context,
                                   const NimfRectangle *area)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (context != NULL);
 
+  /* kept for the engine of a hibernated context, see nimf_context_wake() */
+  context->cursor_area = *area;
+
   if (G_UNLIKELY (context->engine == NULL))
     return;
 
-  context->cursor_area = *area;
   nimf_engine_set_cursor_location (context->engine, area);
 }
 
@@ -609,30 +821,24 @@ void
 nimf_context_xim_set_cursor_location (NimfContext *context,
                                       Display     *display)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfRectangle preedit_area = context->cursor_area;
 
   Window target;
+  gint   x, y;
 
   if (context->focus_window)
     target = context->focus_window;
   else
     target = context->client_window;
 
-  if (target)
+  if (target &&
+      nimf_server_xim_get_window_origin (context->server, display, target,
+                                         &x, &y))
   {
-    XWindowAttributes xwa;
-    Window child;
-
-    XGetWindowAttributes (display, target, &xwa);
-    XTranslateCoordinates (display, target,
-                           xwa.root,
-                           preedit_area.x,
-                           preedit_area.y,
-                           &preedit_area.x,
-                           &preedit_area.y,
-                           &child);
+    preedit_area.x += x;
+    preedit_area.y += y;
   }
 
   nimf_context_set_cursor_location (context, &preedit_area);
@@ -640,7 +846,7 @@ nimf_context_xim_set_cursor_location (NimfContext *context,
 
 void nimf_context_reset (NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (context != NULL);
 
@@ -652,7 +858,7 @@ void
 nimf_context_set_engine_by_id (NimfContext *context,
                                const gchar *engine_id)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfEngine *engine;
 
@@ -663,6 +869,8 @@ nimf_context_set_engine_by_id (NimfContext *context,
 
   g_return_if_fail (engine != NULL);
 
+  context->hibernated_engine = -1;
+  context->engine_epoch = context->server->engine_epoch;
   context->engine = engine;
   nimf_context_emit_engine_changed (context,
                                     nimf_engine_get_icon_name (context->engine));
@@ -671,13 +879,13 @@ nimf_context_set_engine_by_id (NimfContext *context,
 static NimfEngine *
 nimf_context_get_default_engine (NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GSettings  *settings;
   gchar      *engine_id;
   NimfEngine *engine;
 
-  settings  = g_settings_new ("org.nimf.engines");
+  settings  = context->server->engines_settings;
   engine_id = g_settings_get_string (settings, "default-engine");
   engine    = nimf_context_get_instance (context, engine_id);
 
@@ -690,7 +898,6 @@ nimf_context_get_default_engine (NimfContext *context)
   }
 
   g_free (engine_id);
-  g_object_unref (settings);
 
   return engine;
 }
@@ -700,7 +907,7 @@ NimfContext *nimf_context_new (NimfContextType  type,
                                NimfServer      *server,
                                gpointer         cb_user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfContext *context;
 
@@ -711,6 +918,9 @@ NimfContext *nimf_context_new (NimfContextType  type,
   context->cb_user_data  = cb_user_data;
   context->use_preedit   = TRUE;
   context->preedit_state = NIMF_PREEDIT_STATE_END;
+  context->unfocused_since = g_get_monotonic_time ();
+  context->hibernated_engine = -1;
+  context->engine_epoch = server->engine_epoch;
 
   if (server->use_singleton)
   {
@@ -718,7 +928,7 @@ NimfContext *nimf_context_new (NimfContextType  type,
   }
   else
   {
-    context->engines = nimf_context_create_engines (context);
+    /* other engines are instantiated when the context switches to them */
     context->engine = nimf_context_get_default_engine (context);
   }
 
@@ -732,15 +942,26 @@ NimfContext *nimf_context_new (NimfContextType  type,
 
 void nimf_context_free (NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
+
+  guint i;
 
   if (context->type == NIMF_CONTEXT_NIMF_AGENT)
-    g_hash_table_steal (context->server->agents,
-                        GUINT_TO_POINTER (context->icid));
+  {
+    g_ptr_array_remove_fast (context->server->agents, context);
+    g_free (context->agent_icon_name);
+  }
 
-  if (context->engines)
-    g_list_free_full (context->engines, g_object_unref);
+  /* the state of the engines is not known here, so unlike
+   * nimf_context_hibernate(), which resets them, they are not pooled */
+  for (i = 0; context->engines && i < context->server->instances->len; i++)
+    if (context->engines[i])
+      g_object_unref (context->engines[i]);
 
+  g_free (context->engines);
+  g_free (context->xim_preedit_string);
+  g_free (context->xim_feedback);
+  g_free (context->xim_feedback_next);
   g_free (context->preedit_string);
   nimf_preedit_attr_freev (context->preedit_attrs);
 
@@ -44,10 +44,15 @@ struct _NimfContext
   NimfServer      *server;
   gboolean         use_preedit;
   NimfRectangle    cursor_area;
-  GList           *engines;
+  NimfEngine     **engines; /* by the index of the instance of the server */
   /* XIM */
   guint16          xim_connect_id;
   gint             xim_preedit_length;
+  gchar           *xim_preedit_string; /* as drawn last */
+  XIMFeedback     *xim_feedback;       /* of it */
+  XIMFeedback     *xim_feedback_next;  /* reused for the next draw */
+  gint             xim_feedback_size;  /* of both */
+  gboolean         xim_utf8_string; /* otherwise COMPOUND_TEXT */
   NimfPreeditState preedit_state;
   gpointer         cb_user_data;
   Window           client_window;
@@ -56,6 +61,12 @@ struct _NimfContext
   gchar            *preedit_string;
   NimfPreeditAttr **preedit_attrs;
   gint              preedit_cursor_pos;
+  /* hibernation */
+  gint64            unfocused_since; /* 0 while focused */
+  gint              hibernated_engine; /* index of the instance, or -1 */
+  gint              engine_epoch; /* of the server, when last synced */
+  /* agent */
+  gchar            *agent_icon_name; /* last sent to it */
 };
 
 NimfContext *nimf_context_new  (NimfContextType  type,
@@ -82,6 +93,7 @@ void         nimf_context_set_cursor_location     (NimfContext         *context,
 void         nimf_context_xim_set_cursor_location (NimfContext         *context,
                                                    Display             *display);
 void         nimf_context_reset              (NimfContext  *context);
+void         nimf_context_hibernate          (NimfContext  *context);
 void         nimf_context_set_engine_by_id   (NimfContext  *context,
                                               const gchar  *engine_id);
 /* signals */
@@ -97,6 +109,18 @@ gboolean nimf_context_emit_retrieve_surrounding (NimfContext      *context);
 gboolean nimf_context_emit_delete_surrounding   (NimfContext      *context,
                                                  gint              offset,
                                                  gint              n_chars);
+void     nimf_context_emit_retrieve_surrounding_async
+                                                (NimfContext         *context,
+                                                 NimfEngine          *engine,
+                                                 NimfEngineReplyFunc  callback,
+                                                 gpointer             user_data);
+void     nimf_context_emit_delete_surrounding_async
+                                                (NimfContext         *context,
+                                                 NimfEngine          *engine,
+                                                 gint                 offset,
+                                                 gint                 n_chars,
+                                                 NimfEngineReplyFunc  callback,
+                                                 gpointer             user_data);
 void     nimf_context_emit_engine_changed       (NimfContext      *context,
                                                  const gchar      *name);
 G_END_DECLS
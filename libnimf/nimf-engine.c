@@ -20,6 +20,7 @@
  */
 
 #include "nimf-engine.h"
+#include "nimf-trace.h"
 #include "nimf-private.h"
 
 enum
@@ -36,7 +37,7 @@ nimf_engine_set_property (GObject      *object,
                           const GValue *value,
                           GParamSpec   *pspec)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_ENGINE (object));
 
@@ -60,7 +61,7 @@ nimf_engine_get_property (GObject    *object,
                           GValue     *value,
                           GParamSpec *pspec)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_ENGINE (object));
 
@@ -80,7 +81,7 @@ nimf_engine_get_property (GObject    *object,
 void nimf_engine_reset (NimfEngine  *engine,
                         NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_ENGINE (engine));
 
@@ -93,7 +94,7 @@ void nimf_engine_reset (NimfEngine  *engine,
 void nimf_engine_focus_in (NimfEngine  *engine,
                            NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_ENGINE (engine));
 
@@ -106,7 +107,7 @@ void nimf_engine_focus_in (NimfEngine  *engine,
 void nimf_engine_focus_out (NimfEngine  *engine,
                             NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_ENGINE (engine));
 
@@ -120,7 +121,7 @@ gboolean nimf_engine_filter_event (NimfEngine  *engine,
                                    NimfContext *context,
                                    NimfEvent   *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfEngineClass *class = NIMF_ENGINE_GET_CLASS (engine);
 
@@ -131,7 +132,7 @@ gboolean nimf_engine_real_filter_event (NimfEngine  *engine,
                                         NimfContext *context,
                                         NimfEvent   *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return FALSE;
 }
@@ -142,7 +143,7 @@ nimf_engine_set_surrounding (NimfEngine *engine,
                              gint        len,
                              gint        cursor_index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_ENGINE (engine));
   g_return_if_fail (text != NULL || len == 0);
@@ -159,7 +160,7 @@ nimf_engine_get_surrounding (NimfEngine   *engine,
                              gchar       **text,
                              gint         *cursor_index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   gboolean retval = FALSE;
   NimfEngineClass *class = NIMF_ENGINE_GET_CLASS (engine);
@@ -174,7 +175,7 @@ void
 nimf_engine_set_cursor_location (NimfEngine          *engine,
                                  const NimfRectangle *area)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_ENGINE (engine));
 
@@ -188,7 +189,7 @@ void
 nimf_engine_emit_preedit_start (NimfEngine  *engine,
                                 NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_context_emit_preedit_start (context);
 }
@@ -200,7 +201,7 @@ nimf_engine_emit_preedit_changed (NimfEngine       *engine,
                                   NimfPreeditAttr **attrs,
                                   gint              cursor_pos)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_context_emit_preedit_changed (context, preedit_string, attrs, cursor_pos);
 }
@@ -209,7 +210,7 @@ void
 nimf_engine_emit_preedit_end (NimfEngine  *engine,
                               NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_context_emit_preedit_end (context);
 }
@@ -219,7 +220,7 @@ nimf_engine_emit_commit (NimfEngine  *engine,
                          NimfContext *context,
                          const gchar *text)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_context_emit_commit (context, text);
 }
@@ -230,7 +231,7 @@ nimf_engine_emit_delete_surrounding (NimfEngine  *engine,
                                      gint         offset,
                                      gint         n_chars)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return nimf_context_emit_delete_surrounding (context, offset, n_chars);
 }
@@ -239,16 +240,44 @@ gboolean
 nimf_engine_emit_retrieve_surrounding (NimfEngine  *engine,
                                        NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return nimf_context_emit_retrieve_surrounding (context);
 }
 
+/* Unlike the blocking forms above, these do not dispatch other clients
+ * while the reply is awaited; @callback gets it later. */
+void
+nimf_engine_emit_delete_surrounding_async (NimfEngine          *engine,
+                                           NimfContext         *context,
+                                           gint                 offset,
+                                           gint                 n_chars,
+                                           NimfEngineReplyFunc  callback,
+                                           gpointer             user_data)
+{
+  NIMF_TRACE ();
+
+  nimf_context_emit_delete_surrounding_async (context, engine, offset, n_chars,
+                                              callback, user_data);
+}
+
+void
+nimf_engine_emit_retrieve_surrounding_async (NimfEngine          *engine,
+                                             NimfContext         *context,
+                                             NimfEngineReplyFunc  callback,
+                                             gpointer             user_data)
+{
+  NIMF_TRACE ();
+
+  nimf_context_emit_retrieve_surrounding_async (context, engine,
+                                                callback, user_data);
+}
+
 void
 nimf_engine_emit_engine_changed (NimfEngine  *engine,
                                  NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_context_emit_engine_changed (context,
                                     nimf_engine_get_icon_name (engine));
@@ -257,7 +286,7 @@ nimf_engine_emit_engine_changed (NimfEngine  *engine,
 static void
 nimf_engine_init (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   engine->priv = nimf_engine_get_instance_private (engine);
 }
@@ -265,7 +294,7 @@ nimf_engine_init (NimfEngine *engine)
 static void
 nimf_engine_finalize (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfEngine *engine = NIMF_ENGINE (object);
 
@@ -280,7 +309,7 @@ nimf_engine_real_set_surrounding (NimfEngine *engine,
                                   gint        len,
                                   gint        cursor_index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_free (engine->priv->surrounding_text);
   engine->priv->surrounding_text         = g_strndup (text, len);
@@ -293,7 +322,7 @@ nimf_engine_real_get_surrounding (NimfEngine   *engine,
                                   gchar       **text,
                                   gint         *cursor_index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   gboolean retval = nimf_engine_emit_retrieve_surrounding (engine, context);
 
@@ -315,10 +344,58 @@ nimf_engine_real_get_surrounding (NimfEngine   *engine,
   return retval;
 }
 
+typedef struct
+{
+  NimfEngineSurroundingFunc callback;
+  gpointer                  user_data;
+} NimfSurroundingClosure;
+
+static void
+on_surrounding_retrieved (NimfEngine  *engine,
+                          NimfContext *context,
+                          gboolean     retval,
+                          gpointer     user_data)
+{
+  NIMF_TRACE ();
+
+  NimfSurroundingClosure *closure = user_data;
+
+  /* the client has sent NIMF_MESSAGE_SET_SURROUNDING before the reply */
+  if (retval)
+    closure->callback (engine, context,
+                       engine->priv->surrounding_text ?
+                         engine->priv->surrounding_text : "",
+                       engine->priv->surrounding_cursor_index,
+                       closure->user_data);
+  else
+    closure->callback (engine, context, NULL, 0, closure->user_data);
+
+  g_slice_free (NimfSurroundingClosure, closure);
+}
+
+void
+nimf_engine_get_surrounding_async (NimfEngine                *engine,
+                                   NimfContext               *context,
+                                   NimfEngineSurroundingFunc  callback,
+                                   gpointer                   user_data)
+{
+  NIMF_TRACE ();
+
+  NimfSurroundingClosure *closure;
+
+  closure = g_slice_new (NimfSurroundingClosure);
+  closure->callback  = callback;
+  closure->user_data = user_data;
+
+  nimf_engine_emit_retrieve_surrounding_async (engine, context,
+                                               on_surrounding_retrieved,
+                                               closure);
+}
+
 const gchar *
 nimf_engine_get_id (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return NIMF_ENGINE_GET_CLASS (engine)->get_id (engine);
 }
@@ -334,7 +411,7 @@ nimf_engine_real_get_id (NimfEngine *engine)
 const gchar *
 nimf_engine_get_icon_name (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return NIMF_ENGINE_GET_CLASS (engine)->get_icon_name (engine);
 }
@@ -350,7 +427,7 @@ nimf_engine_real_get_icon_name (NimfEngine *engine)
 static void
 nimf_engine_class_init (NimfEngineClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GObjectClass *object_class = G_OBJECT_CLASS (class);
 
@@ -46,6 +46,13 @@ typedef struct _NimfEngine        NimfEngine;
 typedef struct _NimfEngineClass   NimfEngineClass;
 typedef struct _NimfEnginePrivate NimfEnginePrivate;
 
+/* receives the surrounding text, or NULL if the client has none */
+typedef void (*NimfEngineSurroundingFunc) (NimfEngine  *engine,
+                                           NimfContext *context,
+                                           const gchar *text,
+                                           gint         cursor_index,
+                                           gpointer     user_data);
+
 struct _NimfEngine
 {
   GObject parent_instance;
@@ -113,6 +120,10 @@ gboolean nimf_engine_get_surrounding           (NimfEngine          *engine,
                                                 NimfContext         *context,
                                                 gchar             **text,
                                                 gint                *cursor_index);
+void     nimf_engine_get_surrounding_async     (NimfEngine          *engine,
+                                                NimfContext         *context,
+                                                NimfEngineSurroundingFunc callback,
+                                                gpointer             user_data);
 void     nimf_engine_set_cursor_location       (NimfEngine          *engine,
                                                 const NimfRectangle *area);
 /* signals */
@@ -134,6 +145,18 @@ gboolean nimf_engine_emit_delete_surrounding   (NimfEngine       *engine,
                                                 NimfContext      *context,
                                                 gint              offset,
                                                 gint              n_chars);
+void     nimf_engine_emit_retrieve_surrounding_async
+                                               (NimfEngine          *engine,
+                                                NimfContext         *context,
+                                                NimfEngineReplyFunc  callback,
+                                                gpointer             user_data);
+void     nimf_engine_emit_delete_surrounding_async
+                                               (NimfEngine          *engine,
+                                                NimfContext         *context,
+                                                gint                 offset,
+                                                gint                 n_chars,
+                                                NimfEngineReplyFunc  callback,
+                                                gpointer             user_data);
 void     nimf_engine_emit_engine_changed       (NimfEngine       *engine,
                                                 NimfContext      *context);
 /* info */
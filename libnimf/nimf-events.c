@@ -20,6 +20,7 @@
  */
 
 #include "nimf-events.h"
+#include "nimf-trace.h"
 #include "nimf-types.h"
 #include "nimf-key-syms.h"
 #include <string.h>
@@ -55,7 +56,7 @@ nimf_event_matches (NimfEvent *event, const NimfKey **keys)
 NimfEvent *
 nimf_event_new (NimfEventType type)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfEvent *new_event = g_slice_new0 (NimfEvent);
   new_event->type = type;
@@ -66,7 +67,7 @@ nimf_event_new (NimfEventType type)
 void
 nimf_event_free (NimfEvent *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (event != NULL);
 
@@ -76,7 +77,7 @@ nimf_event_free (NimfEvent *event)
 NimfEvent *
 nimf_event_copy (NimfEvent *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (event != NULL, NULL);
 
@@ -0,0 +1,133 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * nimf-id-table.c
+ * This file is part of Nimf.
+ *
+ * Copyright (C) 2015,2016 Hodong Kim <cogniti@gmail.com>
+ *
+ * Nimf is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nimf is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program;  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nimf-id-table.h"
+#include <string.h>
+
+void
+nimf_id_table_init (NimfIdTable *table)
+{
+  table->items      = NULL;
+  table->size       = 0;
+  table->n_items    = 0;
+  table->first_free = 1;
+}
+
+/* frees the array only; the items are the caller's */
+void
+nimf_id_table_clear (NimfIdTable *table)
+{
+  g_free (table->items);
+  nimf_id_table_init (table);
+}
+
+static void
+nimf_id_table_grow (NimfIdTable *table,
+                    guint        id)
+{
+  guint size;
+
+  if (id < table->size)
+    return;
+
+  size = MAX (16, table->size);
+
+  while (size <= id)
+    size *= 2;
+
+  size = MIN (size, G_MAXUINT16 + 1);
+  table->items = g_renew (gpointer, table->items, size);
+  memset (table->items + table->size, 0,
+          (size - table->size) * sizeof (gpointer));
+  table->size = size;
+}
+
+/* returns 0 if all ids are taken */
+guint16
+nimf_id_table_add (NimfIdTable *table,
+                   gpointer     item)
+{
+  guint id;
+
+  g_return_val_if_fail (item != NULL, 0);
+
+  for (id = table->first_free; id < table->size; id++)
+    if (table->items[id] == NULL)
+      break;
+
+  if (id > G_MAXUINT16)
+    return 0;
+
+  nimf_id_table_insert (table, id, item);
+
+  return id;
+}
+
+/* for ids given by peers; replaces the item of @id, if any */
+void
+nimf_id_table_insert (NimfIdTable *table,
+                      guint16      id,
+                      gpointer     item)
+{
+  g_return_if_fail (id != 0 && item != NULL);
+
+  nimf_id_table_grow (table, id);
+
+  if (table->items[id] == NULL)
+    table->n_items++;
+
+  table->items[id] = item;
+
+  if (id == table->first_free)
+    table->first_free++;
+}
+
+gpointer
+nimf_id_table_remove (NimfIdTable *table,
+                      guint16      id)
+{
+  gpointer item = nimf_id_table_lookup (table, id);
+
+  if (item == NULL)
+    return NULL;
+
+  table->items[id] = NULL;
+  table->n_items--;
+  table->first_free = MIN (table->first_free, id);
+
+  return item;
+}
+
+/* Iterates the items; start with *@id 0:
+ *
+ *   while ((item = nimf_id_table_next (table, &id)))
+ *
+ * Removing the item just returned is allowed. */
+gpointer
+nimf_id_table_next (NimfIdTable *table,
+                    guint       *id)
+{
+  while (++*id < table->size)
+    if (table->items[*id])
+      return table->items[*id];
+
+  return NULL;
+}
@@ -0,0 +1,61 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * nimf-id-table.h
+ * This file is part of Nimf.
+ *
+ * Copyright (C) 2015,2016 Hodong Kim <cogniti@gmail.com>
+ *
+ * Nimf is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nimf is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program;  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NIMF_ID_TABLE_H__
+#define __NIMF_ID_TABLE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Pointers indexed by 16-bit ids, in an array.  Ids handed out by
+ * nimf_id_table_add() are the lowest free ones, so the array stays about
+ * as long as the number of items; id 0 is never used. */
+typedef struct
+{
+  gpointer *items;
+  guint     size;      /* of items */
+  guint     n_items;
+  guint     first_free; /* no free id below it */
+} NimfIdTable;
+
+void     nimf_id_table_init   (NimfIdTable *table);
+void     nimf_id_table_clear  (NimfIdTable *table);
+guint16  nimf_id_table_add    (NimfIdTable *table,
+                               gpointer     item);
+void     nimf_id_table_insert (NimfIdTable *table,
+                               guint16      id,
+                               gpointer     item);
+gpointer nimf_id_table_remove (NimfIdTable *table,
+                               guint16      id);
+gpointer nimf_id_table_next   (NimfIdTable *table,
+                               guint       *id);
+
+static inline gpointer
+nimf_id_table_lookup (NimfIdTable *table,
+                      guint16      id)
+{
+  return id < table->size ? table->items[id] : NULL;
+}
+
+G_END_DECLS
+
+#endif /* __NIMF_ID_TABLE_H__ */
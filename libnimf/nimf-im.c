@@ -20,6 +20,7 @@
  */
 
 #include "nimf-im.h"
+#include "nimf-trace.h"
 #include "nimf-events.h"
 #include "nimf-types.h"
 #include "nimf-enum-types.h"
@@ -41,15 +42,13 @@ enum {
 };
 
 static guint im_signals[LAST_SIGNAL] = { 0 };
-extern GMainContext      *nimf_client_socket_context;
-extern NimfResult        *nimf_client_result;
 extern GSocketConnection *nimf_client_connection;
 
 G_DEFINE_TYPE (NimfIM, nimf_im, NIMF_TYPE_CLIENT);
 
 void nimf_im_focus_out (NimfIM *im)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_IM (im));
 
@@ -62,16 +61,15 @@ void nimf_im_focus_out (NimfIM *im)
     return;
   }
 
-  nimf_send_message (socket, client->id, NIMF_MESSAGE_FOCUS_OUT,
-                     NULL, 0, NULL);
-  nimf_result_iteration_until (nimf_client_result, nimf_client_socket_context,
-                               client->id, NIMF_MESSAGE_FOCUS_OUT_REPLY);
+  if (!nimf_send_message (socket, client->id, NIMF_MESSAGE_FOCUS_OUT,
+                          NULL, 0, NULL))
+    g_signal_emit_by_name (client, "disconnected", NULL);
 }
 
 void nimf_im_set_cursor_location (NimfIM              *im,
                                   const NimfRectangle *area)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_IM (im));
 
@@ -84,16 +82,15 @@ void nimf_im_set_cursor_location (NimfIM              *im,
     return;
   }
 
-  nimf_send_message (socket, client->id, NIMF_MESSAGE_SET_CURSOR_LOCATION,
-                     (gchar *) area, sizeof (NimfRectangle), NULL);
-  nimf_result_iteration_until (nimf_client_result, nimf_client_socket_context,
-                               client->id, NIMF_MESSAGE_SET_CURSOR_LOCATION_REPLY);
+  if (!nimf_send_message (socket, client->id, NIMF_MESSAGE_SET_CURSOR_LOCATION,
+                          (gchar *) area, sizeof (NimfRectangle), NULL))
+    g_signal_emit_by_name (client, "disconnected", NULL);
 }
 
 void nimf_im_set_use_preedit (NimfIM   *im,
                               gboolean  use_preedit)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_IM (im));
 
@@ -106,16 +103,15 @@ void nimf_im_set_use_preedit (NimfIM   *im,
     return;
   }
 
-  nimf_send_message (socket, client->id, NIMF_MESSAGE_SET_USE_PREEDIT,
-                     (gchar *) &use_preedit, sizeof (gboolean), NULL);
-  nimf_result_iteration_until (nimf_client_result, nimf_client_socket_context,
-                               client->id, NIMF_MESSAGE_SET_USE_PREEDIT_REPLY);
+  if (!nimf_send_message (socket, client->id, NIMF_MESSAGE_SET_USE_PREEDIT,
+                          (gchar *) &use_preedit, sizeof (gboolean), NULL))
+    g_signal_emit_by_name (client, "disconnected", NULL);
 }
 
 void nimf_im_set_use_fallback_filter (NimfIM   *im,
                                       gboolean  use_fallback_filter)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_IM (im));
 
@@ -126,7 +122,7 @@ gboolean nimf_im_get_surrounding (NimfIM  *im,
                                   gchar  **text,
                                   gint    *cursor_index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_IM (im), FALSE);
 
@@ -146,12 +142,12 @@ gboolean nimf_im_get_surrounding (NimfIM  *im,
     return FALSE;
   }
 
-  nimf_send_message (socket, client->id, NIMF_MESSAGE_GET_SURROUNDING,
-                     NULL, 0, NULL);
-  nimf_result_iteration_until (nimf_client_result, nimf_client_socket_context,
-                               client->id, NIMF_MESSAGE_GET_SURROUNDING_REPLY);
+  NimfMessage *reply;
+  gboolean     retval;
 
-  if (nimf_client_result->reply == NULL)
+  reply = nimf_client_call (socket, client->id, NIMF_MESSAGE_GET_SURROUNDING,
+                            NULL, 0, NULL);
+  if (reply == NULL)
   {
     if (text)
       *text = g_strdup ("");
@@ -163,18 +159,20 @@ gboolean nimf_im_get_surrounding (NimfIM  *im,
   }
 
   if (text)
-    *text = g_strndup (nimf_client_result->reply->data,
-                       nimf_client_result->reply->header->data_len - 1 -
-                       sizeof (gint) - sizeof (gboolean));
+    *text = g_strndup (reply->data, reply->header.data_len - 1 -
+                                    sizeof (gint) - sizeof (gboolean));
 
   if (cursor_index)
   {
-    *cursor_index = *(gint *) (nimf_client_result->reply->data +
-                               nimf_client_result->reply->header->data_len -
+    *cursor_index = *(gint *) (reply->data + reply->header.data_len -
                                sizeof (gint) - sizeof (gboolean));
   }
 
-  return *(gboolean *) (nimf_client_result->reply->data - sizeof (gboolean));
+  retval = *(gboolean *) (reply->data + reply->header.data_len -
+                          sizeof (gboolean));
+  nimf_message_unref (reply);
+
+  return retval;
 }
 
 void nimf_im_set_surrounding (NimfIM     *im,
@@ -182,7 +180,7 @@ void nimf_im_set_surrounding (NimfIM     *im,
                               gint        len,
                               gint        cursor_index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_IM (im));
 
@@ -203,21 +201,26 @@ void nimf_im_set_surrounding (NimfIM     *im,
   else
     str_len = len;
 
+  if (str_len + 1 + 2 * sizeof (gint) > nimf_socket_get_max_data_len (socket))
+  {
+    g_warning (G_STRLOC ": %s: surrounding text is too long", G_STRFUNC);
+    return;
+  }
+
   data = g_strndup (text, str_len);
   data = g_realloc (data, str_len + 1 + 2 * sizeof (gint));
 
   *(gint *) (data + str_len + 1) = len;
   *(gint *) (data + str_len + 1 + sizeof (gint)) = cursor_index;
 
-  nimf_send_message (socket, client->id, NIMF_MESSAGE_SET_SURROUNDING,
-                     data, str_len + 1 + 2 * sizeof (gint), g_free);
-  nimf_result_iteration_until (nimf_client_result, nimf_client_socket_context,
-                               client->id, NIMF_MESSAGE_SET_SURROUNDING_REPLY);
+  if (!nimf_send_message (socket, client->id, NIMF_MESSAGE_SET_SURROUNDING,
+                          data, str_len + 1 + 2 * sizeof (gint), g_free))
+    g_signal_emit_by_name (client, "disconnected", NULL);
 }
 
 void nimf_im_focus_in (NimfIM *im)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_IM (im));
 
@@ -230,9 +233,9 @@ void nimf_im_focus_in (NimfIM *im)
     return;
   }
 
-  nimf_send_message (socket, client->id, NIMF_MESSAGE_FOCUS_IN, NULL, 0, NULL);
-  nimf_result_iteration_until (nimf_client_result, nimf_client_socket_context,
-                               client->id, NIMF_MESSAGE_FOCUS_IN_REPLY);
+  if (!nimf_send_message (socket, client->id, NIMF_MESSAGE_FOCUS_IN,
+                          NULL, 0, NULL))
+    g_signal_emit_by_name (client, "disconnected", NULL);
 }
 
 void
@@ -241,7 +244,7 @@ nimf_im_get_preedit_string (NimfIM            *im,
                             NimfPreeditAttr ***attrs,
                             gint              *cursor_pos)
 {
-  g_debug (G_STRLOC ":%s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_IM (im));
 
@@ -257,7 +260,7 @@ nimf_im_get_preedit_string (NimfIM            *im,
 
 void nimf_im_reset (NimfIM *im)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_IM (im));
 
@@ -270,16 +273,15 @@ void nimf_im_reset (NimfIM *im)
     return;
   }
 
-  nimf_send_message (socket, client->id, NIMF_MESSAGE_RESET, NULL, 0, NULL);
-  nimf_result_iteration_until (nimf_client_result, nimf_client_socket_context,
-                               client->id, NIMF_MESSAGE_RESET_REPLY);
+  nimf_message_unref (nimf_client_call (socket, client->id, NIMF_MESSAGE_RESET,
+                                        NULL, 0, NULL));
 }
 
 gboolean
 nimf_im_filter_event_fallback (NimfIM    *im,
                                NimfEvent *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if ((event->key.type   == NIMF_EVENT_KEY_RELEASE) ||
       (event->key.keyval == NIMF_KEY_Shift_L)       ||
@@ -310,7 +312,7 @@ nimf_im_filter_event_fallback (NimfIM    *im,
 
 gboolean nimf_im_filter_event (NimfIM *im, NimfEvent *event)
 {
-  g_debug (G_STRLOC ":%s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_IM (im), FALSE);
 
@@ -327,13 +329,18 @@ gboolean nimf_im_filter_event (NimfIM *im, NimfEvent *event)
       return FALSE;
   }
 
-  nimf_send_message (socket, client->id, NIMF_MESSAGE_FILTER_EVENT,
-                     event, sizeof (NimfEvent), NULL);
-  nimf_result_iteration_until (nimf_client_result, nimf_client_socket_context,
-                               client->id, NIMF_MESSAGE_FILTER_EVENT_REPLY);
+  NimfMessage *reply;
+  gboolean     retval = FALSE;
+
+  reply = nimf_client_call (socket, client->id, NIMF_MESSAGE_FILTER_EVENT,
+                            event, sizeof (NimfEvent), NULL);
+  if (reply)
+  {
+    retval = *(gboolean *) reply->data;
+    nimf_message_unref (reply);
+  }
 
-  if (nimf_client_result->reply &&
-      *(gboolean *) (nimf_client_result->reply->data))
+  if (retval)
     return TRUE;
 
   if (im->use_fallback_filter)
@@ -345,7 +352,7 @@ gboolean nimf_im_filter_event (NimfIM *im, NimfEvent *event)
 NimfIM *
 nimf_im_new ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return g_object_new (NIMF_TYPE_IM,
                        "context-type", NIMF_CONTEXT_NIMF_IM, NULL);
@@ -354,7 +361,7 @@ nimf_im_new ()
 static void
 nimf_im_init (NimfIM *im)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   im->preedit_string = g_strdup ("");
   im->preedit_attrs = g_malloc0_n (1, sizeof (NimfPreeditAttr *));
@@ -364,7 +371,7 @@ nimf_im_init (NimfIM *im)
 static void
 nimf_im_finalize (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfIM *im = NIMF_IM (object);
 
@@ -377,7 +384,7 @@ nimf_im_finalize (GObject *object)
 static void
 nimf_im_class_init (NimfIMClass *klass)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
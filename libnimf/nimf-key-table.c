@@ -0,0 +1,111 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * nimf-key-table.c
+ * This file is part of Nimf.
+ *
+ * Copyright (C) 2015,2016 Hodong Kim <cogniti@gmail.com>
+ *
+ * Nimf is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nimf is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program;  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nimf-key-table.h"
+#include <string.h>
+
+static guint
+nimf_key_hash (const NimfKey *key)
+{
+  return key->keyval ^ (key->mods << 16);
+}
+
+static gboolean
+nimf_key_equal (const NimfKey *a,
+                const NimfKey *b)
+{
+  return a->keyval == b->keyval && a->mods == b->mods;
+}
+
+void
+nimf_key_table_init (NimfKeyTable   *table,
+                     GDestroyNotify  value_destroy_func)
+{
+  table->bindings = g_hash_table_new_full ((GHashFunc)  nimf_key_hash,
+                                           (GEqualFunc) nimf_key_equal,
+                                           (GDestroyNotify) nimf_key_free,
+                                           NULL);
+  table->values = g_ptr_array_new_with_free_func (value_destroy_func);
+  memset (table->bitmap, 0, sizeof table->bitmap);
+}
+
+void
+nimf_key_table_clear (NimfKeyTable *table)
+{
+  g_hash_table_unref (table->bindings);
+  g_ptr_array_unref  (table->values);
+  table->bindings = NULL;
+  table->values   = NULL;
+}
+
+void
+nimf_key_table_remove_all (NimfKeyTable *table)
+{
+  g_hash_table_remove_all (table->bindings);
+  g_ptr_array_set_size (table->values, 0);
+  memset (table->bitmap, 0, sizeof table->bitmap);
+}
+
+/* Binds each of @keys to @value, which @table takes.  A key bound already
+ * keeps its first value. */
+void
+nimf_key_table_add (NimfKeyTable   *table,
+                    const NimfKey **keys,
+                    gpointer        value)
+{
+  gint i;
+
+  g_ptr_array_add (table->values, value);
+
+  for (i = 0; keys[i] != NULL; i++)
+  {
+    NimfKey *key;
+    guint    bit;
+
+    key = nimf_key_new ();
+    key->keyval = keys[i]->keyval;
+    key->mods   = keys[i]->mods & NIMF_KEY_TABLE_MODS_MASK;
+
+    if (g_hash_table_contains (table->bindings, key))
+    {
+      nimf_key_free (key);
+      continue;
+    }
+
+    g_hash_table_insert (table->bindings, key, value);
+
+    bit = nimf_key_table_fold (key->keyval);
+    table->bitmap[bit / 32] |= 1u << (bit % 32);
+  }
+}
+
+gpointer
+nimf_key_table_lookup_key (NimfKeyTable *table,
+                           guint         keyval,
+                           guint         mods)
+{
+  NimfKey key;
+
+  key.keyval = keyval;
+  key.mods   = mods & NIMF_KEY_TABLE_MODS_MASK;
+
+  return g_hash_table_lookup (table->bindings, &key);
+}
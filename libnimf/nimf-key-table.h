@@ -0,0 +1,81 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * nimf-key-table.h
+ * This file is part of Nimf.
+ *
+ * Copyright (C) 2015,2016 Hodong Kim <cogniti@gmail.com>
+ *
+ * Nimf is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nimf is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program;  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NIMF_KEY_TABLE_H__
+#define __NIMF_KEY_TABLE_H__
+
+#include <glib.h>
+#include "nimf-events.h"
+#include "nimf-types.h"
+
+G_BEGIN_DECLS
+
+/* Modifiers a binding cares about; NIMF_MOD2_MASK (NumLock),
+ * NIMF_LOCK_MASK (CapsLock) and virtual modifiers are ignored. */
+#define NIMF_KEY_TABLE_MODS_MASK (NIMF_SHIFT_MASK   | \
+                                  NIMF_CONTROL_MASK | \
+                                  NIMF_MOD1_MASK    | \
+                                  NIMF_MOD3_MASK    | \
+                                  NIMF_MOD4_MASK    | \
+                                  NIMF_MOD5_MASK)
+
+/* Key bindings, looked up with one hash probe; a bitmap over folded
+ * keyvals turns most keys away before it. */
+typedef struct
+{
+  GHashTable *bindings; /* NimfKey -> value */
+  GPtrArray  *values;   /* owns them */
+  guint32     bitmap[8];
+} NimfKeyTable;
+
+void nimf_key_table_init       (NimfKeyTable   *table,
+                                GDestroyNotify  value_destroy_func);
+void nimf_key_table_clear      (NimfKeyTable   *table);
+void nimf_key_table_remove_all (NimfKeyTable   *table);
+void nimf_key_table_add        (NimfKeyTable   *table,
+                                const NimfKey **keys,
+                                gpointer        value);
+gpointer nimf_key_table_lookup_key (NimfKeyTable *table,
+                                    guint         keyval,
+                                    guint         mods);
+
+static inline guint
+nimf_key_table_fold (guint keyval)
+{
+  return (keyval ^ (keyval >> 8)) & 0xff;
+}
+
+static inline gpointer
+nimf_key_table_lookup (NimfKeyTable *table,
+                       NimfEvent    *event)
+{
+  guint bit = nimf_key_table_fold (event->key.keyval);
+
+  if (G_LIKELY (!(table->bitmap[bit / 32] & (1u << (bit % 32)))))
+    return NULL;
+
+  return nimf_key_table_lookup_key (table, event->key.keyval,
+                                    event->key.state);
+}
+
+G_END_DECLS
+
+#endif /* __NIMF_KEY_TABLE_H__ */
@@ -20,14 +20,33 @@
  */
 
 #include "nimf-message.h"
+#include "nimf-trace.h"
+#include "nimf-private.h"
 #include "nimf-types.h"
 #include "nimf-enum-types.h"
 #include <string.h>
 
+G_STATIC_ASSERT (sizeof (NimfMessageHeader) == 16);
+G_STATIC_ASSERT (G_STRUCT_OFFSET (NimfMessage, inline_data) % 8 == 0);
+
+#define NIMF_MESSAGE_POOL_SIZE 8
+
+/* Recycles the messages received on a connection, so that receiving one
+ * with a small body allocates nothing once the pool is warm.  Messages a
+ * worker receives are unreferenced in the main thread, which dispatches
+ * them. */
+struct _NimfMessagePool
+{
+  NimfMessage *free_messages[NIMF_MESSAGE_POOL_SIZE];
+  guint        n_free;
+  GMutex       lock; /* guards free_messages */
+  gint         ref_count; /* held by the owner and each message taken */
+};
+
 NimfMessage *
 nimf_message_new ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return nimf_message_new_full (NIMF_MESSAGE_NONE, 0, NULL, 0, NULL);
 }
@@ -36,18 +55,18 @@ NimfMessage *
 nimf_message_new_full (NimfMessageType type,
                        guint16         icid,
                        gpointer        data,
-                       guint16         data_len,
+                       guint32         data_len,
                        GDestroyNotify  data_destroy_func)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfMessage *message;
 
   message                    = g_slice_new0 (NimfMessage);
-  message->header            = g_slice_new0 (NimfMessageHeader);
-  message->header->icid      = icid;
-  message->header->type      = type;
-  message->header->data_len  = data_len;
+  message->header.icid       = icid;
+  message->header.version    = NIMF_PROTOCOL_VERSION;
+  message->header.type       = type;
+  message->header.data_len   = data_len;
   message->data              = data;
   message->data_destroy_func = data_destroy_func;
   message->ref_count = 1;
@@ -58,7 +77,7 @@ nimf_message_new_full (NimfMessageType type,
 NimfMessage *
 nimf_message_ref (NimfMessage *message)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (message != NULL, NULL);
 
@@ -70,34 +89,35 @@ nimf_message_ref (NimfMessage *message)
 void
 nimf_message_unref (NimfMessage *message)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (G_UNLIKELY (message == NULL))
     return;
 
   if (g_atomic_int_dec_and_test (&message->ref_count))
   {
-    g_slice_free (NimfMessageHeader, message->header);
-
     if (message->data_destroy_func)
       message->data_destroy_func (message->data);
 
-    g_slice_free (NimfMessage, message);
+    if (message->pool)
+      nimf_message_pool_release (message->pool, message);
+    else
+      g_slice_free (NimfMessage, message);
   }
 }
 
 const NimfMessageHeader *
 nimf_message_get_header (NimfMessage *message)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
-  return message->header;
+  return &message->header;
 }
 
 guint16
 nimf_message_get_header_size ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return sizeof (NimfMessageHeader);
 }
@@ -105,50 +125,150 @@ nimf_message_get_header_size ()
 void
 nimf_message_set_body (NimfMessage    *message,
                        gchar          *data,
-                       guint16         data_len,
+                       guint32         data_len,
                        GDestroyNotify  data_destroy_func)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   message->data              = data;
-  message->header->data_len  = data_len;
+  message->header.data_len   = data_len;
   message->data_destroy_func = data_destroy_func;
 }
 
 const gchar *
 nimf_message_get_body (NimfMessage *message)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return message->data;
 }
 
-guint16
+guint32
 nimf_message_get_body_size (NimfMessage *message)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
-  return message->header->data_len;
+  return message->header.data_len;
 }
 
 const gchar *nimf_message_get_name (NimfMessage *message)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
-
-  GEnumClass *enum_class = (GEnumClass *) g_type_class_ref (NIMF_TYPE_MESSAGE_TYPE);
-  GEnumValue *enum_value = g_enum_get_value (enum_class, message->header->type);
-  g_type_class_unref (enum_class);
+  NIMF_TRACE ();
 
-  return enum_value ? enum_value->value_name : NULL;
+  return nimf_message_get_name_by_type (message->header.type);
 }
 
 const gchar *nimf_message_get_name_by_type (NimfMessageType type)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
+
+  static GEnumClass *enum_class = NULL;
+  GEnumValue        *enum_value;
 
-  GEnumClass *enum_class = (GEnumClass *) g_type_class_ref (NIMF_TYPE_MESSAGE_TYPE);
-  GEnumValue *enum_value = g_enum_get_value (enum_class, type);
-  g_type_class_unref (enum_class);
+  /* kept for the lifetime of the process */
+  if (g_once_init_enter (&enum_class))
+    g_once_init_leave (&enum_class, g_type_class_ref (NIMF_TYPE_MESSAGE_TYPE));
+
+  enum_value = g_enum_get_value (enum_class, type);
 
   return enum_value ? enum_value->value_name : NULL;
 }
+
+NimfMessagePool *
+nimf_message_pool_new (void)
+{
+  NIMF_TRACE ();
+
+  NimfMessagePool *pool;
+
+  pool = g_slice_new0 (NimfMessagePool);
+  pool->ref_count = 1;
+  g_mutex_init (&pool->lock);
+
+  return pool;
+}
+
+void
+nimf_message_pool_unref (NimfMessagePool *pool)
+{
+  NIMF_TRACE ();
+
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&pool->ref_count))
+    return;
+
+  for (i = 0; i < pool->n_free; i++)
+    g_slice_free (NimfMessage, pool->free_messages[i]);
+
+  g_mutex_clear (&pool->lock);
+  g_slice_free (NimfMessagePool, pool);
+}
+
+/* Returns a message with a copy of @data, which is header->data_len bytes
+ * long.  The message goes back to @pool when it is unreferenced. */
+NimfMessage *
+nimf_message_pool_take (NimfMessagePool         *pool,
+                        const NimfMessageHeader *header,
+                        const gchar             *data)
+{
+  NIMF_TRACE ();
+
+  NimfMessage *message = NULL;
+
+  g_mutex_lock (&pool->lock);
+
+  if (pool->n_free > 0)
+    message = pool->free_messages[--pool->n_free];
+
+  g_mutex_unlock (&pool->lock);
+
+  if (message == NULL)
+    message = g_slice_new (NimfMessage);
+
+  message->header    = *header;
+  message->ref_count = 1;
+  message->pool      = pool;
+  g_atomic_int_inc (&pool->ref_count);
+
+  if (header->data_len == 0)
+  {
+    message->data              = NULL;
+    message->data_destroy_func = NULL;
+  }
+  else if (header->data_len <= NIMF_MESSAGE_INLINE_SIZE)
+  {
+    memcpy (message->inline_data, data, header->data_len);
+    message->data              = message->inline_data;
+    message->data_destroy_func = NULL;
+  }
+  else
+  {
+    message->data              = g_memdup (data, header->data_len);
+    message->data_destroy_func = g_free;
+  }
+
+  return message;
+}
+
+void
+nimf_message_pool_release (NimfMessagePool *pool,
+                           NimfMessage     *message)
+{
+  NIMF_TRACE ();
+
+  g_mutex_lock (&pool->lock);
+
+  if (pool->n_free < NIMF_MESSAGE_POOL_SIZE)
+  {
+    pool->free_messages[pool->n_free++] = message;
+    message = NULL;
+  }
+
+  g_mutex_unlock (&pool->lock);
+
+  if (message)
+    g_slice_free (NimfMessage, message);
+
+  nimf_message_pool_unref (pool);
+}
@@ -46,18 +46,21 @@ typedef enum
   NIMF_MESSAGE_FILTER_EVENT_REPLY,
   NIMF_MESSAGE_RESET,
   NIMF_MESSAGE_RESET_REPLY,
+  /* FOCUS_IN, FOCUS_OUT, SET_SURROUNDING, SET_CURSOR_LOCATION and
+   * SET_USE_PREEDIT are one-way: the server handles them in order with the
+   * other messages of the connection and replies only to old clients */
   NIMF_MESSAGE_FOCUS_IN,
-  NIMF_MESSAGE_FOCUS_IN_REPLY,
+  NIMF_MESSAGE_FOCUS_IN_REPLY,            /* old clients only */
   NIMF_MESSAGE_FOCUS_OUT,
-  NIMF_MESSAGE_FOCUS_OUT_REPLY,
+  NIMF_MESSAGE_FOCUS_OUT_REPLY,           /* old clients only */
   NIMF_MESSAGE_SET_SURROUNDING,
-  NIMF_MESSAGE_SET_SURROUNDING_REPLY,
+  NIMF_MESSAGE_SET_SURROUNDING_REPLY,     /* old clients only */
   NIMF_MESSAGE_GET_SURROUNDING,
   NIMF_MESSAGE_GET_SURROUNDING_REPLY,
   NIMF_MESSAGE_SET_CURSOR_LOCATION,
-  NIMF_MESSAGE_SET_CURSOR_LOCATION_REPLY,
+  NIMF_MESSAGE_SET_CURSOR_LOCATION_REPLY, /* old clients only */
   NIMF_MESSAGE_SET_USE_PREEDIT,
-  NIMF_MESSAGE_SET_USE_PREEDIT_REPLY,
+  NIMF_MESSAGE_SET_USE_PREEDIT_REPLY,     /* old clients only */
   /* agent methods */
   NIMF_MESSAGE_GET_LOADED_ENGINE_IDS,
   NIMF_MESSAGE_GET_LOADED_ENGINE_IDS_REPLY,
@@ -76,29 +79,55 @@ typedef enum
   NIMF_MESSAGE_RETRIEVE_SURROUNDING_REPLY,
   NIMF_MESSAGE_DELETE_SURROUNDING,
   NIMF_MESSAGE_DELETE_SURROUNDING_REPLY,
-  NIMF_MESSAGE_ENGINE_CHANGED
+  NIMF_MESSAGE_ENGINE_CHANGED,
+  /* The values above are on the wire since the first release; add new
+   * types only below. */
+  /* context signals batched while the server dispatches a request */
+  NIMF_MESSAGE_COMPOUND,
+  /* transport */
+  NIMF_MESSAGE_SHM_ATTACH,
+  NIMF_MESSAGE_SHM_ATTACH_REPLY,
+  NIMF_MESSAGE_HELLO,
+  NIMF_MESSAGE_HELLO_REPLY,
+  /* acknowledges a one-way message if the peer did not negotiate them */
+  NIMF_MESSAGE_ACK
 } NimfMessageType;
 
+#define NIMF_PROTOCOL_VERSION 1
+
+/* This is also the wire format: 16 bytes without padding, little-endian
+ * on the wire.  A zero version is the unversioned header of old clients
+ * which had padding there. */
 struct _NimfMessageHeader
 {
-  guint16         icid;
-  NimfMessageType type;
-  guint16         data_len;
+  guint16 icid;
+  guint8  version;
+  guint8  flags;
+  guint16 type;
+  guint16 reserved;
+  guint32 data_len;
+  guint32 seq; /* a reply carries the seq of its request */
 };
 
+/* bodies up to this size are stored in the message itself */
+#define NIMF_MESSAGE_INLINE_SIZE 64
+
 struct _NimfMessage
 {
-  NimfMessageHeader *header;
+  NimfMessageHeader  header;
   gchar             *data;
   GDestroyNotify     data_destroy_func;
   gint               ref_count;
+  gpointer           pool; /* the recycler of a received message */
+  /* follows the pointers, so that it is aligned like a g_malloc()'d body */
+  gchar              inline_data[NIMF_MESSAGE_INLINE_SIZE];
 };
 
 NimfMessage  *nimf_message_new              (void);
 NimfMessage  *nimf_message_new_full         (NimfMessageType  type,
                                              guint16          im_id,
                                              gpointer         data,
-                                             guint16          data_len,
+                                             guint32          data_len,
                                              GDestroyNotify   data_destroy_func);
 NimfMessage  *nimf_message_ref              (NimfMessage     *message);
 void          nimf_message_unref            (NimfMessage     *message);
@@ -107,10 +136,10 @@ const NimfMessageHeader *
 guint16       nimf_message_get_header_size  (void);
 void          nimf_message_set_body         (NimfMessage     *message,
                                              gchar           *data,
-                                             guint16          data_len,
+                                             guint32          data_len,
                                              GDestroyNotify   data_destroy_func);
 const gchar  *nimf_message_get_body         (NimfMessage     *message);
-guint16       nimf_message_get_body_size    (NimfMessage     *message);
+guint32       nimf_message_get_body_size    (NimfMessage     *message);
 const gchar  *nimf_message_get_name         (NimfMessage     *message);
 const gchar  *nimf_message_get_name_by_type (NimfMessageType  type);
 
@@ -21,6 +21,7 @@
 
 #include "config.h"
 #include "nimf-module.h"
+#include "nimf-trace.h"
 #include <gio/gio.h>
 
 G_DEFINE_TYPE (NimfModule, nimf_module, G_TYPE_TYPE_MODULE);
@@ -28,7 +29,7 @@ G_DEFINE_TYPE (NimfModule, nimf_module, G_TYPE_TYPE_MODULE);
 NimfModule *
 nimf_module_new (const gchar *path)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (path != NULL, NULL);
 
@@ -42,7 +43,7 @@ nimf_module_new (const gchar *path)
 static gboolean
 nimf_module_load (GTypeModule *gmodule)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfModule *module = NIMF_MODULE (gmodule);
 
@@ -77,7 +78,7 @@ nimf_module_load (GTypeModule *gmodule)
 static void
 nimf_module_unload (GTypeModule *gmodule)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfModule *module = NIMF_MODULE (gmodule);
 
@@ -89,13 +90,13 @@ nimf_module_unload (GTypeModule *gmodule)
 static void
 nimf_module_init (NimfModule *module)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 static void
 nimf_module_class_init (NimfModuleClass *klass)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GTypeModuleClass *module_class = G_TYPE_MODULE_CLASS (klass);
 
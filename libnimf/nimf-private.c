@@ -19,148 +19,1939 @@
  * along with this program;  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "config.h"
 #include "nimf-private.h"
+#include "nimf-trace.h"
+#include "nimf-ring.h"
+#include <gio/gunixfdmessage.h>
 #include <syslog.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+#ifdef HAVE_EPOLL_CREATE1
+#include <sys/epoll.h>
+#endif
+
+static void
+nimf_header_to_wire (const NimfMessageHeader *header,
+                     NimfMessageHeader       *wire)
+{
+  wire->icid     = GUINT16_TO_LE (header->icid);
+  wire->version  = NIMF_PROTOCOL_VERSION;
+  wire->flags    = 0;
+  wire->type     = GUINT16_TO_LE (header->type);
+  wire->reserved = 0;
+  wire->data_len = GUINT32_TO_LE (header->data_len);
+  wire->seq      = GUINT32_TO_LE (header->seq);
+}
+
+static void
+nimf_header_from_wire (gconstpointer      wire,
+                       NimfMessageHeader *header)
+{
+  memcpy (header, wire, sizeof (NimfMessageHeader));
+  header->icid     = GUINT16_FROM_LE (header->icid);
+  header->type     = GUINT16_FROM_LE (header->type);
+  header->data_len = GUINT32_FROM_LE (header->data_len);
+  header->seq      = GUINT32_FROM_LE (header->seq);
+}
+
+/* The header of clients built before NIMF_PROTOCOL_VERSION, as they wrote
+ * it: in host order, with zero padding where the version is now, and no
+ * seq; they match replies by icid and type. */
+typedef struct
+{
+  guint16 icid;
+  guint16 padding;
+  guint32 type;
+  guint16 data_len;
+  guint16 padding2;
+} NimfLegacyHeader;
+
+G_STATIC_ASSERT (sizeof (NimfLegacyHeader) == 12);
+
+/* Old clients know the types up to NIMF_MESSAGE_ENGINE_CHANGED by the
+ * values they had then; these pin a few of them. */
+G_STATIC_ASSERT (NIMF_MESSAGE_FILTER_EVENT_REPLY         == 6);
+G_STATIC_ASSERT (NIMF_MESSAGE_FOCUS_IN                   == 9);
+G_STATIC_ASSERT (NIMF_MESSAGE_GET_SURROUNDING            == 15);
+G_STATIC_ASSERT (NIMF_MESSAGE_SET_CURSOR_LOCATION        == 17);
+G_STATIC_ASSERT (NIMF_MESSAGE_GET_LOADED_ENGINE_IDS      == 21);
+G_STATIC_ASSERT (NIMF_MESSAGE_PREEDIT_START              == 25);
+G_STATIC_ASSERT (NIMF_MESSAGE_COMMIT                     == 31);
+G_STATIC_ASSERT (NIMF_MESSAGE_ENGINE_CHANGED             == 37);
+
+/* Returns the type of an old client's message, or NIMF_MESSAGE_NONE if
+ * old clients did not have it. */
+NimfMessageType
+nimf_message_type_from_legacy (guint32 legacy_type)
+{
+  if (legacy_type == NIMF_MESSAGE_NONE ||
+      legacy_type >  NIMF_MESSAGE_ENGINE_CHANGED)
+    return NIMF_MESSAGE_NONE;
+
+  return legacy_type;
+}
+
+/* Returns the value of @type for an old client, or NIMF_MESSAGE_NONE if
+ * it can not be sent to one. */
+guint32
+nimf_message_type_to_legacy (NimfMessageType type)
+{
+  if (type > NIMF_MESSAGE_ENGINE_CHANGED)
+    return NIMF_MESSAGE_NONE;
+
+  return type;
+}
+
+/* Returns the reply an old peer waits for after @type, or
+ * NIMF_MESSAGE_NONE if it waits for none. */
+NimfMessageType
+nimf_message_get_legacy_reply_type (NimfMessageType type)
+{
+  switch (type)
+  {
+    case NIMF_MESSAGE_FOCUS_IN:
+      return NIMF_MESSAGE_FOCUS_IN_REPLY;
+    case NIMF_MESSAGE_FOCUS_OUT:
+      return NIMF_MESSAGE_FOCUS_OUT_REPLY;
+    case NIMF_MESSAGE_SET_SURROUNDING:
+      return NIMF_MESSAGE_SET_SURROUNDING_REPLY;
+    case NIMF_MESSAGE_SET_CURSOR_LOCATION:
+      return NIMF_MESSAGE_SET_CURSOR_LOCATION_REPLY;
+    case NIMF_MESSAGE_SET_USE_PREEDIT:
+      return NIMF_MESSAGE_SET_USE_PREEDIT_REPLY;
+    case NIMF_MESSAGE_RETRIEVE_SURROUNDING:
+      return NIMF_MESSAGE_RETRIEVE_SURROUNDING_REPLY;
+    case NIMF_MESSAGE_DELETE_SURROUNDING:
+      return NIMF_MESSAGE_DELETE_SURROUNDING_REPLY;
+    default:
+      return NIMF_MESSAGE_NONE;
+  }
+}
+
+static void
+nimf_header_to_legacy (const NimfMessageHeader *header,
+                       NimfLegacyHeader        *legacy)
+{
+  memset (legacy, 0, sizeof (NimfLegacyHeader));
+  legacy->icid     = header->icid;
+  legacy->type     = nimf_message_type_to_legacy (header->type);
+  legacy->data_len = header->data_len;
+}
+
+static void
+nimf_header_from_legacy (gconstpointer      wire,
+                         NimfMessageHeader *header)
+{
+  NimfLegacyHeader legacy;
+
+  memcpy (&legacy, wire, sizeof (NimfLegacyHeader));
+  memset (header, 0, sizeof (NimfMessageHeader));
+  header->icid     = legacy.icid;
+  header->type     = nimf_message_type_from_legacy (legacy.type);
+  header->data_len = legacy.data_len;
+}
 
 void
+nimf_compound_append (GByteArray      *compound,
+                      guint16          icid,
+                      NimfMessageType  type,
+                      gconstpointer    data,
+                      guint32          data_len)
+{
+  NIMF_TRACE ();
+
+  NimfMessageHeader header = {0};
+  guint             offset;
+
+  if (compound->len < NIMF_COMPOUND_PREFIX_SIZE)
+    g_byte_array_set_size (compound, NIMF_COMPOUND_PREFIX_SIZE);
+
+  offset = NIMF_COMPOUND_ALIGN (compound->len);
+
+  header.icid     = icid;
+  header.type     = type;
+  header.data_len = data_len;
+
+  g_byte_array_set_size (compound, offset + sizeof (NimfMessageHeader) + data_len);
+  nimf_header_to_wire (&header,
+                       (NimfMessageHeader *) (compound->data + offset));
+
+  if (data_len > 0)
+    memcpy (compound->data + offset + sizeof (NimfMessageHeader), data, data_len);
+}
+
+gboolean
+nimf_compound_next (const gchar        *compound,
+                    guint32             compound_len,
+                    guint32            *offset,
+                    NimfMessageHeader  *header,
+                    const gchar       **data)
+{
+  NIMF_TRACE ();
+
+  guint pos;
+
+  if (*offset < NIMF_COMPOUND_PREFIX_SIZE)
+    *offset = NIMF_COMPOUND_PREFIX_SIZE;
+
+  pos = NIMF_COMPOUND_ALIGN (*offset);
+
+  if (pos + sizeof (NimfMessageHeader) > compound_len)
+    return FALSE;
+
+  nimf_header_from_wire (compound + pos, header);
+
+  if (G_UNLIKELY (header->data_len > compound_len -
+                                     pos - sizeof (NimfMessageHeader)))
+  {
+    g_critical (G_STRLOC ": %s: truncated record", G_STRFUNC);
+    return FALSE;
+  }
+
+  *data   = compound + pos + sizeof (NimfMessageHeader);
+  *offset = pos + sizeof (NimfMessageHeader) + header->data_len;
+
+  return TRUE;
+}
+
+#define NIMF_STREAM_READ_SIZE 4096
+
+/* Write queues, see nimf_socket_enable_write_queue().  Past the high-water
+ * mark a queued PREEDIT_CHANGED, alone or in a compound, is dropped for a
+ * newer one of its context; a peer is dropped once its queue grows past the
+ * maximum or makes no progress for the timeout. */
+#define NIMF_WRITE_QUEUE_HIGH_WATER (64 * 1024)
+#define NIMF_WRITE_QUEUE_MAX        (4 * 1024 * 1024)
+#define NIMF_WRITE_QUEUE_TIMEOUT    (10 * G_USEC_PER_SEC)
+
+/* a frame waiting in a write queue: wire header and body */
+typedef struct
+{
+  guint16  icid;
+  guint16  type;
+  guint32  len;
+  guint32  offset; /* written so far */
+  gchar   *data;
+} NimfOutFrame;
+
+/* Optional shared memory channel of a connection.  Frames go through the
+ * rings instead of the socket; an eventfd per side, the doorbell, tells
+ * the peer that its receive ring has data or its send ring has room. */
+typedef struct
+{
+  NimfRing *tx;
+  NimfRing *rx;
+  gint      doorbell;      /* rung by the peer */
+  gint      peer_doorbell; /* rung for the peer */
+} NimfShm;
+
+typedef struct _NimfSocketWatch NimfSocketWatch;
+
+/* Per-socket framing state.  Received bytes are kept in @buffer starting at
+ * @offset, so that several queued messages can be parsed from one read and
+ * a message split across reads is completed by the next one. */
+typedef struct
+{
+  GByteArray *buffer;
+  guint       offset;
+  NimfShm    *shm;         /* active */
+  NimfShm    *pending_shm; /* offered, waiting for the reply */
+  GArray     *fds;         /* received with SCM_RIGHTS */
+  guint32     next_seq;
+  guint       n_fills;
+  guint32     capabilities; /* negotiated with NIMF_MESSAGE_HELLO */
+  NimfMessagePool *pool;    /* received messages */
+  gboolean    queue_writes;
+  GQueue      out_queue;    /* NimfOutFrame */
+  gsize       out_queued;   /* bytes left in out_queue */
+  gint64      out_progress; /* when out_queue last got shorter */
+  NimfSocketWatch *watch;   /* in a socket set, see nimf_socket_set_new() */
+  gboolean    allow_legacy; /* see nimf_socket_allow_legacy() */
+  gboolean    has_frame;    /* the kind of the peer is known */
+  gboolean    is_legacy;
+  GQueue      legacy_calls; /* NimfLegacyCall, waiting for replies */
+} NimfStream;
+
+/* a signal sent to an old client whose reply carries a result */
+typedef struct
+{
+  guint16 type;
+  guint32 seq;
+} NimfLegacyCall;
+
+static void nimf_socket_watch_update (NimfSocketWatch *watch);
+
+G_DEFINE_QUARK (nimf-stream, nimf_stream)
+
+static NimfShm *
+nimf_shm_new (void)
+{
+  NimfShm *shm = g_slice_new0 (NimfShm);
+
+  shm->doorbell      = -1;
+  shm->peer_doorbell = -1;
+
+  return shm;
+}
+
+static void
+nimf_shm_free (NimfShm *shm)
+{
+  if (shm == NULL)
+    return;
+
+  nimf_ring_free (shm->tx);
+  nimf_ring_free (shm->rx);
+
+  if (shm->doorbell >= 0)
+    close (shm->doorbell);
+
+  if (shm->peer_doorbell >= 0)
+    close (shm->peer_doorbell);
+
+  g_slice_free (NimfShm, shm);
+}
+
+static void
+nimf_shm_ring (gint doorbell)
+{
+  guint64 one = 1;
+
+  if (write (doorbell, &one, sizeof (guint64)) < 0 && errno != EAGAIN)
+    g_warning (G_STRLOC ": %s: %s", G_STRFUNC, g_strerror (errno));
+}
+
+static void
+nimf_shm_drain (gint doorbell)
+{
+  guint64 value;
+
+  while (read (doorbell, &value, sizeof (guint64)) > 0)
+    ;
+}
+
+/* Blocks until the doorbell rings, for at most @timeout milliseconds if it
+ * is not negative.  Returns FALSE if the socket becomes readable instead,
+ * which only happens when the peer hangs up, or on the timeout. */
+static gboolean
+nimf_shm_wait (NimfShm *shm,
+               GSocket *socket,
+               gint     timeout)
+{
+  struct pollfd fds[2];
+  gint          n_fds;
+
+  fds[0].fd     = shm->doorbell;
+  fds[0].events = POLLIN;
+  fds[1].fd     = g_socket_get_fd (socket);
+  fds[1].events = POLLIN;
+
+  while ((n_fds = poll (fds, 2, timeout)) < 0)
+  {
+    if (errno != EINTR)
+      return FALSE;
+  }
+
+  if (n_fds == 0)
+  {
+    g_warning (G_STRLOC ": %s: the peer stalled, fd: %d", G_STRFUNC,
+               g_socket_get_fd (socket));
+    return FALSE;
+  }
+
+  if (fds[1].revents)
+    return FALSE;
+
+  nimf_shm_drain (shm->doorbell);
+
+  return TRUE;
+}
+
+static void
+nimf_stream_close_fds (NimfStream *stream)
+{
+  guint i;
+
+  if (stream->fds == NULL)
+    return;
+
+  for (i = 0; i < stream->fds->len; i++)
+    close (g_array_index (stream->fds, gint, i));
+
+  g_array_set_size (stream->fds, 0);
+}
+
+static void
+nimf_stream_free (NimfStream *stream)
+{
+  nimf_shm_free (stream->shm);
+  nimf_shm_free (stream->pending_shm);
+  nimf_stream_close_fds (stream);
+
+  if (stream->fds)
+    g_array_unref (stream->fds);
+
+  while (!g_queue_is_empty (&stream->out_queue))
+    g_free (g_queue_pop_head (&stream->out_queue));
+
+  while (!g_queue_is_empty (&stream->legacy_calls))
+    g_slice_free (NimfLegacyCall, g_queue_pop_head (&stream->legacy_calls));
+
+  g_byte_array_unref (stream->buffer);
+  nimf_message_pool_unref (stream->pool);
+  g_slice_free (NimfStream, stream);
+}
+
+static NimfStream *
+nimf_stream_get (GSocket *socket)
+{
+  NimfStream *stream;
+
+  stream = g_object_get_qdata (G_OBJECT (socket), nimf_stream_quark ());
+
+  if (G_UNLIKELY (stream == NULL))
+  {
+    /* for g_socket_receive_message() to deserialize SCM_RIGHTS */
+    g_type_ensure (G_TYPE_UNIX_FD_MESSAGE);
+
+    stream = g_slice_new0 (NimfStream);
+    stream->buffer = g_byte_array_sized_new (NIMF_STREAM_READ_SIZE);
+    stream->pool   = nimf_message_pool_new ();
+    g_object_set_qdata_full (G_OBJECT (socket), nimf_stream_quark (), stream,
+                             (GDestroyNotify) nimf_stream_free);
+  }
+
+  return stream;
+}
+
+static guint32
+nimf_stream_get_max_data_len (NimfStream *stream)
+{
+  guint32 max_data_len = G_MAXUINT16;
+
+  if (stream->capabilities & NIMF_CAPABILITY_LARGE_PAYLOAD)
+    max_data_len = NIMF_MESSAGE_MAX_DATA_LEN;
+
+  /* a frame must fit in the ring at once */
+  if (stream->shm)
+    max_data_len = MIN (max_data_len,
+                        MIN (nimf_ring_get_size (stream->shm->tx),
+                             nimf_ring_get_size (stream->shm->rx)) -
+                        sizeof (NimfMessageHeader));
+
+  return max_data_len;
+}
+
+typedef enum
+{
+  NIMF_FRAME_INCOMPLETE,
+  NIMF_FRAME_COMPLETE,
+  NIMF_FRAME_INVALID
+} NimfFrameState;
+
+static gsize
+nimf_stream_get_header_size (NimfStream *stream)
+{
+  if (G_UNLIKELY (stream->is_legacy))
+    return sizeof (NimfLegacyHeader);
+
+  return sizeof (NimfMessageHeader);
+}
+
+static NimfFrameState
+nimf_stream_check_frame (NimfStream        *stream,
+                         NimfMessageHeader *header)
+{
+  const guint8 *data    = stream->buffer->data + stream->offset;
+  guint         n_bytes = stream->buffer->len - stream->offset;
+  gsize         header_size;
+
+  /* the first frame tells an old client by the padding after its icid */
+  if (G_UNLIKELY (!stream->has_frame))
+  {
+    if (n_bytes <= G_STRUCT_OFFSET (NimfMessageHeader, version))
+      return NIMF_FRAME_INCOMPLETE;
+
+    stream->has_frame = TRUE;
+    stream->is_legacy = stream->allow_legacy &&
+                        data[G_STRUCT_OFFSET (NimfMessageHeader, version)] == 0;
+  }
+
+  header_size = nimf_stream_get_header_size (stream);
+
+  if (n_bytes < header_size)
+    return NIMF_FRAME_INCOMPLETE;
+
+  if (G_UNLIKELY (stream->is_legacy))
+    nimf_header_from_legacy (data, header);
+  else
+    nimf_header_from_wire (data, header);
+
+  if (G_UNLIKELY ((!stream->is_legacy &&
+                   header->version != NIMF_PROTOCOL_VERSION) ||
+                  (stream->is_legacy && header->type == NIMF_MESSAGE_NONE) ||
+                  header->data_len > nimf_stream_get_max_data_len (stream)))
+    return NIMF_FRAME_INVALID;
+
+  if (n_bytes - header_size < header->data_len)
+    return NIMF_FRAME_INCOMPLETE;
+
+  return NIMF_FRAME_COMPLETE;
+}
+
+/* Old clients send no seq; they reply to signals in order, so the reply
+ * gets that of the oldest signal of its request type. */
+static guint32
+nimf_stream_take_legacy_seq (NimfStream *stream,
+                             guint16     type)
+{
+  GList *l;
+
+  for (l = stream->legacy_calls.head; l != NULL; l = l->next)
+  {
+    NimfLegacyCall *call = l->data;
+    guint32         seq  = call->seq;
+
+    if (nimf_message_get_legacy_reply_type (call->type) != type)
+      continue;
+
+    g_queue_delete_link (&stream->legacy_calls, l);
+    g_slice_free (NimfLegacyCall, call);
+
+    return seq;
+  }
+
+  return 0;
+}
+
+/* an invalid frame counts, so that the reader fails on it */
+static gboolean
+nimf_stream_has_message (NimfStream *stream)
+{
+  NimfMessageHeader header;
+
+  return nimf_stream_check_frame (stream, &header) != NIMF_FRAME_INCOMPLETE;
+}
+
+static gboolean
+nimf_stream_has_pending (NimfStream *stream)
+{
+  return nimf_stream_has_message (stream) ||
+         (stream->shm && !nimf_ring_is_empty (stream->shm->rx));
+}
+
+static void
+nimf_stream_take_fds (NimfStream             *stream,
+                      GSocketControlMessage **messages,
+                      gint                    n_messages)
+{
+  gint i;
+
+  for (i = 0; i < n_messages; i++)
+  {
+    if (G_IS_UNIX_FD_MESSAGE (messages[i]))
+    {
+      gint *fds;
+      gint  n_fds;
+
+      fds = g_unix_fd_message_steal_fds (G_UNIX_FD_MESSAGE (messages[i]),
+                                         &n_fds);
+      if (stream->fds == NULL)
+        stream->fds = g_array_new (FALSE, FALSE, sizeof (gint));
+
+      g_array_append_vals (stream->fds, fds, n_fds);
+      g_free (fds);
+    }
+
+    g_object_unref (messages[i]);
+  }
+
+  g_free (messages);
+}
+
+static gssize
+nimf_stream_fill (NimfStream  *stream,
+                  GSocket     *socket,
+                  gsize        size,
+                  GError     **error)
+{
+  gssize n_read;
+  guint  len;
+
+  if (stream->offset > 0)
+  {
+    g_byte_array_remove_range (stream->buffer, 0, stream->offset);
+    stream->offset = 0;
+  }
+
+  len = stream->buffer->len;
+  g_byte_array_set_size (stream->buffer, len + size);
+  stream->n_fills++;
+
+  if (stream->shm)
+  {
+    while ((n_read = nimf_ring_read (stream->shm->rx,
+                                     (gchar *) stream->buffer->data + len,
+                                     size)) == 0)
+    {
+      /* the daemon, which queues its writes, does not wait for long on
+       * a client which advertised data it does not send */
+      if (!nimf_shm_wait (stream->shm, socket,
+                          stream->queue_writes ?
+                          NIMF_WRITE_QUEUE_TIMEOUT / 1000 : -1))
+        break;
+    }
+
+    if (n_read > 0 && nimf_ring_steal_waiting (stream->shm->rx))
+      nimf_shm_ring (stream->shm->peer_doorbell);
+
+    if (G_UNLIKELY (n_read < 0))
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                           "corrupted shared memory ring");
+  }
+  else
+  {
+    GInputVector            vector;
+    GSocketControlMessage **messages   = NULL;
+    gint                    n_messages = 0;
+
+    vector.buffer = stream->buffer->data + len;
+    vector.size   = size;
+
+    n_read = g_socket_receive_message (socket, NULL, &vector, 1,
+                                       &messages, &n_messages, NULL,
+                                       NULL, error);
+    if (G_UNLIKELY (n_messages > 0))
+      nimf_stream_take_fds (stream, messages, n_messages);
+  }
+
+  g_byte_array_set_size (stream->buffer, len + MAX (n_read, 0));
+
+  return n_read;
+}
+
+static gboolean
+nimf_shm_send_vectors (NimfShm       *shm,
+                       GSocket       *socket,
+                       GOutputVector *vectors,
+                       gint           n_vectors)
+{
+  while (!nimf_ring_write (shm->tx, vectors, n_vectors))
+  {
+    /* set the flag first and try again, so that no wake-up is lost */
+    nimf_ring_set_waiting (shm->tx, TRUE);
+
+    if (nimf_ring_write (shm->tx, vectors, n_vectors))
+      break;
+
+    if (!nimf_shm_wait (shm, socket, -1))
+    {
+      g_critical (G_STRLOC ": %s: connection closed", G_STRFUNC);
+      return FALSE;
+    }
+  }
+
+  nimf_shm_ring (shm->peer_doorbell);
+
+  return TRUE;
+}
+
+static gboolean
+nimf_socket_send_vectors (GSocket       *socket,
+                          GOutputVector *vectors,
+                          gint           n_vectors)
+{
+  GError     *error = NULL;
+  NimfStream *stream;
+  gssize      n_written;
+
+  stream = g_object_get_qdata (G_OBJECT (socket), nimf_stream_quark ());
+
+  if (stream && stream->shm)
+    return nimf_shm_send_vectors (stream->shm, socket, vectors, n_vectors);
+
+  while (n_vectors > 0)
+  {
+    n_written = g_socket_send_message (socket, NULL, vectors, n_vectors,
+                                       NULL, 0, G_SOCKET_MSG_NONE,
+                                       NULL, &error);
+    if (G_UNLIKELY (n_written < 0))
+    {
+      g_critical (G_STRLOC ": %s: %s", G_STRFUNC, error->message);
+      g_error_free (error);
+
+      return FALSE;
+    }
+
+    /* skip what is written and continue with the rest on a short write */
+    while (n_vectors > 0 && (gsize) n_written >= vectors->size)
+    {
+      n_written -= vectors->size;
+      vectors++;
+      n_vectors--;
+    }
+
+    if (n_vectors > 0)
+    {
+      vectors->buffer = (const gchar *) vectors->buffer + n_written;
+      vectors->size  -= n_written;
+    }
+  }
+
+  return TRUE;
+}
+
+G_STATIC_ASSERT (sizeof (GOutputVector) == sizeof (struct iovec));
+
+/* Writes what the transport takes without blocking and returns the number
+ * of bytes written, or -1 on an error.  A shared memory ring takes a frame
+ * at once or not at all. */
+static gssize
+nimf_stream_try_send (NimfStream    *stream,
+                      GSocket       *socket,
+                      GOutputVector *vectors,
+                      gint           n_vectors)
+{
+  struct msghdr msg = {0};
+  gssize        n_written;
+  gsize         size = 0;
+  gint          i;
+
+  if (stream->shm)
+  {
+    for (i = 0; i < n_vectors; i++)
+      size += vectors[i].size;
+
+    if (!nimf_ring_write (stream->shm->tx, vectors, n_vectors))
+    {
+      /* the peer rings the doorbell once it makes room */
+      nimf_ring_set_waiting (stream->shm->tx, TRUE);
+
+      if (!nimf_ring_write (stream->shm->tx, vectors, n_vectors))
+        return 0;
+    }
+
+    nimf_shm_ring (stream->shm->peer_doorbell);
+
+    return size;
+  }
+
+  msg.msg_iov    = (struct iovec *) vectors;
+  msg.msg_iovlen = n_vectors;
+
+  do {
+    n_written = sendmsg (g_socket_get_fd (socket), &msg,
+                         MSG_DONTWAIT | MSG_NOSIGNAL);
+  } while (n_written < 0 && errno == EINTR);
+
+  if (n_written < 0)
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+
+  return n_written;
+}
+
+static void
+nimf_stream_clear_queue (NimfStream *stream)
+{
+  while (!g_queue_is_empty (&stream->out_queue))
+    g_free (g_queue_pop_head (&stream->out_queue));
+
+  stream->out_queued = 0;
+}
+
+/* Gives up on a peer which does not read.  The socket source of the
+ * connection sees the hang-up and ends the connection. */
+static void
+nimf_stream_abort (NimfStream *stream,
+                   GSocket    *socket)
+{
+  g_warning (G_STRLOC ": %s: dropping a stuck peer with %" G_GSIZE_FORMAT
+             " bytes queued, fd: %d", G_STRFUNC, stream->out_queued,
+             g_socket_get_fd (socket));
+
+  nimf_stream_clear_queue (stream);
+  g_socket_shutdown (socket, TRUE, TRUE, NULL);
+}
+
+static void
+nimf_stream_flush (NimfStream *stream,
+                   GSocket    *socket)
+{
+  NimfOutFrame *frame;
+
+  while ((frame = g_queue_peek_head (&stream->out_queue)))
+  {
+    GOutputVector vector;
+    gssize        n_written;
+
+    vector.buffer = frame->data + frame->offset;
+    vector.size   = frame->len - frame->offset;
+
+    n_written = nimf_stream_try_send (stream, socket, &vector, 1);
+
+    if (G_UNLIKELY (n_written < 0))
+    {
+      g_critical (G_STRLOC ": %s: %s", G_STRFUNC, g_strerror (errno));
+      nimf_stream_abort (stream, socket);
+      return;
+    }
+
+    if (n_written == 0)
+      return;
+
+    frame->offset      += n_written;
+    stream->out_queued -= n_written;
+    stream->out_progress = g_get_monotonic_time ();
+
+    if (frame->offset < frame->len)
+      return;
+
+    g_free (g_queue_pop_head (&stream->out_queue));
+  }
+}
+
+/* whether a frame of @type carries records, see nimf_compound_append() */
+static gboolean
+nimf_stream_is_compound (NimfStream *stream,
+                         guint16     type)
+{
+  return (stream->capabilities & NIMF_CAPABILITY_COMPOUND) &&
+         (type == NIMF_MESSAGE_COMPOUND ||
+          type == NIMF_MESSAGE_FILTER_EVENT_REPLY);
+}
+
+/* Removes the records of @type for @icid from a compound body in place
+ * and returns the new length of the body. */
+static guint32
+nimf_compound_remove (gchar   *compound,
+                      guint32  compound_len,
+                      guint16  icid,
+                      guint16  type)
+{
+  NimfMessageHeader  header;
+  const gchar       *data;
+  guint32            offset = 0;
+  guint32            len    = NIMF_COMPOUND_PREFIX_SIZE;
+
+  while (nimf_compound_next (compound, compound_len, &offset, &header, &data))
+  {
+    const gchar *record = data - sizeof (NimfMessageHeader);
+    guint32      record_len = compound + offset - record;
+
+    if (header.icid == icid && header.type == type)
+      continue;
+
+    /* records only move towards the front, past what is read */
+    len = NIMF_COMPOUND_ALIGN (len);
+    memmove (compound + len, record, record_len);
+    len += record_len;
+  }
+
+  return len;
+}
+
+/* drops the queued frames and compound records of @type for @icid which
+ * have not started */
+static void
+nimf_stream_drop_superseded (NimfStream *stream,
+                             guint16     icid,
+                             guint16     type)
+{
+  GList *l = stream->out_queue.head;
+
+  while (l)
+  {
+    GList        *next  = l->next;
+    NimfOutFrame *frame = l->data;
+
+    if (frame->offset > 0)
+    {
+      l = next;
+      continue;
+    }
+
+    if (frame->icid == icid && frame->type == type)
+    {
+      stream->out_queued -= frame->len;
+      g_queue_delete_link (&stream->out_queue, l);
+      g_free (frame);
+    }
+    else if (nimf_stream_is_compound (stream, frame->type))
+    {
+      NimfMessageHeader *wire = (NimfMessageHeader *) frame->data;
+      guint32            len;
+
+      len = nimf_compound_remove (frame->data + sizeof (NimfMessageHeader),
+                                  frame->len - sizeof (NimfMessageHeader),
+                                  icid, type);
+      stream->out_queued -= frame->len - sizeof (NimfMessageHeader) - len;
+      frame->len     = sizeof (NimfMessageHeader) + len;
+      wire->data_len = GUINT32_TO_LE (len);
+
+      /* nobody waits for a compound which is left without records */
+      if (frame->type == NIMF_MESSAGE_COMPOUND &&
+          len == NIMF_COMPOUND_PREFIX_SIZE)
+      {
+        stream->out_queued -= frame->len;
+        g_queue_delete_link (&stream->out_queue, l);
+        g_free (frame);
+      }
+    }
+
+    l = next;
+  }
+}
+
+/* drops what the PREEDIT_CHANGED of a frame makes stale, see
+ * nimf_stream_drop_superseded() */
+static void
+nimf_stream_coalesce (NimfStream    *stream,
+                      guint16        icid,
+                      guint16        type,
+                      GOutputVector *vectors,
+                      gint           n_vectors)
+{
+  NimfMessageHeader  header;
+  const gchar       *data;
+  guint32            offset = 0;
+
+  if (type == NIMF_MESSAGE_PREEDIT_CHANGED)
+  {
+    nimf_stream_drop_superseded (stream, icid, type);
+    return;
+  }
+
+  if (!nimf_stream_is_compound (stream, type) || n_vectors < 2)
+    return;
+
+  while (nimf_compound_next (vectors[1].buffer, vectors[1].size,
+                             &offset, &header, &data))
+  {
+    if (header.type == NIMF_MESSAGE_PREEDIT_CHANGED)
+      nimf_stream_drop_superseded (stream, header.icid, header.type);
+  }
+}
+
+/* Sends a frame or queues what the peer can not take yet; the socket
+ * source flushes the queue once the peer reads. */
+static gboolean
+nimf_stream_send_or_queue (NimfStream    *stream,
+                           GSocket       *socket,
+                           guint16        icid,
+                           guint16        type,
+                           GOutputVector *vectors,
+                           gint           n_vectors)
+{
+  NimfOutFrame *frame;
+  gssize        n_written = 0;
+  gsize         size = 0;
+  gint          i;
+
+  for (i = 0; i < n_vectors; i++)
+    size += vectors[i].size;
+
+  if (g_queue_is_empty (&stream->out_queue))
+  {
+    n_written = nimf_stream_try_send (stream, socket, vectors, n_vectors);
+
+    if (G_UNLIKELY (n_written < 0))
+    {
+      g_critical (G_STRLOC ": %s: %s", G_STRFUNC, g_strerror (errno));
+      return FALSE;
+    }
+
+    if ((gsize) n_written == size)
+      return TRUE;
+
+    stream->out_progress = g_get_monotonic_time ();
+  }
+  else if (stream->out_queued + size > NIMF_WRITE_QUEUE_MAX ||
+           g_get_monotonic_time () - stream->out_progress >
+           NIMF_WRITE_QUEUE_TIMEOUT)
+  {
+    nimf_stream_abort (stream, socket);
+    return FALSE;
+  }
+  else if (stream->out_queued > NIMF_WRITE_QUEUE_HIGH_WATER)
+  {
+    nimf_stream_coalesce (stream, icid, type, vectors, n_vectors);
+  }
+
+  frame = g_malloc (sizeof (NimfOutFrame) + size);
+  frame->icid   = icid;
+  frame->type   = type;
+  frame->len    = size;
+  frame->offset = n_written;
+  frame->data   = (gchar *) (frame + 1);
+
+  for (size = 0, i = 0; i < n_vectors; i++)
+  {
+    memcpy (frame->data + size, vectors[i].buffer, vectors[i].size);
+    size += vectors[i].size;
+  }
+
+  g_queue_push_tail (&stream->out_queue, frame);
+  stream->out_queued += frame->len - frame->offset;
+
+  /* the socket set polls for room from now on */
+  if (stream->watch && stream->out_queue.length == 1)
+    nimf_socket_watch_update (stream->watch);
+
+  return TRUE;
+}
+
+/* also taken by the main thread for a socket a worker writes, see
+ * nimf_socket_next_seq() */
+static guint32
+nimf_stream_next_seq (NimfStream *stream)
+{
+  guint32 seq;
+
+  do
+    seq = (guint32) g_atomic_int_add ((gint *) &stream->next_seq, 1) + 1;
+  while (G_UNLIKELY (seq == 0));
+
+  return seq;
+}
+
+static gboolean
+nimf_send_frame (GSocket         *socket,
+                 guint16          icid,
+                 NimfMessageType  type,
+                 guint32          seq,
+                 gpointer         data,
+                 guint32          data_len,
+                 GDestroyNotify   data_destroy_func)
+{
+  NimfStream        *stream = nimf_stream_get (socket);
+  NimfMessageHeader  header = {0};
+  NimfMessageHeader  wire;
+  NimfLegacyHeader   legacy;
+  GOutputVector      vectors[2];
+  gboolean           retval = FALSE;
+
+  /* the frame is written straight from the caller's data; no message is
+   * built for it */
+  header.icid     = icid;
+  header.version  = NIMF_PROTOCOL_VERSION;
+  header.type     = type;
+  header.data_len = data_len;
+  header.seq      = seq;
+
+  if (G_UNLIKELY (data_len > nimf_socket_get_max_data_len (socket)))
+  {
+    g_critical (G_STRLOC ": %s: %s is too large: %u bytes", G_STRFUNC,
+                nimf_message_get_name_by_type (type), data_len);
+  }
+  else if (G_UNLIKELY (stream->is_legacy &&
+                       nimf_message_type_to_legacy (type) == NIMF_MESSAGE_NONE))
+  {
+    g_critical (G_STRLOC ": %s: %s can not be sent to an old client",
+                G_STRFUNC, nimf_message_get_name_by_type (type));
+  }
+  else
+  {
+    /* header and body go out in one vectored write */
+    if (G_UNLIKELY (stream->is_legacy))
+    {
+      nimf_header_to_legacy (&header, &legacy);
+      vectors[0].buffer = &legacy;
+      vectors[0].size   = sizeof (NimfLegacyHeader);
+
+      if (type == NIMF_MESSAGE_RETRIEVE_SURROUNDING ||
+          type == NIMF_MESSAGE_DELETE_SURROUNDING)
+      {
+        NimfLegacyCall *call = g_slice_new (NimfLegacyCall);
+
+        call->type = type;
+        call->seq  = seq;
+        g_queue_push_tail (&stream->legacy_calls, call);
+      }
+    }
+    else
+    {
+      nimf_header_to_wire (&header, &wire);
+      vectors[0].buffer = &wire;
+      vectors[0].size   = sizeof (NimfMessageHeader);
+    }
+
+    vectors[1].buffer = data;
+    vectors[1].size   = data_len;
+
+    if (stream->queue_writes)
+      retval = nimf_stream_send_or_queue (stream, socket, icid, type,
+                                          vectors, data_len > 0 ? 2 : 1);
+    else
+      retval = nimf_socket_send_vectors (socket, vectors,
+                                         data_len > 0 ? 2 : 1);
+  }
+
+  if (retval)
+    NIMF_TRACE_MESSAGE (NIMF_TRACE_INSTANT, "send", type, seq);
+
+  if (data_destroy_func)
+    data_destroy_func (data);
+
+  return retval;
+}
+
+/* Returns the sequence number of the message, by which its reply is
+ * found, or 0 if it could not be sent. */
+guint32
 nimf_send_message (GSocket         *socket,
                    guint16          icid,
                    NimfMessageType  type,
                    gpointer         data,
-                   guint16          data_len,
+                   guint32          data_len,
                    GDestroyNotify   data_destroy_func)
 {
-  g_debug (G_STRLOC ": %s: fd = %d", G_STRFUNC, g_socket_get_fd (socket));
+  guint32 seq = nimf_stream_next_seq (nimf_stream_get (socket));
+
+  if (!nimf_send_frame (socket, icid, type, seq,
+                        data, data_len, data_destroy_func))
+    return 0;
+
+  return seq;
+}
+
+gboolean
+nimf_send_reply (GSocket         *socket,
+                 guint16          icid,
+                 NimfMessageType  type,
+                 guint32          seq,
+                 gpointer         data,
+                 guint32          data_len,
+                 GDestroyNotify   data_destroy_func)
+{
+  return nimf_send_frame (socket, icid, type, seq,
+                          data, data_len, data_destroy_func);
+}
+
+NimfMessage *nimf_recv_message (GSocket *socket)
+{
+  NIMF_TRACE ();
+
+  NimfStream        *stream = nimf_stream_get (socket);
+  NimfMessage       *message;
+  NimfMessageHeader  header;
+  NimfFrameState     state;
+  GError            *error = NULL;
+  gssize             n_read;
+  gsize              size;
+
+  while ((state = nimf_stream_check_frame (stream, &header)) ==
+         NIMF_FRAME_INCOMPLETE)
+  {
+    size = NIMF_STREAM_READ_SIZE;
+
+    /* read the rest of a large body at once */
+    if (stream->has_frame && stream->buffer->len - stream->offset >=
+                             nimf_stream_get_header_size (stream))
+      size = MAX (size, nimf_stream_get_header_size (stream) +
+                        header.data_len -
+                        (stream->buffer->len - stream->offset));
+
+    n_read = nimf_stream_fill (stream, socket, size, &error);
+
+    if (G_UNLIKELY (n_read <= 0))
+    {
+      if (error)
+      {
+        g_critical (G_STRLOC ": %s: %s", G_STRFUNC, error->message);
+        g_error_free (error);
+      }
+      else
+      {
+        g_critical (G_STRLOC ": %s: connection closed with %u bytes pending",
+                    G_STRFUNC, stream->buffer->len - stream->offset);
+      }
+
+      return NULL;
+    }
+  }
+
+  if (G_UNLIKELY (state == NIMF_FRAME_INVALID))
+  {
+    if (!stream->is_legacy && header.version != NIMF_PROTOCOL_VERSION)
+      g_warning (G_STRLOC ": %s: unsupported protocol version %d", G_STRFUNC,
+                 header.version);
+    else if (stream->is_legacy && header.type == NIMF_MESSAGE_NONE)
+      g_warning (G_STRLOC ": %s: unknown message type of an old client",
+                 G_STRFUNC);
+    else
+      g_warning (G_STRLOC ": %s: message is too large: %u bytes", G_STRFUNC,
+                 header.data_len);
+
+    /* nothing after it can be framed */
+    stream->offset = stream->buffer->len;
+
+    return NULL;
+  }
+
+  if (G_UNLIKELY (stream->is_legacy))
+    header.seq = nimf_stream_take_legacy_seq (stream, header.type);
+
+  stream->offset += nimf_stream_get_header_size (stream);
+  message = nimf_message_pool_take (stream->pool, &header,
+                                    (gchar *) stream->buffer->data +
+                                    stream->offset);
+  stream->offset += header.data_len;
+
+  NIMF_TRACE_MESSAGE (NIMF_TRACE_INSTANT, "recv", header.type, header.seq);
+
+  return message;
+}
+
+/* Offers shared memory rings to the server along with
+ * NIMF_MESSAGE_SHM_ATTACH and returns its seq, or 0 if nothing is offered.
+ * The rings are used once the server accepts them in
+ * NIMF_MESSAGE_SHM_ATTACH_REPLY, see nimf_shm_complete(). */
+guint32
+nimf_shm_offer (GSocket *socket,
+                guint16  icid)
+{
+  NIMF_TRACE ();
+
+#if defined (HAVE_MEMFD_CREATE) && defined (HAVE_EVENTFD)
+  NimfStream            *stream = nimf_stream_get (socket);
+  NimfShm               *shm;
+  GSocketControlMessage *fd_message;
+  NimfMessageHeader      header = {0};
+  NimfMessageHeader      wire;
+  GOutputVector          vector;
+  GError                *error = NULL;
+  gint                   server_doorbell;
+  gssize                 n_written;
+
+  shm = nimf_shm_new ();
+  shm->tx = nimf_ring_new (NIMF_RING_SIZE);
+  shm->rx = nimf_ring_new (NIMF_RING_SIZE);
+  shm->doorbell = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+  server_doorbell = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+  shm->peer_doorbell = server_doorbell;
 
-  NimfMessage *message;
-  const NimfMessageHeader *header;
-  GError *error = NULL;
-  gssize n_written;
+  if (!shm->tx || !shm->rx || shm->doorbell < 0 || server_doorbell < 0)
+  {
+    nimf_shm_free (shm);
+    return 0;
+  }
+
+  /* the order is the one of the server: its rx, its tx, its peer doorbell
+   * and its own doorbell */
+  fd_message = g_unix_fd_message_new ();
+
+  if (!g_unix_fd_message_append_fd (G_UNIX_FD_MESSAGE (fd_message),
+                                    nimf_ring_get_fd (shm->tx), &error) ||
+      !g_unix_fd_message_append_fd (G_UNIX_FD_MESSAGE (fd_message),
+                                    nimf_ring_get_fd (shm->rx), &error) ||
+      !g_unix_fd_message_append_fd (G_UNIX_FD_MESSAGE (fd_message),
+                                    shm->doorbell, &error) ||
+      !g_unix_fd_message_append_fd (G_UNIX_FD_MESSAGE (fd_message),
+                                    server_doorbell, &error))
+  {
+    g_warning (G_STRLOC ": %s: %s", G_STRFUNC, error->message);
+    g_error_free (error);
+    g_object_unref (fd_message);
+    nimf_shm_free (shm);
+
+    return 0;
+  }
 
-  message = nimf_message_new_full (type, icid,
-                                   data, data_len, data_destroy_func);
-  header  = nimf_message_get_header (message);
+  header.icid = icid;
+  header.type = NIMF_MESSAGE_SHM_ATTACH;
+  header.seq  = nimf_stream_next_seq (stream);
+  nimf_header_to_wire (&header, &wire);
+  vector.buffer = &wire;
+  vector.size   = sizeof (NimfMessageHeader);
 
-  n_written = g_socket_send (socket,
-                             (gchar *) header,
-                             nimf_message_get_header_size (),
-                             NULL, &error);
+  n_written = g_socket_send_message (socket, NULL, &vector, 1,
+                                     &fd_message, 1, G_SOCKET_MSG_NONE,
+                                     NULL, &error);
+  g_object_unref (fd_message);
 
-  if (G_UNLIKELY (n_written < nimf_message_get_header_size ()))
+  if (n_written != sizeof (NimfMessageHeader))
   {
-    g_critical (G_STRLOC ": %s: sent %"G_GSSIZE_FORMAT" less than %d",
-                G_STRFUNC, n_written, nimf_message_get_header_size ());
     if (error)
     {
       g_critical (G_STRLOC ": %s: %s", G_STRFUNC, error->message);
       g_error_free (error);
     }
 
-    nimf_message_unref (message);
+    nimf_shm_free (shm);
 
-    return;
+    return 0;
   }
 
-  if (G_LIKELY (message->header->data_len > 0))
+  nimf_shm_free (stream->pending_shm);
+  stream->pending_shm = shm;
+
+  return header.seq;
+#else
+  return 0;
+#endif
+}
+
+void
+nimf_shm_complete (GSocket  *socket,
+                   gboolean  accepted)
+{
+  NIMF_TRACE ();
+
+  NimfStream *stream = nimf_stream_get (socket);
+
+  if (accepted && stream->pending_shm)
+  {
+    nimf_shm_free (stream->shm);
+    stream->shm = stream->pending_shm;
+  }
+  else
   {
-    n_written = g_socket_send (socket,
-                               message->data,
-                               message->header->data_len,
-                               NULL, &error);
+    nimf_shm_free (stream->pending_shm);
+  }
 
-    if (G_UNLIKELY (n_written < message->header->data_len))
-    {
-      g_critical (G_STRLOC ": %s: sent %"G_GSSIZE_FORMAT" less than %d",
-                  G_STRFUNC, n_written, message->header->data_len);
+  stream->pending_shm = NULL;
+}
 
-      if (error)
-      {
-        g_critical (G_STRLOC ": %s: %s", G_STRFUNC, error->message);
-        g_error_free (error);
-      }
+/* Maps the rings which came with NIMF_MESSAGE_SHM_ATTACH and replies.
+ * The reply is the last message sent through the socket itself. */
+gboolean
+nimf_shm_accept (GSocket  *socket,
+                 guint16   icid,
+                 guint32   seq,
+                 gboolean  enabled)
+{
+  NIMF_TRACE ();
 
-      nimf_message_unref (message);
+  NimfStream *stream = nimf_stream_get (socket);
+  NimfShm    *shm    = NULL;
+  gboolean    accepted;
 
-      return;
+  if (enabled && stream->shm == NULL &&
+      stream->fds && stream->fds->len == 4)
+  {
+    gint *fds = (gint *) stream->fds->data;
+
+    shm = nimf_shm_new ();
+    shm->rx = nimf_ring_new_from_fd (fds[0]);
+    shm->tx = nimf_ring_new_from_fd (fds[1]);
+    shm->peer_doorbell = fds[2];
+    shm->doorbell      = fds[3];
+    g_array_set_size (stream->fds, 0);
+
+    if (!shm->rx || !shm->tx)
+    {
+      nimf_shm_free (shm);
+      shm = NULL;
     }
   }
 
-  /* debug message */
-  const gchar *name = nimf_message_get_name (message);
-  if (name)
-    g_debug ("send: %s, fd: %d", name, g_socket_get_fd(socket));
+  nimf_stream_close_fds (stream);
+
+  accepted = shm != NULL;
+  nimf_send_reply (socket, icid, NIMF_MESSAGE_SHM_ATTACH_REPLY, seq,
+                   &accepted, sizeof (gboolean), NULL);
+  stream->shm = shm;
+
+  return accepted;
+}
+
+guint32
+nimf_socket_get_capabilities (GSocket *socket)
+{
+  return nimf_stream_get (socket)->capabilities;
+}
+
+void
+nimf_socket_set_capabilities (GSocket *socket,
+                              guint32  capabilities)
+{
+  g_debug (G_STRLOC ": %s: 0x%x", G_STRFUNC, capabilities);
+
+  nimf_stream_get (socket)->capabilities = capabilities;
+}
+
+/* the largest body which may be sent to the peer */
+guint32
+nimf_socket_get_max_data_len (GSocket *socket)
+{
+  return nimf_stream_get_max_data_len (nimf_stream_get (socket));
+}
+
+/* Makes writes to @socket never block: what the peer can not take yet is
+ * queued and flushed by the source of the socket, so that
+ * nimf-daemon is not stalled by a client which does not read. */
+void
+nimf_socket_enable_write_queue (GSocket *socket)
+{
+  nimf_stream_get (socket)->queue_writes = TRUE;
+}
+
+/* Lets clients built before NIMF_PROTOCOL_VERSION use @socket.  Their
+ * header is told from a versioned one by its first frame, and kept for
+ * the replies; they negotiate no capabilities. */
+void
+nimf_socket_allow_legacy (GSocket *socket)
+{
+  nimf_stream_get (socket)->allow_legacy = TRUE;
+}
+
+gboolean
+nimf_socket_is_legacy (GSocket *socket)
+{
+  return nimf_stream_get (socket)->is_legacy;
+}
+
+/* The sequence number of a message which is to be sent with
+ * nimf_send_reply(), possibly in another thread. */
+guint32
+nimf_socket_next_seq (GSocket *socket)
+{
+  return nimf_stream_next_seq (nimf_stream_get (socket));
+}
+
+gboolean
+nimf_socket_has_queued_output (GSocket *socket)
+{
+  return !g_queue_is_empty (&nimf_stream_get (socket)->out_queue);
+}
+
+/* Unlike g_socket_create_source(), this source is also ready while
+ * complete messages are left in the receive buffer of the socket, and
+ * polls the doorbell once the shared memory channel is active. */
+typedef struct
+{
+  GSource     source;
+  GSocket    *socket;
+  NimfStream *stream;
+  GPollFD     poll_fd;
+  GPollFD     doorbell;
+  guint       n_fills;
+} NimfSocketSource;
+
+static gboolean
+nimf_socket_source_prepare (GSource *source,
+                            gint    *timeout)
+{
+  NimfSocketSource *socket_source = (NimfSocketSource *) source;
+
+  *timeout = -1;
+
+  if (G_UNLIKELY (socket_source->stream->shm &&
+                  socket_source->doorbell.fd < 0))
+  {
+    socket_source->doorbell.fd = socket_source->stream->shm->doorbell;
+    g_source_add_poll (source, &socket_source->doorbell);
+  }
+
+  /* a shared memory ring with room rings the doorbell instead */
+  if (!g_queue_is_empty (&socket_source->stream->out_queue) &&
+      !socket_source->stream->shm)
+    socket_source->poll_fd.events |= G_IO_OUT;
   else
-    g_error (G_STRLOC ": unknown message type");
+    socket_source->poll_fd.events &= ~G_IO_OUT;
 
-  nimf_message_unref (message);
+  return nimf_stream_has_pending (socket_source->stream);
 }
 
-NimfMessage *nimf_recv_message (GSocket *socket)
+static gboolean
+nimf_socket_source_check (GSource *source)
+{
+  NimfSocketSource *socket_source = (NimfSocketSource *) source;
+
+  socket_source->n_fills = socket_source->stream->n_fills;
+
+  return (socket_source->poll_fd.revents & socket_source->poll_fd.events) ||
+         nimf_stream_has_pending (socket_source->stream);
+}
+
+static gboolean
+nimf_socket_source_dispatch (GSource     *source,
+                             GSourceFunc  callback,
+                             gpointer     user_data)
+{
+  NimfSocketSource *socket_source = (NimfSocketSource *) source;
+  GIOCondition      condition;
+  GIOCondition      events;
+
+  if (G_UNLIKELY (callback == NULL))
+    return G_SOURCE_REMOVE;
+
+  if (socket_source->doorbell.revents)
+    nimf_shm_drain (socket_source->doorbell.fd);
+
+  if ((socket_source->poll_fd.revents & G_IO_OUT) ||
+      socket_source->doorbell.revents)
+    nimf_stream_flush (socket_source->stream, socket_source->socket);
+
+  /* the callback is for reading */
+  events = socket_source->poll_fd.events & ~G_IO_OUT;
+
+  /* buffered messages are delivered before a hang-up */
+  if (nimf_stream_has_pending (socket_source->stream))
+    condition = G_IO_IN;
+  else if (socket_source->n_fills != socket_source->stream->n_fills)
+    /* a reader waiting for a reply may have consumed what poll() saw */
+    condition = g_socket_condition_check (socket_source->socket, events);
+  else
+    condition = socket_source->poll_fd.revents & events;
+
+  if (condition == 0)
+    return G_SOURCE_CONTINUE;
+
+  return ((GSocketSourceFunc) callback) (socket_source->socket,
+                                         condition, user_data);
+}
+
+static void
+nimf_socket_source_finalize (GSource *source)
+{
+  g_object_unref (((NimfSocketSource *) source)->socket);
+}
+
+static GSourceFuncs nimf_socket_source_funcs = {
+  nimf_socket_source_prepare,
+  nimf_socket_source_check,
+  nimf_socket_source_dispatch,
+  nimf_socket_source_finalize
+};
+
+GSource *
+nimf_socket_source_new (GSocket *socket)
+{
+  NIMF_TRACE ();
+
+  GSource          *source;
+  NimfSocketSource *socket_source;
+
+  source = g_source_new (&nimf_socket_source_funcs, sizeof (NimfSocketSource));
+  socket_source = (NimfSocketSource *) source;
+  socket_source->socket = g_object_ref (socket);
+  socket_source->stream = nimf_stream_get (socket);
+  socket_source->poll_fd.fd = g_socket_get_fd (socket);
+  socket_source->poll_fd.events = G_IO_IN | G_IO_HUP | G_IO_ERR;
+  g_source_add_poll (source, &socket_source->poll_fd);
+  socket_source->doorbell.fd = -1;
+  socket_source->doorbell.events = G_IO_IN;
+
+  return source;
+}
+
+/* A source for many sockets.  Per-socket sources make every iteration of
+ * the main loop poll and scan all of them; with epoll only the sockets
+ * which are ready are looked at.  Sockets with messages already read into
+ * their buffers are kept on a list, so that prepare() does not go through
+ * all of them either.  Without epoll, the fds are polled by GLib. */
+#define NIMF_SOCKET_SET_MAX_EVENTS 64
+
+typedef struct _NimfSocketSet NimfSocketSet;
+
+typedef struct
+{
+  NimfSocketWatch *watch;
+  gint             fd;
+  GIOCondition     events;
+  gpointer         tag; /* without epoll */
+} NimfSocketFd;
+
+struct _NimfSocketWatch
+{
+  NimfSocketSet     *set; /* NULL once removed */
+  GSocket           *socket;
+  NimfStream        *stream;
+  GSocketSourceFunc  callback;
+  gpointer           user_data;
+  NimfSocketFd       fd;
+  NimfSocketFd       doorbell;
+  GList              link; /* in watches */
+  gboolean           is_pending;
+  gint               ref_count;
+};
+
+struct _NimfSocketSet
+{
+  GSource  source;
+  gint     epfd;
+  gpointer tag;
+  GQueue   watches;
+  GQueue   pending; /* may have messages read; holds references */
+};
+
+static NimfSocketWatch *
+nimf_socket_watch_ref (NimfSocketWatch *watch)
+{
+  watch->ref_count++;
+
+  return watch;
+}
+
+static void
+nimf_socket_watch_unref (NimfSocketWatch *watch)
+{
+  if (--watch->ref_count > 0)
+    return;
+
+  g_object_unref (watch->socket);
+  g_slice_free (NimfSocketWatch, watch);
+}
+
+static void
+nimf_socket_set_watch_fd (NimfSocketSet *set,
+                          NimfSocketFd  *sfd,
+                          GIOCondition   events)
+{
+#ifdef HAVE_EPOLL_CREATE1
+  struct epoll_event event = { 0 };
+
+  event.data.ptr = sfd;
+
+  if (events & G_IO_IN)
+    event.events |= EPOLLIN;
+
+  if (events & G_IO_OUT)
+    event.events |= EPOLLOUT;
+
+  if (epoll_ctl (set->epfd, sfd->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                 sfd->fd, &event) < 0)
+    g_critical (G_STRLOC ": %s: %s", G_STRFUNC, g_strerror (errno));
+#else
+  if (sfd->tag)
+    g_source_modify_unix_fd ((GSource *) set, sfd->tag, events);
+  else
+    sfd->tag = g_source_add_unix_fd ((GSource *) set, sfd->fd, events);
+#endif
+
+  sfd->events = events;
+}
+
+static void
+nimf_socket_set_unwatch_fd (NimfSocketSet *set,
+                            NimfSocketFd  *sfd)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  if (sfd->events == 0)
+    return;
 
-  NimfMessage *message = nimf_message_new ();
-  GError *error = NULL;
-  gssize n_read = 0;
+#ifdef HAVE_EPOLL_CREATE1
+  epoll_ctl (set->epfd, EPOLL_CTL_DEL, sfd->fd, NULL);
+#else
+  g_source_remove_unix_fd ((GSource *) set, sfd->tag);
+  sfd->tag = NULL;
+#endif
+
+  sfd->events = 0;
+}
 
-  n_read = g_socket_receive (socket,
-                             (gchar *) message->header,
-                             nimf_message_get_header_size (),
-                             NULL, &error);
+/* Follows the stream: polls for room while frames are queued, adds the
+ * doorbell once shared memory is active, and remembers messages left in
+ * the buffer. */
+static void
+nimf_socket_watch_update (NimfSocketWatch *watch)
+{
+  NimfSocketSet *set    = watch->set;
+  NimfStream    *stream = watch->stream;
+  GIOCondition   events = G_IO_IN | G_IO_HUP | G_IO_ERR;
 
-  if (G_UNLIKELY (n_read < nimf_message_get_header_size ()))
+  if (G_UNLIKELY (stream->shm && watch->doorbell.fd < 0))
   {
-    g_critical (G_STRLOC ": %s: received %"G_GSSIZE_FORMAT" less than %d",
-                G_STRFUNC, n_read, nimf_message_get_header_size ());
+    watch->doorbell.fd = stream->shm->doorbell;
+    nimf_socket_set_watch_fd (set, &watch->doorbell, G_IO_IN);
+  }
 
-    if (error)
-    {
-      g_critical (G_STRLOC ": %s: %s", G_STRFUNC, error->message);
-      g_error_free (error);
-    }
+  /* a shared memory ring with room rings the doorbell instead */
+  if (!g_queue_is_empty (&stream->out_queue) && !stream->shm)
+    events |= G_IO_OUT;
 
-    nimf_message_unref (message);
+  if (events != watch->fd.events)
+    nimf_socket_set_watch_fd (set, &watch->fd, events);
 
-    return NULL;
+  if (!watch->is_pending && nimf_stream_has_pending (stream))
+  {
+    watch->is_pending = TRUE;
+    g_queue_push_tail (&set->pending, nimf_socket_watch_ref (watch));
   }
+}
+
+/* @n_fills is that of the stream when @revents was polled */
+static void
+nimf_socket_watch_dispatch (NimfSocketWatch *watch,
+                            NimfSocketFd    *sfd,
+                            GIOCondition     revents,
+                            guint            n_fills)
+{
+  NimfSocketSet *set    = watch->set;
+  NimfStream    *stream = watch->stream;
+  GIOCondition   events = G_IO_IN | G_IO_HUP | G_IO_ERR;
+  GIOCondition   condition;
 
-  if (message->header->data_len > 0)
+  /* removed by a callback dispatched before */
+  if (set == NULL)
+    return;
+
+  if (sfd == &watch->doorbell)
+  {
+    nimf_shm_drain (sfd->fd);
+    nimf_stream_flush (stream, watch->socket);
+    revents = 0;
+  }
+  else if (revents & G_IO_OUT)
   {
-    nimf_message_set_body (message,
-                           g_malloc0 (message->header->data_len),
-                           message->header->data_len,
-                           g_free);
+    nimf_stream_flush (stream, watch->socket);
+  }
 
-    n_read = g_socket_receive (socket,
-                               message->data,
-                               message->header->data_len,
-                               NULL, &error);
+  /* buffered messages are delivered before a hang-up */
+  if (nimf_stream_has_pending (stream))
+    condition = G_IO_IN;
+  else if (revents == 0)
+    condition = 0;
+  else if (n_fills != stream->n_fills)
+    /* a reader waiting for a reply may have consumed what was polled */
+    condition = g_socket_condition_check (watch->socket, events);
+  else
+    condition = revents & events;
 
-    if (G_UNLIKELY (n_read < message->header->data_len))
-    {
-      g_critical (G_STRLOC ": %s: received %"G_GSSIZE_FORMAT" less than %d",
-                  G_STRFUNC, n_read, message->header->data_len);
+  if (condition &&
+      !watch->callback (watch->socket, condition, watch->user_data))
+    nimf_socket_set_remove ((GSource *) set, watch->socket);
 
-      if (error)
-      {
-        g_critical (G_STRLOC ": %s: %s", G_STRFUNC, error->message);
-        g_error_free (error);
-      }
+  if (watch->set)
+    nimf_socket_watch_update (watch);
+}
 
-      nimf_message_unref (message);
+static gboolean
+nimf_socket_set_prepare (GSource *source,
+                         gint    *timeout)
+{
+  *timeout = -1;
 
-      return NULL;
+  return !g_queue_is_empty (&((NimfSocketSet *) source)->pending);
+}
+
+static gboolean
+nimf_socket_set_check (GSource *source)
+{
+  NimfSocketSet *set = (NimfSocketSet *) source;
+
+  if (!g_queue_is_empty (&set->pending))
+    return TRUE;
+
+#ifdef HAVE_EPOLL_CREATE1
+  return g_source_query_unix_fd (source, set->tag) != 0;
+#else
+  GList *l;
+
+  for (l = set->watches.head; l; l = l->next)
+  {
+    NimfSocketWatch *watch = l->data;
+
+    if (g_source_query_unix_fd (source, watch->fd.tag) ||
+        (watch->doorbell.tag &&
+         g_source_query_unix_fd (source, watch->doorbell.tag)))
+      return TRUE;
+  }
+
+  return FALSE;
+#endif
+}
+
+static gboolean
+nimf_socket_set_dispatch (GSource     *source,
+                          GSourceFunc  callback,
+                          gpointer     user_data)
+{
+  NIMF_TRACE ();
+
+  NimfSocketSet   *set = (NimfSocketSet *) source;
+  NimfSocketWatch *watch;
+  NimfSocketFd    *ready[NIMF_SOCKET_SET_MAX_EVENTS];
+  GIOCondition     revents[NIMF_SOCKET_SET_MAX_EVENTS];
+  guint            n_fills[NIMF_SOCKET_SET_MAX_EVENTS];
+  GQueue           pending;
+  gint             n_ready = 0;
+  gint             i;
+
+  /* everything is collected before any callback runs, and referenced, as
+   * callbacks may remove watches or dispatch this source recursively */
+  pending = set->pending;
+  g_queue_init (&set->pending);
+
+#ifdef HAVE_EPOLL_CREATE1
+  struct epoll_event events[NIMF_SOCKET_SET_MAX_EVENTS];
+
+  do
+    n_ready = epoll_wait (set->epfd, events, NIMF_SOCKET_SET_MAX_EVENTS, 0);
+  while (n_ready < 0 && errno == EINTR);
+
+  for (i = 0; i < n_ready; i++)
+  {
+    ready[i]   = events[i].data.ptr;
+    revents[i] = 0;
+
+    if (events[i].events & EPOLLIN)
+      revents[i] |= G_IO_IN;
+    if (events[i].events & EPOLLOUT)
+      revents[i] |= G_IO_OUT;
+    if (events[i].events & EPOLLHUP)
+      revents[i] |= G_IO_HUP;
+    if (events[i].events & EPOLLERR)
+      revents[i] |= G_IO_ERR;
+  }
+#else
+  GList *l;
+
+  for (l = set->watches.head; l; l = l->next)
+  {
+    NimfSocketFd *sfds[2];
+    gint          j;
+
+    watch   = l->data;
+    sfds[0] = &watch->fd;
+    sfds[1] = &watch->doorbell;
+
+    for (j = 0; j < 2 && n_ready < NIMF_SOCKET_SET_MAX_EVENTS; j++)
+    {
+      if (sfds[j]->tag &&
+          (revents[n_ready] = g_source_query_unix_fd (source, sfds[j]->tag)))
+        ready[n_ready++] = sfds[j];
     }
   }
+#endif
 
-  /* debug message */
-  const gchar *name = nimf_message_get_name (message);
-  if (name)
-    g_debug ("recv: %s, fd: %d", name, g_socket_get_fd (socket));
-  else
-    g_error (G_STRLOC ": unknown message type");
+  for (i = 0; i < n_ready; i++)
+  {
+    nimf_socket_watch_ref (ready[i]->watch);
+    n_fills[i] = ready[i]->watch->stream->n_fills;
+  }
 
-  return message;
+  while ((watch = g_queue_pop_head (&pending)))
+  {
+    watch->is_pending = FALSE;
+    nimf_socket_watch_dispatch (watch, &watch->fd, 0, watch->stream->n_fills);
+    nimf_socket_watch_unref (watch);
+  }
+
+  for (i = 0; i < n_ready; i++)
+  {
+    nimf_socket_watch_dispatch (ready[i]->watch, ready[i], revents[i],
+                                n_fills[i]);
+    nimf_socket_watch_unref (ready[i]->watch);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+nimf_socket_set_finalize (GSource *source)
+{
+  NimfSocketSet   *set = (NimfSocketSet *) source;
+  NimfSocketWatch *watch;
+
+  while (set->watches.head)
+    nimf_socket_set_remove (source,
+                            ((NimfSocketWatch *) set->watches.head->data)->socket);
+
+  while ((watch = g_queue_pop_head (&set->pending)))
+    nimf_socket_watch_unref (watch);
+
+  if (set->epfd >= 0)
+    close (set->epfd);
+}
+
+static GSourceFuncs nimf_socket_set_funcs = {
+  nimf_socket_set_prepare,
+  nimf_socket_set_check,
+  nimf_socket_set_dispatch,
+  nimf_socket_set_finalize
+};
+
+GSource *
+nimf_socket_set_new (void)
+{
+  NIMF_TRACE ();
+
+  GSource       *source;
+  NimfSocketSet *set;
+
+  source = g_source_new (&nimf_socket_set_funcs, sizeof (NimfSocketSet));
+  set = (NimfSocketSet *) source;
+  set->epfd = -1;
+  g_queue_init (&set->watches);
+  g_queue_init (&set->pending);
+  g_source_set_name (source, "NimfSocketSet");
+
+#ifdef HAVE_EPOLL_CREATE1
+  set->epfd = epoll_create1 (EPOLL_CLOEXEC);
+
+  if (set->epfd < 0)
+    g_error (G_STRLOC ": %s: %s", G_STRFUNC, g_strerror (errno));
+
+  set->tag = g_source_add_unix_fd (source, set->epfd, G_IO_IN);
+#endif
+
+  return source;
+}
+
+/* Calls @callback like a source of g_socket_create_source() would, in the
+ * thread of the main context @source is attached to; also removed if
+ * @callback returns G_SOURCE_REMOVE.  Call it from that thread. */
+void
+nimf_socket_set_add (GSource           *source,
+                     GSocket           *socket,
+                     GSocketSourceFunc  callback,
+                     gpointer           user_data)
+{
+  NIMF_TRACE ();
+
+  NimfSocketSet   *set    = (NimfSocketSet *) source;
+  NimfStream      *stream = nimf_stream_get (socket);
+  NimfSocketWatch *watch;
+
+  g_return_if_fail (stream->watch == NULL);
+
+  watch = g_slice_new0 (NimfSocketWatch);
+  watch->set         = set;
+  watch->socket      = g_object_ref (socket);
+  watch->stream      = stream;
+  watch->callback    = callback;
+  watch->user_data   = user_data;
+  watch->fd.watch    = watch;
+  watch->fd.fd       = g_socket_get_fd (socket);
+  watch->doorbell.watch = watch;
+  watch->doorbell.fd = -1;
+  watch->link.data   = watch;
+  watch->ref_count   = 1;
+
+  g_queue_push_tail_link (&set->watches, &watch->link);
+  stream->watch = watch;
+  nimf_socket_watch_update (watch);
+}
+
+void
+nimf_socket_set_remove (GSource *source,
+                        GSocket *socket)
+{
+  NIMF_TRACE ();
+
+  NimfSocketSet   *set    = (NimfSocketSet *) source;
+  NimfStream      *stream = nimf_stream_get (socket);
+  NimfSocketWatch *watch  = stream->watch;
+
+  if (watch == NULL || watch->set != set)
+    return;
+
+  nimf_socket_set_unwatch_fd (set, &watch->fd);
+  nimf_socket_set_unwatch_fd (set, &watch->doorbell);
+  g_queue_unlink (&set->watches, &watch->link);
+
+  /* left on the pending list, if there, until it is dispatched */
+  stream->watch = NULL;
+  watch->set = NULL;
+  nimf_socket_watch_unref (watch);
 }
 
 void nimf_log_default_handler (const gchar    *log_domain,
@@ -210,23 +2001,21 @@ void nimf_log_default_handler (const gchar    *log_domain,
 }
 
 void
-nimf_result_iteration_until (NimfResult      *result,
-                             GMainContext    *main_context,
-                             guint16          icid,
-                             NimfMessageType  type)
+nimf_result_iteration_until (NimfResult   *result,
+                             GMainContext *main_context,
+                             guint32       seq)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   do {
     result->is_dispatched = FALSE;
     g_main_context_iteration (main_context, TRUE);
   } while ((result->is_dispatched == FALSE) ||
-           (result->reply && ((result->reply->header->type != type) ||
-                              (result->reply->header->icid != icid))));
+           (result->reply && result->reply->header.seq != seq));
 
   if (G_UNLIKELY (result->is_dispatched == TRUE && result->reply == NULL))
-    g_critical (G_STRLOC ": %s:Can't receive %s", G_STRFUNC,
-                nimf_message_get_name_by_type (type));
+    g_critical (G_STRLOC ": %s: Can't receive the reply of %u",
+                G_STRFUNC, seq);
 
   /* This prevents not checking reply in the following iteration
    *                               send commit (wait reply)
@@ -43,7 +43,8 @@ struct _NimfEnginePrivate
   gint        surrounding_cursor_index;
 };
 
-typedef struct _NimfResult NimfResult;
+typedef struct _NimfResult      NimfResult;
+typedef struct _NimfMessagePool NimfMessagePool;
 
 struct _NimfResult
 {
@@ -51,21 +52,107 @@ struct _NimfResult
   NimfMessage *reply;
 };
 
-void         nimf_send_message           (GSocket         *socket,
-                                          guint16          im_id,
+/* Features negotiated with NIMF_MESSAGE_HELLO.  Each side advertises what
+ * it supports and both use the intersection. */
+typedef enum
+{
+  NIMF_CAPABILITY_COMPOUND      = 1 << 0, /* NIMF_MESSAGE_COMPOUND, batched
+                                             FILTER_EVENT_REPLY */
+  NIMF_CAPABILITY_ONE_WAY       = 1 << 1, /* no NIMF_MESSAGE_ACK needed */
+  NIMF_CAPABILITY_SHM           = 1 << 2, /* NIMF_MESSAGE_SHM_ATTACH */
+  NIMF_CAPABILITY_LARGE_PAYLOAD = 1 << 3  /* bodies over 64 KiB */
+} NimfCapabilities;
+
+/* the body of NIMF_MESSAGE_HELLO and its reply, little-endian */
+typedef struct
+{
+  guint32 version;
+  guint32 capabilities;
+} NimfHello;
+
+#define NIMF_MESSAGE_MAX_DATA_LEN (1 << 24)
+
+/* A compound body is an 8-byte prefix followed by 8-byte aligned records.
+ * Each record is a NimfMessageHeader followed by its body.  The prefix of
+ * NIMF_MESSAGE_FILTER_EVENT_REPLY holds the gboolean result of the event. */
+#define NIMF_COMPOUND_PREFIX_SIZE 8
+#define NIMF_COMPOUND_ALIGN(n)    (((n) + 7) & ~7)
+
+void         nimf_compound_append        (GByteArray      *compound,
+                                          guint16          icid,
+                                          NimfMessageType  type,
+                                          gconstpointer    data,
+                                          guint32          data_len);
+gboolean     nimf_compound_next          (const gchar     *compound,
+                                          guint32          compound_len,
+                                          guint32         *offset,
+                                          NimfMessageHeader *header,
+                                          const gchar    **data);
+guint32      nimf_send_message           (GSocket         *socket,
+                                          guint16          icid,
                                           NimfMessageType  type,
                                           gpointer         data,
-                                          guint16          data_len,
+                                          guint32          data_len,
+                                          GDestroyNotify   data_destroy_func);
+gboolean     nimf_send_reply             (GSocket         *socket,
+                                          guint16          icid,
+                                          NimfMessageType  type,
+                                          guint32          seq,
+                                          gpointer         data,
+                                          guint32          data_len,
                                           GDestroyNotify   data_destroy_func);
 NimfMessage *nimf_recv_message           (GSocket         *socket);
+NimfMessagePool *
+             nimf_message_pool_new       (void);
+void         nimf_message_pool_unref     (NimfMessagePool *pool);
+NimfMessage *nimf_message_pool_take      (NimfMessagePool *pool,
+                                          const NimfMessageHeader *header,
+                                          const gchar     *data);
+void         nimf_message_pool_release   (NimfMessagePool *pool,
+                                          NimfMessage     *message);
+GSource     *nimf_socket_source_new      (GSocket         *socket);
+GSource     *nimf_socket_set_new         (void);
+void         nimf_socket_set_add         (GSource         *source,
+                                          GSocket         *socket,
+                                          GSocketSourceFunc callback,
+                                          gpointer         user_data);
+void         nimf_socket_set_remove      (GSource         *source,
+                                          GSocket         *socket);
+guint32      nimf_socket_get_capabilities (GSocket        *socket);
+void         nimf_socket_set_capabilities (GSocket        *socket,
+                                           guint32         capabilities);
+guint32      nimf_socket_get_max_data_len (GSocket        *socket);
+void         nimf_socket_enable_write_queue (GSocket      *socket);
+gboolean     nimf_socket_has_queued_output  (GSocket      *socket);
+guint32      nimf_socket_next_seq           (GSocket      *socket);
+void         nimf_socket_allow_legacy       (GSocket      *socket);
+gboolean     nimf_socket_is_legacy          (GSocket      *socket);
+NimfMessageType
+             nimf_message_type_from_legacy  (guint32       legacy_type);
+guint32      nimf_message_type_to_legacy    (NimfMessageType type);
+NimfMessageType
+             nimf_message_get_legacy_reply_type (NimfMessageType type);
+guint32      nimf_shm_offer              (GSocket         *socket,
+                                          guint16          icid);
+void         nimf_shm_complete           (GSocket         *socket,
+                                          gboolean         accepted);
+gboolean     nimf_shm_accept             (GSocket         *socket,
+                                          guint16          icid,
+                                          guint32          seq,
+                                          gboolean         enabled);
 void         nimf_log_default_handler    (const gchar     *log_domain,
                                           GLogLevelFlags   log_level,
                                           const gchar     *message,
                                           gboolean        *debug);
 void         nimf_result_iteration_until (NimfResult      *result,
                                           GMainContext    *main_context,
+                                          guint32          seq);
+NimfMessage *nimf_client_call            (GSocket         *socket,
                                           guint16          icid,
-                                          NimfMessageType  type);
+                                          NimfMessageType  type,
+                                          gpointer         data,
+                                          guint32          data_len,
+                                          GDestroyNotify   data_destroy_func);
 G_END_DECLS
 
 #endif /* __NIMF_PRIVATE_H__ */
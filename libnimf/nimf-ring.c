@@ -0,0 +1,258 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * nimf-ring.c
+ * This file is part of Nimf.
+ *
+ * Copyright (C) 2015,2016 Hodong Kim <cogniti@gmail.com>
+ *
+ * Nimf is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nimf is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program;  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include "nimf-ring.h"
+#include "nimf-trace.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define NIMF_RING_MIN_SIZE  (1 << 12)
+#define NIMF_RING_MAX_SIZE  (1 << 24)
+
+/* head and tail are kept on separate cache lines */
+typedef struct
+{
+  gint head;    /* advanced by the producer */
+  gint padding1[15];
+  gint tail;    /* advanced by the consumer */
+  gint waiting; /* set by the producer while the ring is full */
+  gint padding2[14];
+} NimfRingHeader;
+
+struct _NimfRing
+{
+  NimfRingHeader *header;
+  gchar          *data;
+  guint32         size;
+  gsize           map_size;
+  gint            fd;
+};
+
+static NimfRing *
+nimf_ring_map (gint fd, gsize map_size)
+{
+  NIMF_TRACE ();
+
+  NimfRing *ring;
+  gpointer  addr;
+
+  addr = mmap (NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (addr == MAP_FAILED)
+  {
+    g_warning (G_STRLOC ": %s: %s", G_STRFUNC, g_strerror (errno));
+    close (fd);
+    return NULL;
+  }
+
+  ring = g_slice_new0 (NimfRing);
+  ring->header   = addr;
+  ring->data     = (gchar *) addr + sizeof (NimfRingHeader);
+  ring->size     = map_size - sizeof (NimfRingHeader);
+  ring->map_size = map_size;
+  ring->fd       = fd;
+
+  return ring;
+}
+
+NimfRing *
+nimf_ring_new (guint32 size)
+{
+  NIMF_TRACE ();
+
+#ifdef HAVE_MEMFD_CREATE
+  gint  fd;
+  gsize map_size = sizeof (NimfRingHeader) + size;
+
+  g_return_val_if_fail ((size & (size - 1)) == 0, NULL);
+
+  fd = memfd_create ("nimf-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+  if (fd < 0)
+    return NULL;
+
+  if (ftruncate (fd, map_size) < 0)
+  {
+    close (fd);
+    return NULL;
+  }
+
+#ifdef F_ADD_SEALS
+  /* the peer maps it too; it must not be able to shrink it under us */
+  fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+#endif
+
+  return nimf_ring_map (fd, map_size);
+#else
+  return NULL;
+#endif
+}
+
+/* Takes ownership of @fd, which comes from the peer. */
+NimfRing *
+nimf_ring_new_from_fd (gint fd)
+{
+  NIMF_TRACE ();
+
+  struct stat st;
+  gsize       size;
+
+  if (fstat (fd, &st) < 0 || st.st_size <= (off_t) sizeof (NimfRingHeader))
+  {
+    close (fd);
+    return NULL;
+  }
+
+  size = st.st_size - sizeof (NimfRingHeader);
+
+  if (size < NIMF_RING_MIN_SIZE || size > NIMF_RING_MAX_SIZE ||
+      (size & (size - 1)) != 0)
+  {
+    g_warning (G_STRLOC ": %s: invalid ring size %" G_GSIZE_FORMAT,
+               G_STRFUNC, size);
+    close (fd);
+    return NULL;
+  }
+
+#ifdef F_GET_SEALS
+  if ((fcntl (fd, F_GET_SEALS) & F_SEAL_SHRINK) == 0)
+  {
+    g_warning (G_STRLOC ": %s: ring is not sealed", G_STRFUNC);
+    close (fd);
+    return NULL;
+  }
+#endif
+
+  return nimf_ring_map (fd, st.st_size);
+}
+
+void
+nimf_ring_free (NimfRing *ring)
+{
+  NIMF_TRACE ();
+
+  if (ring == NULL)
+    return;
+
+  munmap (ring->header, ring->map_size);
+  close (ring->fd);
+  g_slice_free (NimfRing, ring);
+}
+
+gint
+nimf_ring_get_fd (NimfRing *ring)
+{
+  return ring->fd;
+}
+
+guint32
+nimf_ring_get_size (NimfRing *ring)
+{
+  return ring->size;
+}
+
+/* Writes all the vectors, or nothing if they do not fit. */
+gboolean
+nimf_ring_write (NimfRing      *ring,
+                 GOutputVector *vectors,
+                 gint           n_vectors)
+{
+  guint32 head = g_atomic_int_get (&ring->header->head);
+  guint32 tail = g_atomic_int_get (&ring->header->tail);
+  guint32 used = head - tail;
+  gsize   total = 0;
+  gint    i;
+
+  for (i = 0; i < n_vectors; i++)
+    total += vectors[i].size;
+
+  if (G_UNLIKELY (used > ring->size) || total > ring->size - used)
+    return FALSE;
+
+  for (i = 0; i < n_vectors; i++)
+  {
+    guint32 offset = head & (ring->size - 1);
+    gsize   len    = vectors[i].size;
+    gsize   n      = MIN (len, ring->size - offset);
+
+    memcpy (ring->data + offset, vectors[i].buffer, n);
+    memcpy (ring->data, (const gchar *) vectors[i].buffer + n, len - n);
+    head += len;
+  }
+
+  g_atomic_int_set (&ring->header->head, head);
+
+  return TRUE;
+}
+
+/* Returns the number of bytes read, or -1 if the peer broke the indices. */
+gssize
+nimf_ring_read (NimfRing *ring,
+                gchar    *buffer,
+                gsize     size)
+{
+  guint32 tail = g_atomic_int_get (&ring->header->tail);
+  guint32 head = g_atomic_int_get (&ring->header->head);
+  guint32 used = head - tail;
+  guint32 offset;
+  gsize   len;
+  gsize   n;
+
+  if (G_UNLIKELY (used > ring->size))
+    return -1;
+
+  len    = MIN (used, size);
+  offset = tail & (ring->size - 1);
+  n      = MIN (len, ring->size - offset);
+
+  memcpy (buffer, ring->data + offset, n);
+  memcpy (buffer + n, ring->data, len - n);
+
+  g_atomic_int_set (&ring->header->tail, tail + len);
+
+  return len;
+}
+
+gboolean
+nimf_ring_is_empty (NimfRing *ring)
+{
+  return g_atomic_int_get (&ring->header->head) ==
+         g_atomic_int_get (&ring->header->tail);
+}
+
+void
+nimf_ring_set_waiting (NimfRing *ring,
+                       gboolean  waiting)
+{
+  g_atomic_int_set (&ring->header->waiting, waiting);
+}
+
+gboolean
+nimf_ring_steal_waiting (NimfRing *ring)
+{
+  return g_atomic_int_compare_and_exchange (&ring->header->waiting, TRUE, FALSE);
+}
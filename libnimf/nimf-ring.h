@@ -0,0 +1,56 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * nimf-ring.h
+ * This file is part of Nimf.
+ *
+ * Copyright (C) 2015,2016 Hodong Kim <cogniti@gmail.com>
+ *
+ * Nimf is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nimf is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program;  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NIMF_RING_H__
+#define __NIMF_RING_H__
+
+#include <glib.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* A single-producer single-consumer byte ring in a memfd, shared between
+ * a client and nimf-daemon.  Only the indices live in shared memory; the
+ * capacity is taken from the size of the mapping, so a peer can not make
+ * the other side read or write out of bounds. */
+#define NIMF_RING_SIZE  (1 << 17)
+
+typedef struct _NimfRing NimfRing;
+
+NimfRing *nimf_ring_new            (guint32        size);
+NimfRing *nimf_ring_new_from_fd    (gint           fd);
+void      nimf_ring_free           (NimfRing      *ring);
+gint      nimf_ring_get_fd         (NimfRing      *ring);
+guint32   nimf_ring_get_size       (NimfRing      *ring);
+gboolean  nimf_ring_write          (NimfRing      *ring,
+                                    GOutputVector *vectors,
+                                    gint           n_vectors);
+gssize    nimf_ring_read           (NimfRing      *ring,
+                                    gchar         *buffer,
+                                    gsize          size);
+gboolean  nimf_ring_is_empty       (NimfRing      *ring);
+void      nimf_ring_set_waiting    (NimfRing      *ring,
+                                    gboolean       waiting);
+gboolean  nimf_ring_steal_waiting  (NimfRing      *ring);
+
+G_END_DECLS
+
+#endif /* __NIMF_RING_H__ */
@@ -21,6 +21,7 @@
 
 #include "config.h"
 #include "nimf-server.h"
+#include "nimf-trace.h"
 #include "nimf-private.h"
 #include "nimf-module.h"
 #include "nimf-key-syms.h"
@@ -29,6 +30,7 @@
 #include "nimf-context.h"
 #include <gio/gunixsocketaddress.h>
 #include "IMdkit/Xi18n.h"
+#include "IMdkit/XimFunc.h"
 #include <X11/XKBlib.h>
 
 enum
@@ -37,110 +39,225 @@ enum
   PROP_ADDRESS,
 };
 
+#define NIMF_HIBERNATION_INTERVAL  60 /* seconds */
+
 static gboolean
-on_incoming_message_nimf (GSocket        *socket,
-                          GIOCondition    condition,
-                          NimfConnection *connection)
+nimf_message_type_is_one_way (guint16 type)
+{
+  switch (type)
+  {
+    case NIMF_MESSAGE_FOCUS_IN:
+    case NIMF_MESSAGE_FOCUS_OUT:
+    case NIMF_MESSAGE_SET_SURROUNDING:
+    case NIMF_MESSAGE_SET_CURSOR_LOCATION:
+    case NIMF_MESSAGE_SET_USE_PREEDIT:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+void
+nimf_server_invoke (NimfServer     *server,
+                    NimfWorker     *worker,
+                    NimfTaskFunc    func,
+                    gpointer        data,
+                    GDestroyNotify  destroy)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
-  NimfMessage *message;
-  gboolean     retval;
-  nimf_message_unref (connection->result->reply);
-  connection->result->is_dispatched = TRUE;
+  GMainContext  *main_context;
+  NimfTaskQueue *tasks;
 
-  if (condition & (G_IO_HUP | G_IO_ERR))
+  if (worker)
   {
-    g_debug (G_STRLOC ": condition & (G_IO_HUP | G_IO_ERR)");
+    main_context = worker->main_context;
+    tasks        = worker->tasks;
+  }
+  else
+  {
+    main_context = server->main_context;
+    tasks        = server->tasks;
+  }
 
-    g_socket_close (socket, NULL);
+  if (tasks == NULL || g_main_context_is_owner (main_context))
+  {
+    func (data);
+
+    if (destroy)
+      destroy (data);
+  }
+  else
+  {
+    nimf_task_queue_push (tasks, func, data, destroy);
+  }
+}
 
-    GList *l;
-    for (l = connection->server->instances; l != NULL; l = l->next)
-      nimf_engine_reset (l->data, NULL);
+/* once changes have settled */
+static gboolean
+on_engine_changed_timeout (NimfServer *server)
+{
+  NIMF_TRACE ();
+
+  guint i;
 
-    connection->result->reply = NULL;
-    g_hash_table_remove (connection->server->connections,
-                         GUINT_TO_POINTER (nimf_connection_get_id (connection)));
+  g_source_unref (server->engine_changed_source);
+  server->engine_changed_source = NULL;
 
-    return G_SOURCE_REMOVE;
+  for (i = 0; i < server->agents->len; i++)
+  {
+    NimfContext *agent = g_ptr_array_index (server->agents, i);
+
+    if (g_strcmp0 (agent->agent_icon_name, server->pending_icon_name) == 0)
+      continue;
+
+    g_free (agent->agent_icon_name);
+    agent->agent_icon_name = g_strdup (server->pending_icon_name);
+
+    nimf_connection_send_message (agent->connection, agent->icid,
+                                  NIMF_MESSAGE_ENGINE_CHANGED,
+                                  server->pending_icon_name,
+                                  strlen (server->pending_icon_name) + 1);
   }
 
-  message = nimf_recv_message (socket);
-  connection->result->reply = message;
+  return G_SOURCE_REMOVE;
+}
 
-  if (G_UNLIKELY (message == NULL))
+/* Tells every agent that the engine is now @name, an icon name.  Changes
+ * within engine_changed_delay are coalesced into the last of them, which
+ * is not sent to agents that have it already. */
+void
+nimf_server_emit_engine_changed (NimfServer  *server,
+                                 const gchar *name)
+{
+  NIMF_TRACE ();
+
+  g_free (server->pending_icon_name);
+  server->pending_icon_name = g_strdup (name);
+
+  if (server->engine_changed_source == NULL)
   {
-    g_critical (G_STRLOC ": NULL message");
-    return G_SOURCE_CONTINUE;
+    server->engine_changed_source =
+      g_timeout_source_new (server->engine_changed_delay);
+    g_source_set_callback (server->engine_changed_source,
+                           (GSourceFunc) on_engine_changed_timeout, server,
+                           NULL);
+    g_source_attach (server->engine_changed_source, server->main_context);
+  }
+}
+
+/* Contexts switch to @engine_id when they are next focused or filter an
+ * event, see nimf_context_sync_engine(), instead of all of them at once;
+ * agents are told once. */
+static void
+nimf_server_set_engine_by_id (NimfServer  *server,
+                              const gchar *engine_id)
+{
+  NIMF_TRACE ();
+
+  gint        index = nimf_server_get_instance_index (server, engine_id);
+  NimfEngine *engine;
+
+  /* from a client or an agent, which may name an engine not loaded */
+  if (index < 0)
+  {
+    g_debug (G_STRLOC ": %s: unknown engine: %s", G_STRFUNC, engine_id);
+    return;
   }
 
+  server->selected_engine = index;
+  server->engine_epoch++;
+
+  engine = g_ptr_array_index (server->instances, index);
+  nimf_server_emit_engine_changed (server, nimf_engine_get_icon_name (engine));
+}
+
+/* in the main thread, which runs all engines */
+static void
+nimf_server_dispatch (NimfConnection *connection,
+                      NimfMessage    *message)
+{
+  NIMF_TRACE ();
+
+  GSocket     *socket = connection->socket;
+  gboolean     retval;
   NimfContext *context;
-  guint16      icid = message->header->icid;
+  guint16      icid = message->header.icid;
+  guint16      type = message->header.type;
+  guint32      seq  = message->header.seq;
 
-  context = g_hash_table_lookup (connection->contexts,
-                                 GUINT_TO_POINTER (icid));
+  NIMF_TRACE_MESSAGE (NIMF_TRACE_BEGIN, "dispatch", type, seq);
 
-  switch (message->header->type)
+  context = nimf_id_table_lookup (&connection->contexts, icid);
+
+  switch (message->header.type)
   {
     case NIMF_MESSAGE_CREATE_CONTEXT:
+      /* an icid reused without NIMF_MESSAGE_DESTROY_CONTEXT */
+      if (context)
+        nimf_context_free (nimf_id_table_remove (&connection->contexts, icid));
+
       context = nimf_context_new (*(NimfContextType *) message->data,
                                   connection, connection->server, NULL);
       context->icid = icid;
-      g_hash_table_insert (connection->contexts,
-                           GUINT_TO_POINTER (icid), context);
+      nimf_id_table_insert (&connection->contexts, icid, context);
 
       if (context->type == NIMF_CONTEXT_NIMF_AGENT)
-        g_hash_table_insert (connection->server->agents,
-                             GUINT_TO_POINTER (icid), context);
+        g_ptr_array_add (connection->server->agents, context);
 
-      nimf_send_message (socket, icid, NIMF_MESSAGE_CREATE_CONTEXT_REPLY,
-                         NULL, 0, NULL);
+      nimf_connection_send_reply (connection, icid,
+                                  NIMF_MESSAGE_CREATE_CONTEXT_REPLY, seq,
+                                  NULL, 0);
       break;
     case NIMF_MESSAGE_DESTROY_CONTEXT:
-      if (context && context->type == NIMF_CONTEXT_NIMF_AGENT)
-        g_hash_table_remove (connection->server->agents,
-                             GUINT_TO_POINTER (icid));
+      if (context)
+        nimf_context_free (nimf_id_table_remove (&connection->contexts, icid));
 
-      g_hash_table_remove (connection->contexts, GUINT_TO_POINTER (icid));
-      nimf_send_message (socket, icid, NIMF_MESSAGE_DESTROY_CONTEXT_REPLY,
-                         NULL, 0, NULL);
+      nimf_connection_send_reply (connection, icid,
+                                  NIMF_MESSAGE_DESTROY_CONTEXT_REPLY, seq,
+                                  NULL, 0);
       break;
     case NIMF_MESSAGE_FILTER_EVENT:
-      nimf_message_ref (message);
-      retval = nimf_context_filter_event (context, (NimfEvent *) message->data);
-      nimf_message_unref (message);
-      nimf_send_message (socket, icid, NIMF_MESSAGE_FILTER_EVENT_REPLY,
-                         &retval, sizeof (gboolean), NULL);
+      /* signals emitted by the engine go out with the reply */
+      nimf_connection_begin_compound (connection);
+
+      if (G_LIKELY (context))
+        retval = nimf_context_filter_event (context,
+                                            (NimfEvent *) message->data);
+      else
+        retval = FALSE;
+
+      nimf_connection_end_compound (connection, icid,
+                                    NIMF_MESSAGE_FILTER_EVENT_REPLY, seq,
+                                    retval);
       break;
     case NIMF_MESSAGE_RESET:
       nimf_context_reset (context);
-      nimf_send_message (socket, icid, NIMF_MESSAGE_RESET_REPLY,
-                         NULL, 0, NULL);
+      nimf_connection_send_reply (connection, icid, NIMF_MESSAGE_RESET_REPLY,
+                                  seq, NULL, 0);
       break;
     case NIMF_MESSAGE_FOCUS_IN:
+      /* one-way; signals emitted by the engine go out on their own */
+      nimf_connection_begin_compound (connection);
       nimf_context_focus_in (context);
-      nimf_send_message (socket, icid, NIMF_MESSAGE_FOCUS_IN_REPLY,
-                         NULL, 0, NULL);
+      nimf_connection_finish_compound (connection, icid);
       break;
     case NIMF_MESSAGE_FOCUS_OUT:
+      nimf_connection_begin_compound (connection);
       nimf_context_focus_out (context);
-      nimf_send_message (socket, icid, NIMF_MESSAGE_FOCUS_OUT_REPLY,
-                         NULL, 0, NULL);
+      nimf_connection_finish_compound (connection, icid);
       break;
     case NIMF_MESSAGE_SET_SURROUNDING:
       {
         nimf_message_ref (message);
         gchar   *data     = message->data;
-        guint16  data_len = message->header->data_len;
+        guint32  data_len = message->header.data_len;
 
         gint   str_len      = data_len - 1 - 2 * sizeof (gint);
         gint   cursor_index = *(gint *) (data + data_len - sizeof (gint));
 
         nimf_context_set_surrounding (context, data, str_len, cursor_index);
         nimf_message_unref (message);
-        nimf_send_message (socket, icid,
-                           NIMF_MESSAGE_SET_SURROUNDING_REPLY, NULL, 0, NULL);
       }
       break;
     case NIMF_MESSAGE_GET_SURROUNDING:
@@ -155,10 +272,10 @@ on_incoming_message_nimf (GSocket        *socket,
         *(gint *) (data + str_len + 1) = cursor_index;
         *(gboolean *) (data + str_len + 1 + sizeof (gint)) = retval;
 
-        nimf_send_message (socket, icid,
-                           NIMF_MESSAGE_GET_SURROUNDING_REPLY, data,
-                           str_len + 1 + sizeof (gint) + sizeof (gboolean),
-                           NULL);
+        nimf_connection_send_reply (connection, icid,
+                                    NIMF_MESSAGE_GET_SURROUNDING_REPLY, seq,
+                                    data, str_len + 1 + sizeof (gint) +
+                                          sizeof (gboolean));
         g_free (data);
       }
       break;
@@ -167,96 +284,250 @@ on_incoming_message_nimf (GSocket        *socket,
       nimf_context_set_cursor_location (context,
                                         (NimfRectangle *) message->data);
       nimf_message_unref (message);
-      nimf_send_message (socket, icid, NIMF_MESSAGE_SET_CURSOR_LOCATION_REPLY,
-                         NULL, 0, NULL);
       break;
     case NIMF_MESSAGE_SET_USE_PREEDIT:
       nimf_message_ref (message);
+      nimf_connection_begin_compound (connection);
       nimf_context_set_use_preedit (context, *(gboolean *) message->data);
+      nimf_connection_finish_compound (connection, icid);
       nimf_message_unref (message);
-      nimf_send_message (socket, icid, NIMF_MESSAGE_SET_USE_PREEDIT_REPLY,
-                         NULL, 0, NULL);
       break;
     case NIMF_MESSAGE_GET_LOADED_ENGINE_IDS:
       {
-        GString *string;
-        GList *list = g_list_first (connection->server->instances);
-        const gchar *id;
+        GString   *string;
+        GPtrArray *instances = connection->server->instances;
+        guint      i;
 
         string = g_string_new (NULL);
 
-        while (list)
+        for (i = 0; i < instances->len; i++)
         {
-          id = nimf_engine_get_id (list->data);
-          g_string_append (string, id);
-
-          if ((list = list->next) == NULL)
-            break;
           /* 0x1e is RS (record separator) */
-          g_string_append_c (string, 0x1e);
+          if (i > 0)
+            g_string_append_c (string, 0x1e);
+
+          g_string_append (string,
+                           nimf_engine_get_id (g_ptr_array_index (instances, i)));
         }
 
-        nimf_send_message (socket, icid,
-                           NIMF_MESSAGE_GET_LOADED_ENGINE_IDS_REPLY,
-                           string->str, string->len + 1, NULL);
+        nimf_connection_send_reply (connection, icid,
+                                    NIMF_MESSAGE_GET_LOADED_ENGINE_IDS_REPLY,
+                                    seq, string->str, string->len + 1);
         g_string_free (string, TRUE);
       }
       break;
     case NIMF_MESSAGE_SET_ENGINE_BY_ID:
-      {
-        nimf_message_ref (message);
+      nimf_message_ref (message);
+      nimf_server_set_engine_by_id (connection->server, message->data);
+      nimf_message_unref (message);
+      nimf_connection_send_reply (connection, icid,
+                                  NIMF_MESSAGE_SET_ENGINE_BY_ID_REPLY, seq,
+                                  NULL, 0);
+      break;
+    case NIMF_MESSAGE_PREEDIT_START_REPLY:
+    case NIMF_MESSAGE_PREEDIT_CHANGED_REPLY:
+    case NIMF_MESSAGE_PREEDIT_END_REPLY:
+    case NIMF_MESSAGE_COMMIT_REPLY:
+      break;
+    case NIMF_MESSAGE_RETRIEVE_SURROUNDING_REPLY:
+    case NIMF_MESSAGE_DELETE_SURROUNDING_REPLY:
+      nimf_connection_complete_reply (connection, seq,
+        message->header.data_len >= sizeof (gboolean) &&
+        *(gboolean *) message->data);
+      break;
+    default:
+      g_warning ("Unknown message type: %d", message->header.type);
+      break;
+  }
 
-        GHashTableIter iter;
-        gpointer       conn;
-        gpointer       ctx;
+  /* old clients wait for the reply of the request itself */
+  if (nimf_message_type_is_one_way (type) &&
+      !(nimf_socket_get_capabilities (socket) & NIMF_CAPABILITY_ONE_WAY))
+    nimf_connection_send_reply (connection, icid,
+                                nimf_socket_is_legacy (socket) ?
+                                  nimf_message_get_legacy_reply_type (type) :
+                                  NIMF_MESSAGE_ACK,
+                                seq, NULL, 0);
 
-        g_hash_table_iter_init (&iter, connection->server->connections);
+  NIMF_TRACE_MESSAGE (NIMF_TRACE_END, "dispatch", type, seq);
+}
 
-        while (g_hash_table_iter_next (&iter, NULL, &conn))
-          nimf_connection_set_engine_by_id (NIMF_CONNECTION (conn),
-                                            message->data);
+/* Negotiates the stream of @connection, which is kept by the thread that
+ * owns the socket. */
+static void
+nimf_server_dispatch_stream (NimfConnection *connection,
+                             NimfMessage    *message)
+{
+  NIMF_TRACE ();
 
-        g_hash_table_iter_init (&iter, connection->server->xim_contexts);
+  GSocket *socket = connection->socket;
+  guint16  icid   = message->header.icid;
+  guint32  seq    = message->header.seq;
 
-        while (g_hash_table_iter_next (&iter, NULL, &ctx))
-          if (((NimfContext *) ctx)->type != NIMF_CONTEXT_NIMF_AGENT)
-            nimf_context_set_engine_by_id (ctx, message->data);
+  NIMF_TRACE_MESSAGE (NIMF_TRACE_BEGIN, "dispatch", message->header.type, seq);
 
-        nimf_message_unref (message);
-        nimf_send_message (socket, icid,
-                           NIMF_MESSAGE_SET_ENGINE_BY_ID_REPLY, NULL, 0, NULL);
+  switch (message->header.type)
+  {
+    case NIMF_MESSAGE_HELLO:
+      {
+        NimfHello hello = {0};
+        guint32   capabilities = NIMF_CAPABILITY_COMPOUND |
+                                 NIMF_CAPABILITY_ONE_WAY  |
+                                 NIMF_CAPABILITY_LARGE_PAYLOAD;
+
+        if (connection->server->use_shm_transport)
+          capabilities |= NIMF_CAPABILITY_SHM;
+
+        if (message->header.data_len >= sizeof (NimfHello))
+          memcpy (&hello, message->data, sizeof (NimfHello));
+
+        capabilities &= GUINT32_FROM_LE (hello.capabilities);
+        hello.version      = GUINT32_TO_LE (NIMF_PROTOCOL_VERSION);
+        hello.capabilities = GUINT32_TO_LE (capabilities);
+
+        nimf_send_reply (socket, icid, NIMF_MESSAGE_HELLO_REPLY, seq,
+                         &hello, sizeof (NimfHello), NULL);
+        nimf_socket_set_capabilities (socket, capabilities);
       }
       break;
-    case NIMF_MESSAGE_PREEDIT_START_REPLY:
-    case NIMF_MESSAGE_PREEDIT_CHANGED_REPLY:
-    case NIMF_MESSAGE_PREEDIT_END_REPLY:
-    case NIMF_MESSAGE_COMMIT_REPLY:
-    case NIMF_MESSAGE_RETRIEVE_SURROUNDING_REPLY:
-    case NIMF_MESSAGE_DELETE_SURROUNDING_REPLY:
+    case NIMF_MESSAGE_SHM_ATTACH:
+      nimf_shm_accept (socket, icid, seq,
+                       connection->server->use_shm_transport);
       break;
     default:
-      g_warning ("Unknown message type: %d", message->header->type);
+      g_assert_not_reached ();
       break;
   }
 
-  return G_SOURCE_CONTINUE;
+  NIMF_TRACE_MESSAGE (NIMF_TRACE_END, "dispatch", message->header.type, seq);
+}
+
+/* Shared engines @connection used are reset, as others may be composing
+ * for other clients; otherwise engines go with its contexts. */
+static void
+nimf_server_close_connection (NimfConnection *connection)
+{
+  NIMF_TRACE ();
+
+  NimfServer *server = connection->server;
+
+  if (connection->engines)
+  {
+    guint i;
+    for (i = 0; i < connection->engines->len; i++)
+      nimf_engine_reset (g_ptr_array_index (connection->engines, i), NULL);
+  }
+
+  nimf_connection_close (connection);
+  nimf_id_table_remove (&server->connections,
+                        nimf_connection_get_id (connection));
+  g_object_unref (connection);
+}
+
+typedef struct
+{
+  NimfConnection *connection;
+  NimfMessage    *message; /* NULL if the client has gone */
+} NimfDispatchTask;
+
+static void
+nimf_dispatch_task_run (NimfDispatchTask *task)
+{
+  NIMF_TRACE ();
+
+  NimfConnection *connection = task->connection;
+
+  /* for a blocking emission waiting for the reply */
+  nimf_message_unref (connection->result->reply);
+  connection->result->is_dispatched = TRUE;
+  connection->result->reply = task->message ?
+                                nimf_message_ref (task->message) : NULL;
+
+  if (task->message)
+    nimf_server_dispatch (connection, task->message);
+  else
+    nimf_server_close_connection (connection);
+}
+
+static void
+nimf_dispatch_task_free (NimfDispatchTask *task)
+{
+  g_object_unref (task->connection);
+
+  if (task->message)
+    nimf_message_unref (task->message);
+
+  g_slice_free (NimfDispatchTask, task);
+}
+
+/* In the thread which owns @connection, the main one or a worker.  The
+ * message is dispatched in the main thread, as engine libraries keep
+ * global state and GTK, used by the candidate window, is not
+ * thread-safe. */
+static gboolean
+on_incoming_message_nimf (GSocket        *socket,
+                          GIOCondition    condition,
+                          NimfConnection *connection)
+{
+  NIMF_TRACE ();
+
+  NimfDispatchTask *task;
+  NimfMessage      *message;
+
+  if (condition & (G_IO_HUP | G_IO_ERR))
+    message = NULL;
+  else
+    message = nimf_recv_message (socket);
+
+  /* a message which can not be read ends the connection too */
+  if (G_UNLIKELY (message == NULL))
+  {
+    g_debug (G_STRLOC ": condition & (G_IO_HUP | G_IO_ERR)");
+    g_socket_close (socket, NULL);
+    /* before the main thread may drop the last reference */
+    nimf_socket_set_remove (connection->source, socket);
+  }
+  else if (message->header.type == NIMF_MESSAGE_HELLO ||
+           message->header.type == NIMF_MESSAGE_SHM_ATTACH)
+  {
+    nimf_server_dispatch_stream (connection, message);
+    nimf_message_unref (message);
+
+    return G_SOURCE_CONTINUE;
+  }
+
+  task = g_slice_new (NimfDispatchTask);
+  task->connection = g_object_ref (connection);
+  task->message    = message;
+  nimf_server_invoke (connection->server, NULL,
+                      (NimfTaskFunc) nimf_dispatch_task_run, task,
+                      (GDestroyNotify) nimf_dispatch_task_free);
+
+  return message ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+/* in the thread which owns @connection */
+static void
+nimf_server_watch_connection (NimfConnection *connection)
+{
+  NIMF_TRACE ();
+
+  nimf_socket_set_add (connection->source, connection->socket,
+                       (GSocketSourceFunc) on_incoming_message_nimf,
+                       connection);
 }
 
 static guint16
 nimf_server_add_connection (NimfServer     *server,
                             NimfConnection *connection)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   guint16 id;
 
-  do
-    id = server->next_id++;
-  while (id == 0 || g_hash_table_contains (server->connections,
-                                           GUINT_TO_POINTER (id)));
+  id = nimf_id_table_add (&server->connections, connection);
   connection->id = id;
   connection->server = server;
-  g_hash_table_insert (server->connections, GUINT_TO_POINTER (id), connection);
 
   return id;
 }
@@ -265,16 +536,12 @@ static guint16
 nimf_server_add_xim_context (NimfServer  *server,
                              NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   guint16 icid;
 
-  do
-    icid = server->next_icid++;
-  while (icid == 0 || g_hash_table_contains (server->xim_contexts,
-                                             GUINT_TO_POINTER (icid)));
+  icid = nimf_id_table_add (&server->xim_contexts, context);
   context->icid = icid;
-  g_hash_table_insert (server->xim_contexts, GUINT_TO_POINTER (icid), context);
 
   return icid;
 }
@@ -285,20 +552,40 @@ on_new_connection (GSocketService    *service,
                    GObject           *source_object,
                    NimfServer        *server)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfConnection *connection;
+  GSource        *sockets = server->sockets;
+  guint16         id;
+
   connection = nimf_connection_new ();
   connection->socket = g_socket_connection_get_socket (socket_connection);
-  nimf_server_add_connection (server, connection);
-
-  connection->source = g_socket_create_source (connection->socket, G_IO_IN, NULL);
   connection->socket_connection = g_object_ref (socket_connection);
-  g_source_set_can_recurse (connection->source, TRUE);
-  g_source_set_callback (connection->source,
-                         (GSourceFunc) on_incoming_message_nimf,
-                         connection, NULL);
-  g_source_attach (connection->source, server->main_context);
+  nimf_socket_enable_write_queue (connection->socket);
+  nimf_socket_allow_legacy (connection->socket);
+
+  if (server->n_workers > 0)
+  {
+    guint i = server->next_worker++ % server->n_workers;
+
+    connection->worker = server->workers[i];
+    sockets = server->worker_sockets[i];
+  }
+
+  id = nimf_server_add_connection (server, connection);
+
+  if (G_UNLIKELY (id == 0))
+  {
+    g_warning (G_STRLOC ": %s: too many connections", G_STRFUNC);
+    g_object_unref (connection);
+
+    return TRUE;
+  }
+
+  connection->source = g_source_ref (sockets);
+  nimf_server_invoke (server, connection->worker,
+                      (NimfTaskFunc) nimf_server_watch_connection,
+                      g_object_ref (connection), g_object_unref);
 
   return TRUE;
 }
@@ -308,7 +595,7 @@ nimf_server_initable_init (GInitable     *initable,
                            GCancellable  *cancellable,
                            GError       **error)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfServer     *server = NIMF_SERVER (initable);
   GSocketAddress *address;
@@ -356,66 +643,140 @@ G_DEFINE_TYPE_WITH_CODE (NimfServer, nimf_server, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE,
                                                 nimf_server_initable_iface_init));
 
-static gint
-on_comparing_engine_with_id (NimfEngine *engine, const gchar *id)
+/* The index of @engine_id in server->instances, or -1; ids of loaded
+ * engines are interned, so others are not even hashed. */
+gint
+nimf_server_get_instance_index (NimfServer  *server,
+                                const gchar *engine_id)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
+
+  GQuark quark = g_quark_try_string (engine_id);
+
+  if (quark == 0)
+    return -1;
 
-  return g_strcmp0 (nimf_engine_get_id (engine), id);
+  return GPOINTER_TO_INT (g_hash_table_lookup (server->instance_indices,
+                                               GUINT_TO_POINTER (quark))) - 1;
 }
 
 NimfEngine *
 nimf_server_get_instance (NimfServer  *server,
                           const gchar *id)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
-  GList *list;
+  gint index = nimf_server_get_instance_index (server, id);
 
-  list = g_list_find_custom (g_list_first (server->instances), id,
-                             (GCompareFunc) on_comparing_engine_with_id);
-  if (list)
-    return list->data;
+  if (index < 0)
+    return NULL;
 
-  return NULL;
+  return g_ptr_array_index (server->instances, index);
 }
 
 NimfEngine *
 nimf_server_get_next_instance (NimfServer *server, NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
+
+  gint index = nimf_server_get_instance_index (server,
+                                               nimf_engine_get_id (engine));
+
+  return g_ptr_array_index (server->instances,
+                            (index + 1) % server->instances->len);
+}
+
+/* Keeps @engine, which a context has given up, for another context,
+ * unless engine_pool_size of its type are kept already. */
+void
+nimf_server_pool_engine (NimfServer *server,
+                         NimfEngine *engine)
+{
+  NIMF_TRACE ();
+
+  gpointer  type = GSIZE_TO_POINTER (G_OBJECT_TYPE (engine));
+  GSList   *pool;
 
-  GList *list;
+  pool = g_hash_table_lookup (server->engine_pool, type);
 
-  server->instances = g_list_first (server->instances);
-  server->instances = g_list_find  (server->instances, engine);
+  if (g_slist_length (pool) < server->engine_pool_size)
+    g_hash_table_insert (server->engine_pool, type,
+                         g_slist_prepend (pool, engine));
+  else
+    g_object_unref (engine);
+}
 
-  list = g_list_next (server->instances);
+NimfEngine *
+nimf_server_take_pooled_engine (NimfServer *server,
+                                GType       type)
+{
+  NIMF_TRACE ();
 
-  if (list == NULL)
-    list = g_list_first (server->instances);
+  NimfEngine *engine = NULL;
+  GSList     *pool;
 
-  if (list)
+  pool = g_hash_table_lookup (server->engine_pool, GSIZE_TO_POINTER (type));
+
+  if (pool)
   {
-    server->instances = list;
-    return list->data;
+    engine = pool->data;
+    g_hash_table_insert (server->engine_pool, GSIZE_TO_POINTER (type),
+                         g_slist_delete_link (pool, pool));
   }
 
-  g_assert (list != NULL);
-
   return engine;
 }
 
+/* contexts unfocused for longer than hibernation_delay give their engines
+ * back to the pool, unless they are still composing */
+static void
+nimf_server_hibernate_if_idle (NimfContext *context,
+                               gint64       now)
+{
+  NimfServer *server = context->server;
+
+  if (context->unfocused_since > 0 &&
+      context->preedit_string[0] == 0 &&
+      now - context->unfocused_since >
+        (gint64) server->hibernation_delay * G_USEC_PER_SEC)
+    nimf_context_hibernate (context);
+}
+
+static gboolean
+on_hibernation_timeout (NimfServer *server)
+{
+  NIMF_TRACE ();
+
+  NimfConnection *connection;
+  NimfContext    *context;
+  gint64          now = g_get_monotonic_time ();
+  guint           id;
+  guint           icid;
+
+  /* engines shared by all contexts are not theirs to give up */
+  if (server->use_singleton)
+    return G_SOURCE_CONTINUE;
+
+  for (id = 0; (connection = nimf_id_table_next (&server->connections, &id)); )
+    for (icid = 0; (context = nimf_id_table_next (&connection->contexts, &icid)); )
+      nimf_server_hibernate_if_idle (context, now);
+
+  for (id = 0; (context = nimf_id_table_next (&server->xim_contexts, &id)); )
+    nimf_server_hibernate_if_idle (context, now);
+
+  return G_SOURCE_CONTINUE;
+}
+
 NimfEngine *
 nimf_server_get_default_engine (NimfServer *server)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GSettings  *settings;
   gchar      *engine_id;
   NimfEngine *engine;
 
-  settings  = g_settings_new ("org.nimf.engines");
+  settings  = server->engines_settings;
   engine_id = g_settings_get_string (settings, "default-engine");
   engine    = nimf_server_get_instance (server, engine_id);
 
@@ -428,37 +789,70 @@ nimf_server_get_default_engine (NimfServer *server)
   }
 
   g_free (engine_id);
-  g_object_unref (settings);
 
   return engine;
 }
 
 static void
-on_changed_trigger_keys (GSettings  *settings,
-                         gchar      *key,
-                         NimfServer *server)
+nimf_key_action_free (NimfKeyAction *action)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  g_free (action->engine_id);
+  g_slice_free (NimfKeyAction, action);
+}
+
+static void
+nimf_server_add_keys (NimfServer        *server,
+                      GSettings         *settings,
+                      const gchar       *key,
+                      NimfKeyActionType  type,
+                      const gchar       *engine_id)
+{
+  NimfKeyAction  *action;
+  NimfKey       **keys;
+  gchar         **strv;
+
+  action = g_slice_new (NimfKeyAction);
+  action->type      = type;
+  action->engine_id = g_strdup (engine_id);
+
+  strv = g_settings_get_strv (settings, key);
+  keys = nimf_key_newv ((const gchar **) strv);
+  nimf_key_table_add (&server->keys, (const NimfKey **) keys, action);
+  nimf_key_freev (keys);
+  g_strfreev (strv);
+}
+
+/* Rebuilds the key table; trigger keys go first, so that they win over
+ * hotkeys bound to the same keys. */
+static void
+nimf_server_update_keys (NimfServer *server)
+{
+  NIMF_TRACE ();
 
   GHashTableIter iter;
   gpointer       engine_id;
   gpointer       gsettings;
 
-  g_hash_table_remove_all (server->trigger_keys);
+  nimf_key_table_remove_all (&server->keys);
 
   g_hash_table_iter_init (&iter, server->trigger_gsettings);
 
   while (g_hash_table_iter_next (&iter, &engine_id, &gsettings))
-  {
-    NimfKey **trigger_keys;
-    gchar   **strv;
-
-    strv = g_settings_get_strv (gsettings, "trigger-keys");
-    trigger_keys = nimf_key_newv ((const gchar **) strv);
-    g_hash_table_insert (server->trigger_keys,
-                         trigger_keys, g_strdup (engine_id));
-    g_strfreev (strv);
-  }
+    nimf_server_add_keys (server, gsettings, "trigger-keys",
+                          NIMF_KEY_ACTION_TRIGGER, engine_id);
+
+  nimf_server_add_keys (server, server->settings, "hotkeys",
+                        NIMF_KEY_ACTION_ROTATE, NULL);
+}
+
+static void
+on_changed_trigger_keys (GSettings  *settings,
+                         gchar      *key,
+                         NimfServer *server)
+{
+  NIMF_TRACE ();
+
+  nimf_server_update_keys (server);
 }
 
 static void
@@ -466,14 +860,9 @@ on_changed_hotkeys (GSettings  *settings,
                     gchar      *key,
                     NimfServer *server)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
-  gchar **keys = g_settings_get_strv (settings, key);
-
-  nimf_key_freev (server->hotkeys);
-  server->hotkeys = nimf_key_newv ((const gchar **) keys);
-
-  g_strfreev (keys);
+  nimf_server_update_keys (server);
 }
 
 static void
@@ -481,28 +870,69 @@ on_changed_disable_fallback_filter_for_xim (GSettings  *settings,
                                             gchar      *key,
                                             NimfServer *server)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   server->disable_fallback_filter_for_xim =
     g_settings_get_boolean (server->settings,
                             "disable-fallback-filter-for-xim");
 }
 
+static void
+on_changed_engine_changed_delay (GSettings  *settings,
+                                 gchar      *key,
+                                 NimfServer *server)
+{
+  NIMF_TRACE ();
+
+  server->engine_changed_delay = g_settings_get_uint (settings, key);
+}
+
+static void
+on_changed_hibernation_delay (GSettings  *settings,
+                              gchar      *key,
+                              NimfServer *server)
+{
+  NIMF_TRACE ();
+
+  server->hibernation_delay = g_settings_get_uint (settings, key);
+}
+
+static void
+on_changed_engine_pool_size (GSettings  *settings,
+                             gchar      *key,
+                             NimfServer *server)
+{
+  NIMF_TRACE ();
+
+  server->engine_pool_size = g_settings_get_uint (settings, key);
+}
+
 static void
 on_use_singleton (GSettings  *settings,
                   gchar      *key,
                   NimfServer *server)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   server->use_singleton = g_settings_get_boolean (server->settings,
                                                   "use-singleton");
 }
 
+static void
+on_use_shm_transport (GSettings  *settings,
+                      gchar      *key,
+                      NimfServer *server)
+{
+  NIMF_TRACE ();
+
+  server->use_shm_transport = g_settings_get_boolean (server->settings,
+                                                      "use-shm-transport");
+}
+
 static void
 nimf_server_load_engines (NimfServer *server)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GSettingsSchemaSource  *source; /* do not free */
   gchar                 **schema_ids;
@@ -531,6 +961,7 @@ nimf_server_load_engines (NimfServer *server)
       {
         NimfModule *module;
         NimfEngine *engine;
+        GQuark      quark;
         gchar      *path;
 
         path = g_module_build_path (NIMF_MODULE_DIR, engine_id);
@@ -550,23 +981,18 @@ nimf_server_load_engines (NimfServer *server)
 
         g_hash_table_insert (server->modules, g_strdup (path), module);
         engine = g_object_new (module->type, "server", server, NULL);
-        server->instances = g_list_prepend (server->instances, engine);
+        g_ptr_array_add (server->instances, engine);
+        quark = g_quark_from_string (nimf_engine_get_id (engine));
+        g_hash_table_insert (server->instance_indices, GUINT_TO_POINTER (quark),
+                             GUINT_TO_POINTER (server->instances->len));
         g_type_module_unuse (G_TYPE_MODULE (module));
 
         if (g_settings_schema_has_key (schema, "trigger-keys"))
         {
-          NimfKey **trigger_keys;
-          gchar   **strv;
-
-          strv = g_settings_get_strv (settings, "trigger-keys");
-          trigger_keys = nimf_key_newv ((const gchar **) strv);
-          g_hash_table_insert (server->trigger_keys,
-                               trigger_keys, g_strdup (engine_id));
           g_hash_table_insert (server->trigger_gsettings,
                                g_strdup (engine_id), settings);
           g_signal_connect (settings, "changed::trigger-keys",
                             G_CALLBACK (on_changed_trigger_keys), server);
-          g_strfreev (strv);
         }
 
         g_free (path);
@@ -582,22 +1008,26 @@ nimf_server_load_engines (NimfServer *server)
 static void
 nimf_server_init (NimfServer *server)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   server->settings = g_settings_new ("org.nimf");
+  server->engines_settings = g_settings_new ("org.nimf.engines");
   server->disable_fallback_filter_for_xim =
     g_settings_get_boolean (server->settings,
                             "disable-fallback-filter-for-xim");
   server->use_singleton = g_settings_get_boolean (server->settings,
                                                   "use-singleton");
+  server->use_shm_transport = g_settings_get_boolean (server->settings,
+                                                      "use-shm-transport");
+  server->engine_changed_delay =
+    g_settings_get_uint (server->settings, "hidden-engine-changed-delay");
+  server->hibernation_delay =
+    g_settings_get_uint (server->settings, "hidden-hibernation-delay");
+  server->engine_pool_size =
+    g_settings_get_uint (server->settings, "hidden-engine-pool-size");
   server->trigger_gsettings = g_hash_table_new_full (g_str_hash, g_str_equal,
                                                      g_free, g_object_unref);
-  server->trigger_keys = g_hash_table_new_full (g_direct_hash, g_direct_equal,
-                                                (GDestroyNotify) nimf_key_freev,
-                                                g_free);
-  gchar **hotkeys = g_settings_get_strv (server->settings, "hotkeys");
-  server->hotkeys = nimf_key_newv ((const gchar **) hotkeys);
-  g_strfreev (hotkeys);
+  nimf_key_table_init (&server->keys, (GDestroyNotify) nimf_key_action_free);
 
   g_signal_connect (server->settings, "changed::hotkeys",
                     G_CALLBACK (on_changed_hotkeys), server);
@@ -607,28 +1037,83 @@ nimf_server_init (NimfServer *server)
                     server);
   g_signal_connect (server->settings, "changed::use-singleton",
                     G_CALLBACK (on_use_singleton), server);
+  g_signal_connect (server->settings, "changed::use-shm-transport",
+                    G_CALLBACK (on_use_shm_transport), server);
+  g_signal_connect (server->settings, "changed::hidden-engine-changed-delay",
+                    G_CALLBACK (on_changed_engine_changed_delay), server);
+  g_signal_connect (server->settings, "changed::hidden-hibernation-delay",
+                    G_CALLBACK (on_changed_hibernation_delay), server);
+  g_signal_connect (server->settings, "changed::hidden-engine-pool-size",
+                    G_CALLBACK (on_changed_engine_pool_size), server);
 
   server->candidate = nimf_candidate_new ();
 
   server->modules = g_hash_table_new_full (g_str_hash, g_str_equal,
                                            g_free, NULL);
+  server->engine_pool = g_hash_table_new (g_direct_hash, g_direct_equal);
+  server->instances = g_ptr_array_new_with_free_func (g_object_unref);
+  server->instance_indices = g_hash_table_new (g_direct_hash, g_direct_equal);
   nimf_server_load_engines (server);
+  nimf_server_update_keys (server);
   server->main_context = g_main_context_ref_thread_default ();
-  server->connections = g_hash_table_new_full (g_direct_hash,
-                                               g_direct_equal,
-                                               NULL,
-                                               (GDestroyNotify) g_object_unref);
-  server->xim_contexts = g_hash_table_new_full (g_direct_hash,
-                                                g_direct_equal,
-                                                NULL,
-                                                (GDestroyNotify) nimf_context_free);
-  server->agents = g_hash_table_new (g_direct_hash, g_direct_equal);
+  server->tasks = nimf_task_queue_new (server->main_context);
+  /* dispatches messages read by workers, which a blocking emission waits
+   * for, like server->sockets below */
+  g_source_set_can_recurse ((GSource *) server->tasks, TRUE);
+  nimf_id_table_init (&server->connections);
+  nimf_id_table_init (&server->xim_contexts);
+  server->agents = g_ptr_array_new ();
+  server->sockets = nimf_socket_set_new ();
+  /* only for the blocking nimf_context_emit_retrieve_surrounding() and
+   * nimf_context_emit_delete_surrounding(), which wait for a reply */
+  g_source_set_can_recurse (server->sockets, TRUE);
+  g_source_attach (server->sockets, server->main_context);
+  server->hibernation_source =
+    g_timeout_source_new_seconds (NIMF_HIBERNATION_INTERVAL);
+  g_source_set_callback (server->hibernation_source,
+                         (GSourceFunc) on_hibernation_timeout, server, NULL);
+  g_source_attach (server->hibernation_source, server->main_context);
+}
+
+/* Connections are assigned to @n_workers threads in turn, each of which
+ * reads, frames and writes the messages of its connections.  Contexts and
+ * engines stay in the main thread, which dispatches the messages, as do
+ * XIM and the candidate window.  Call this before nimf_server_start(). */
+void
+nimf_server_set_n_workers (NimfServer *server,
+                           guint       n_workers)
+{
+  NIMF_TRACE ();
+
+  guint i;
+
+  g_return_if_fail (NIMF_IS_SERVER (server));
+  g_return_if_fail (!server->active && server->n_workers == 0);
+
+  if (n_workers == 0)
+    return;
+
+  server->workers = g_new (NimfWorker *, n_workers);
+  server->worker_sockets = g_new (GSource *, n_workers);
+
+  for (i = 0; i < n_workers; i++)
+  {
+    gchar *name = g_strdup_printf ("nimf-worker-%u", i);
+    server->workers[i] = nimf_worker_new (name);
+    g_free (name);
+
+    server->worker_sockets[i] = nimf_socket_set_new ();
+    g_source_attach (server->worker_sockets[i],
+                     server->workers[i]->main_context);
+  }
+
+  server->n_workers = n_workers;
 }
 
 void
 nimf_server_stop (NimfServer *server)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_SERVER (server));
 
@@ -648,9 +1133,38 @@ nimf_server_stop (NimfServer *server)
 static void
 nimf_server_finalize (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
-  NimfServer *server = NIMF_SERVER (object);
+  NimfServer     *server = NIMF_SERVER (object);
+  NimfConnection *connection;
+  NimfContext    *context;
+  GHashTableIter  iter;
+  gpointer        pool;
+  guint           id;
+  guint           i;
+
+  g_source_destroy (server->hibernation_source);
+  g_source_unref   (server->hibernation_source);
+
+  if (server->engine_changed_source)
+  {
+    g_source_destroy (server->engine_changed_source);
+    g_source_unref   (server->engine_changed_source);
+  }
+
+  g_free (server->pending_icon_name);
+
+  /* before the workers stop, which send what engines emit meanwhile */
+  for (id = 0; (connection = nimf_id_table_next (&server->connections, &id)); )
+    nimf_connection_close (connection);
+
+  /* stopped here, so that nothing runs in them while the rest goes */
+  for (i = 0; i < server->n_workers; i++)
+    nimf_worker_free (server->workers[i]);
+
+  g_free (server->workers);
+
+  nimf_task_queue_free (server->tasks);
 
   if (server->run_signal_handler_id > 0)
     g_signal_handler_disconnect (server->listener, server->run_signal_handler_id);
@@ -660,26 +1174,50 @@ nimf_server_finalize (GObject *object)
 
   g_hash_table_unref (server->modules);
 
-  if (server->instances)
+  for (id = 0; (connection = nimf_id_table_next (&server->connections, &id)); )
+    g_object_unref (connection);
+
+  for (id = 0; (context = nimf_id_table_next (&server->xim_contexts, &id)); )
+    nimf_context_free (context);
+
+  nimf_id_table_clear (&server->connections);
+  nimf_id_table_clear (&server->xim_contexts);
+  g_ptr_array_unref (server->agents);
+
+  /* after the contexts, which give their engines to it */
+  g_hash_table_iter_init (&iter, server->engine_pool);
+
+  while (g_hash_table_iter_next (&iter, NULL, &pool))
+    g_slist_free_full (pool, g_object_unref);
+
+  g_hash_table_unref (server->engine_pool);
+  /* after the contexts, which index their engines by them */
+  g_ptr_array_unref (server->instances);
+  g_hash_table_unref (server->instance_indices);
+  g_object_unref (server->candidate);
+
+  /* after the connections, which are watched by them */
+  for (i = 0; i < server->n_workers; i++)
   {
-    g_list_free_full (server->instances, g_object_unref);
-    server->instances = NULL;
+    g_source_destroy (server->worker_sockets[i]);
+    g_source_unref   (server->worker_sockets[i]);
   }
 
-  g_object_unref (server->candidate);
-  g_hash_table_unref (server->connections);
-  g_hash_table_unref (server->xim_contexts);
-  g_hash_table_unref (server->agents);
+  g_free (server->worker_sockets);
+  g_source_destroy (server->sockets);
+  g_source_unref   (server->sockets);
+
   g_object_unref (server->settings);
+  g_object_unref (server->engines_settings);
   g_hash_table_unref (server->trigger_gsettings);
-  g_hash_table_unref (server->trigger_keys);
-  nimf_key_freev (server->hotkeys);
+  nimf_key_table_clear (&server->keys);
   g_free (server->address);
 
   if (server->xevent_source)
   {
     g_source_destroy (server->xevent_source);
     g_source_unref   (server->xevent_source);
+    g_hash_table_unref (server->xim_windows);
   }
 
   g_main_context_unref (server->main_context);
@@ -728,7 +1266,7 @@ nimf_server_set_property (GObject      *object,
 static void
 nimf_server_class_init (NimfServerClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GObjectClass *object_class = G_OBJECT_CLASS (class);
 
@@ -754,7 +1292,7 @@ NimfServer *
 nimf_server_new (const gchar  *address,
                  GError      **error)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (address != NULL, NULL);
   g_return_val_if_fail (error == NULL || *error == NULL, NULL);
@@ -765,15 +1303,16 @@ nimf_server_new (const gchar  *address,
 
 typedef struct
 {
-  GSource  source;
-  Display *display;
-  GPollFD  poll_fd;
+  GSource     source;
+  Display    *display;
+  GPollFD     poll_fd;
+  NimfServer *server;
 } NimfXEventSource;
 
 static gboolean nimf_xevent_source_prepare (GSource *source,
                                             gint    *timeout)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   Display *display = ((NimfXEventSource *) source)->display;
   *timeout = -1;
@@ -782,7 +1321,7 @@ static gboolean nimf_xevent_source_prepare (GSource *source,
 
 static gboolean nimf_xevent_source_check (GSource *source)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfXEventSource *display_source = (NimfXEventSource *) source;
 
@@ -796,11 +1335,10 @@ int nimf_server_xim_set_ic_values (NimfServer       *server,
                                    XIMS              xims,
                                    IMChangeICStruct *data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfContext *context;
-  context = g_hash_table_lookup (server->xim_contexts,
-                                 GUINT_TO_POINTER (data->icid));
+  context = nimf_id_table_lookup (&server->xim_contexts, data->icid);
   CARD16 i;
 
   for (i = 0; i < data->ic_attr_num; i++)
@@ -856,15 +1394,19 @@ int nimf_server_xim_create_ic (NimfServer       *server,
   g_debug (G_STRLOC ": %s, data->connect_id: %d", G_STRFUNC, data->connect_id);
 
   NimfContext *context;
-  context = g_hash_table_lookup (server->xim_contexts,
-                                 GUINT_TO_POINTER (data->icid));
+  context = nimf_id_table_lookup (&server->xim_contexts, data->icid);
 
   if (!context)
   {
+    Xi18nClient *client;
+
+    client  = _Xi18nFindClient (xims->protocol, data->connect_id);
     context = nimf_context_new (NIMF_CONTEXT_XIM, NULL, server, xims);
-    context->xim_connect_id = data->connect_id;
+    context->xim_connect_id  = data->connect_id;
+    context->xim_utf8_string = client && client->use_utf8_string;
     data->icid = nimf_server_add_xim_context (server, context);
-    g_debug (G_STRLOC ": icid = %d", data->icid);
+    g_debug (G_STRLOC ": icid = %d, encoding: %s", data->icid,
+             context->xim_utf8_string ? "UTF8_STRING" : "COMPOUND_TEXT");
   }
 
   nimf_server_xim_set_ic_values (server, xims, data);
@@ -878,19 +1420,25 @@ int nimf_server_xim_destroy_ic (NimfServer        *server,
 {
   g_debug (G_STRLOC ": %s, data->icid = %d", G_STRFUNC, data->icid);
 
-  return g_hash_table_remove (server->xim_contexts,
-                              GUINT_TO_POINTER (data->icid));
+  NimfContext *context;
+  context = nimf_id_table_remove (&server->xim_contexts, data->icid);
+
+  if (context == NULL)
+    return 0;
+
+  nimf_context_free (context);
+
+  return 1;
 }
 
 int nimf_server_xim_get_ic_values (NimfServer       *server,
                                    XIMS              xims,
                                    IMChangeICStruct *data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfContext *context;
-  context = g_hash_table_lookup (server->xim_contexts,
-                                 GUINT_TO_POINTER (data->icid));
+  context = nimf_id_table_lookup (&server->xim_contexts, data->icid);
   CARD16 i;
 
   for (i = 0; i < data->ic_attr_num; i++)
@@ -941,8 +1489,7 @@ int nimf_server_xim_set_ic_focus (NimfServer          *server,
                                   IMChangeFocusStruct *data)
 {
   NimfContext *context;
-  context = g_hash_table_lookup (server->xim_contexts,
-                                 GUINT_TO_POINTER (data->icid));
+  context = nimf_id_table_lookup (&server->xim_contexts, data->icid);
 
   g_debug (G_STRLOC ": %s, icid = %d, connection id = %d",
            G_STRFUNC, data->icid, context->icid);
@@ -957,8 +1504,7 @@ int nimf_server_xim_unset_ic_focus (NimfServer          *server,
                                     IMChangeFocusStruct *data)
 {
   NimfContext *context;
-  context = g_hash_table_lookup (server->xim_contexts,
-                                 GUINT_TO_POINTER (data->icid));
+  context = nimf_id_table_lookup (&server->xim_contexts, data->icid);
 
   g_debug (G_STRLOC ": %s, icid = %d", G_STRFUNC, data->icid);
 
@@ -971,7 +1517,7 @@ int nimf_server_xim_forward_event (NimfServer           *server,
                                    XIMS                  xims,
                                    IMForwardEventStruct *data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   XKeyEvent        *xevent;
   NimfEvent        *event;
@@ -1003,8 +1549,7 @@ int nimf_server_xim_forward_event (NimfServer           *server,
   event->key.state |= (NimfModifierType) state;
 
   NimfContext *context;
-  context = g_hash_table_lookup (server->xim_contexts,
-                                 GUINT_TO_POINTER (data->icid));
+  context = nimf_id_table_lookup (&server->xim_contexts, data->icid);
   retval = nimf_context_filter_event (context, event);
   nimf_event_free (event);
 
@@ -1041,11 +1586,10 @@ int nimf_server_xim_reset_ic (NimfServer      *server,
                               XIMS             xims,
                               IMResetICStruct *data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfContext *context;
-  context = g_hash_table_lookup (server->xim_contexts,
-                                 GUINT_TO_POINTER (data->icid));
+  context = nimf_id_table_lookup (&server->xim_contexts, data->icid);
   nimf_context_reset (context);
 
   return 1;
@@ -1056,7 +1600,7 @@ on_incoming_message_xim (XIMS        xims,
                          IMProtocol *data,
                          NimfServer *server)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (xims != NULL, True);
   g_return_val_if_fail (data != NULL, True);
@@ -1117,28 +1661,180 @@ on_incoming_message_xim (XIMS        xims,
   return retval;
 }
 
+/* Where a window of an XIM context, or one of its ancestors, is in its
+ * parent.  It is kept current from the StructureNotify events selected on
+ * the window, so that cursor locations are translated without asking the
+ * X server. */
+typedef struct
+{
+  Window root;
+  Window parent;
+  gint   x, y; /* of the outer corner */
+  gint   border_width;
+} NimfXimWindow;
+
+static NimfXimWindow *
+nimf_server_xim_watch_window (NimfServer *server,
+                              Display    *display,
+                              Window      window)
+{
+  NIMF_TRACE ();
+
+  NimfXimWindow *xim_window;
+  Window         root, parent, *children;
+  unsigned int   n_children, width, height, border_width, depth;
+  int            x, y;
+
+  /* before asking, so that no change afterwards is missed */
+  XSelectInput (display, window, StructureNotifyMask);
+
+  if (!XQueryTree (display, window, &root, &parent, &children, &n_children))
+    return NULL;
+
+  if (children)
+    XFree (children);
+
+  if (!XGetGeometry (display, window, &root, &x, &y,
+                     &width, &height, &border_width, &depth))
+    return NULL;
+
+  xim_window = g_slice_new (NimfXimWindow);
+  xim_window->root         = root;
+  xim_window->parent       = parent;
+  xim_window->x            = x;
+  xim_window->y            = y;
+  xim_window->border_width = border_width;
+  g_hash_table_insert (server->xim_windows, GSIZE_TO_POINTER (window),
+                       xim_window);
+
+  return xim_window;
+}
+
+static void
+nimf_xim_window_free (NimfXimWindow *xim_window)
+{
+  g_slice_free (NimfXimWindow, xim_window);
+}
+
+/* Sums the positions of @window and its ancestors up to the root; only
+ * windows not watched yet cost round trips, once. */
+gboolean
+nimf_server_xim_get_window_origin (NimfServer *server,
+                                   Display    *display,
+                                   Window      window,
+                                   gint       *x,
+                                   gint       *y)
+{
+  NIMF_TRACE ();
+
+  NimfXimWindow *xim_window;
+
+  *x = 0;
+  *y = 0;
+
+  while (TRUE)
+  {
+    xim_window = g_hash_table_lookup (server->xim_windows,
+                                      GSIZE_TO_POINTER (window));
+
+    if (xim_window == NULL &&
+        !(xim_window = nimf_server_xim_watch_window (server, display, window)))
+      return FALSE;
+
+    *x += xim_window->x + xim_window->border_width;
+    *y += xim_window->y + xim_window->border_width;
+
+    if (xim_window->parent == xim_window->root || xim_window->parent == None)
+      return TRUE;
+
+    window = xim_window->parent;
+  }
+}
+
+/* Its descendants move along, as their positions are relative to it. */
+static void
+nimf_server_xim_update_window (NimfServer *server,
+                               XEvent     *event)
+{
+  NIMF_TRACE ();
+
+  NimfXimWindow *xim_window;
+
+  switch (event->type)
+  {
+    case ConfigureNotify:
+      /* those sent by window managers are in root coordinates; the real
+       * ones of the window or of its ancestors tell the same */
+      if (event->xconfigure.send_event)
+        break;
+
+      xim_window = g_hash_table_lookup (server->xim_windows,
+                     GSIZE_TO_POINTER (event->xconfigure.window));
+      if (xim_window)
+      {
+        xim_window->x            = event->xconfigure.x;
+        xim_window->y            = event->xconfigure.y;
+        xim_window->border_width = event->xconfigure.border_width;
+      }
+      break;
+    case GravityNotify:
+      xim_window = g_hash_table_lookup (server->xim_windows,
+                     GSIZE_TO_POINTER (event->xgravity.window));
+      if (xim_window)
+      {
+        xim_window->x = event->xgravity.x;
+        xim_window->y = event->xgravity.y;
+      }
+      break;
+    case ReparentNotify:
+      /* a new parent is watched when it is first looked up */
+      xim_window = g_hash_table_lookup (server->xim_windows,
+                     GSIZE_TO_POINTER (event->xreparent.window));
+      if (xim_window)
+      {
+        xim_window->parent = event->xreparent.parent;
+        xim_window->x      = event->xreparent.x;
+        xim_window->y      = event->xreparent.y;
+      }
+      break;
+    case DestroyNotify:
+      g_hash_table_remove (server->xim_windows,
+                           GSIZE_TO_POINTER (event->xdestroywindow.window));
+      break;
+    default:
+      break;
+  }
+}
+
 static gboolean nimf_xevent_source_dispatch (GSource     *source,
                                              GSourceFunc  callback,
                                              gpointer     user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
-  Display *display = ((NimfXEventSource*) source)->display;
-  XEvent   event;
+  Display    *display = ((NimfXEventSource*) source)->display;
+  NimfServer *server  = ((NimfXEventSource*) source)->server;
+  XEvent      event;
 
-  while (XPending (display))
+  /* replies to the events are written out together, below; output
+   * from elsewhere in the main thread goes with XPending() in prepare */
+  while (XEventsQueued (display, QueuedAfterReading))
   {
     XNextEvent (display, &event);
     if (XFilterEvent (&event, None))
       continue;
+
+    nimf_server_xim_update_window (server, &event);
   }
 
+  XFlush (display);
+
   return TRUE;
 }
 
 static void nimf_xevent_source_finalize (GSource *source)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 static GSourceFuncs event_funcs = {
@@ -1149,9 +1845,10 @@ static GSourceFuncs event_funcs = {
 };
 
 GSource *
-nimf_xevent_source_new (Display *display)
+nimf_xevent_source_new (NimfServer *server,
+                        Display    *display)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GSource *source;
   NimfXEventSource *xevent_source;
@@ -1160,6 +1857,7 @@ nimf_xevent_source_new (Display *display)
   source = g_source_new (&event_funcs, sizeof (NimfXEventSource));
   xevent_source = (NimfXEventSource *) source;
   xevent_source->display = display;
+  xevent_source->server  = server;
 
   connection_number = ConnectionNumber (xevent_source->display);
 
@@ -1190,7 +1888,7 @@ on_xerror (Display *display, XErrorEvent *error)
 static gboolean
 nimf_server_init_xims (NimfServer *server)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   Display *display;
   Window   window;
@@ -1210,7 +1908,13 @@ nimf_server_init_xims (NimfServer *server)
     0
   };
 
+  /* In the order of preference; UTF-8 is passed through as it is.  Xlib
+   * offers the codeset of the locale, e.g. "UTF-8", and COMPOUND_TEXT, but
+   * decodes what it receives as COMPOUND_TEXT whichever is chosen, so its
+   * clients must get COMPOUND_TEXT; only clients which offer UTF8_STRING,
+   * such as those of xcb-imdkit, get UTF-8. */
   XIMEncoding ims_encodings[] = {
+      "UTF8_STRING",
       "COMPOUND_TEXT",
       NULL
   };
@@ -1253,7 +1957,9 @@ nimf_server_init_xims (NimfServer *server)
             IMFilterEventMask,  KeyPressMask | KeyReleaseMask,
             NULL);
 
-  server->xevent_source = nimf_xevent_source_new (display);
+  server->xim_windows = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                      NULL, (GDestroyNotify) nimf_xim_window_free);
+  server->xevent_source = nimf_xevent_source_new (server, display);
   g_source_attach (server->xevent_source, server->main_context);
   XSetErrorHandler (on_xerror);
 
@@ -1263,7 +1969,7 @@ nimf_server_init_xims (NimfServer *server)
 void
 nimf_server_start (NimfServer *server)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_SERVER (server));
 
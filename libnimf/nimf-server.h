@@ -31,6 +31,10 @@
 #include "nimf-types.h"
 #include "nimf-candidate.h"
 #include "nimf-engine.h"
+#include "nimf-worker.h"
+#include "nimf-id-table.h"
+#include "nimf-key-table.h"
+#include <X11/Xlib.h>
 
 G_BEGIN_DECLS
 
@@ -47,22 +51,45 @@ typedef struct _NimfCandidate   NimfCandidate;
 typedef struct _NimfServer      NimfServer;
 typedef struct _NimfServerClass NimfServerClass;
 
+typedef enum
+{
+  NIMF_KEY_ACTION_TRIGGER, /* toggles engine_id and the system keyboard */
+  NIMF_KEY_ACTION_ROTATE   /* switches to the next engine */
+} NimfKeyActionType;
+
+typedef struct
+{
+  NimfKeyActionType  type;
+  gchar             *engine_id;
+} NimfKeyAction;
+
 struct _NimfServer
 {
   GObject parent_instance;
 
   GMainContext    *main_context;
   GHashTable      *modules;
-  GList           *instances;
+  GPtrArray       *instances; /* in the order of rotation */
+  GHashTable      *instance_indices; /* GQuark of engine id -> index + 1 */
+  gint             selected_engine; /* index, set with engine_epoch */
+  gint             engine_epoch; /* bumped when an engine is selected */
   GSocketListener *listener;
-  GHashTable      *connections;
-  GHashTable      *xim_contexts;
-  GHashTable      *agents;
+  NimfIdTable      connections;
+  NimfIdTable      xim_contexts;
+  GPtrArray       *agents;
+  GSource         *sockets;
+
+  NimfWorker     **workers;
+  guint            n_workers;
+  guint            next_worker;
+  GSource        **worker_sockets;
+  NimfTaskQueue   *tasks; /* run in main_context */
+  GHashTable      *engine_pool; /* GType -> GSList of idle instances */
+  GSource         *hibernation_source;
 
   NimfCandidate   *candidate;
   GSource         *xevent_source;
-  guint16          next_id;
-  guint16          next_icid;
+  GHashTable      *xim_windows; /* Window -> NimfXimWindow */
 
   gchar           *address;
   gboolean         active;
@@ -70,11 +97,17 @@ struct _NimfServer
   gulong           run_signal_handler_id;
 
   GSettings       *settings;
-  NimfKey        **hotkeys;
+  GSettings       *engines_settings; /* org.nimf.engines */
+  guint            engine_changed_delay; /* ms */
+  guint            hibernation_delay;    /* s */
+  guint            engine_pool_size;     /* per engine */
+  GSource         *engine_changed_source;
+  gchar           *pending_icon_name;
   GHashTable      *trigger_gsettings;
-  GHashTable      *trigger_keys;
+  NimfKeyTable     keys; /* -> NimfKeyAction, of trigger keys and hotkeys */
   gboolean         disable_fallback_filter_for_xim;
   gboolean         use_singleton;
+  gboolean         use_shm_transport;
 };
 
 struct _NimfServerClass
@@ -87,11 +120,31 @@ NimfServer *nimf_server_new                (const gchar  *address,
                                             GError      **error);
 void        nimf_server_start              (NimfServer   *server);
 void        nimf_server_stop               (NimfServer   *server);
+void        nimf_server_set_n_workers      (NimfServer   *server,
+                                            guint         n_workers);
+void        nimf_server_invoke             (NimfServer     *server,
+                                            NimfWorker     *worker,
+                                            NimfTaskFunc    func,
+                                            gpointer        data,
+                                            GDestroyNotify  destroy);
 NimfEngine *nimf_server_get_default_engine (NimfServer   *server);
+void        nimf_server_pool_engine        (NimfServer   *server,
+                                            NimfEngine   *engine);
+NimfEngine *nimf_server_take_pooled_engine (NimfServer   *server,
+                                            GType         type);
 NimfEngine *nimf_server_get_next_instance  (NimfServer   *server,
                                             NimfEngine   *engine);
 NimfEngine *nimf_server_get_instance       (NimfServer   *server,
                                             const gchar  *module_name);
+gint        nimf_server_get_instance_index (NimfServer   *server,
+                                            const gchar  *engine_id);
+void        nimf_server_emit_engine_changed (NimfServer  *server,
+                                             const gchar *name);
+gboolean    nimf_server_xim_get_window_origin (NimfServer *server,
+                                               Display    *display,
+                                               Window      window,
+                                               gint       *x,
+                                               gint       *y);
 G_END_DECLS
 
 #endif /* __NIMF_SERVER_H__ */
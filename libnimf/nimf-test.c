@@ -0,0 +1,415 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * nimf-test.c
+ * This file is part of Nimf.
+ *
+ * Copyright (C) 2015,2016 Hodong Kim <cogniti@gmail.com>
+ *
+ * Nimf is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nimf is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program;  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "nimf-private.h"
+#include "nimf-types.h"
+#include "nimf-ring.h"
+#include "nimf-id-table.h"
+#include "nimf-key-table.h"
+#include "nimf-key-syms.h"
+
+/* the header as clients built before NIMF_PROTOCOL_VERSION declared it */
+typedef struct
+{
+  guint16 icid;
+  guint32 type;
+  guint16 data_len;
+} TestLegacyHeader;
+
+/* their values of the message types */
+#define TEST_LEGACY_FOCUS_IN                   9
+#define TEST_LEGACY_FOCUS_IN_REPLY             10
+#define TEST_LEGACY_SET_CURSOR_LOCATION        17
+#define TEST_LEGACY_SET_CURSOR_LOCATION_REPLY  18
+
+static void
+test_socket_pair (GSocket **a,
+                  GSocket **b)
+{
+  gint fds[2];
+
+  g_assert_cmpint (socketpair (AF_UNIX, SOCK_STREAM, 0, fds), ==, 0);
+
+  *a = g_socket_new_from_fd (fds[0], NULL);
+  *b = g_socket_new_from_fd (fds[1], NULL);
+
+  g_assert_nonnull (*a);
+  g_assert_nonnull (*b);
+}
+
+static void
+test_legacy_send (GSocket       *socket,
+                  guint32        type,
+                  gconstpointer  data,
+                  guint16        data_len)
+{
+  TestLegacyHeader header;
+
+  memset (&header, 0, sizeof (TestLegacyHeader));
+  header.icid     = 1;
+  header.type     = type;
+  header.data_len = data_len;
+
+  g_assert_cmpint (g_socket_send (socket, (gchar *) &header,
+                                  sizeof (TestLegacyHeader), NULL, NULL),
+                   ==, sizeof (TestLegacyHeader));
+
+  if (data_len > 0)
+    g_assert_cmpint (g_socket_send (socket, data, data_len, NULL, NULL),
+                     ==, data_len);
+}
+
+static guint32
+test_legacy_recv (GSocket *socket)
+{
+  TestLegacyHeader header;
+
+  g_assert_cmpint (g_socket_receive (socket, (gchar *) &header,
+                                     sizeof (TestLegacyHeader), NULL, NULL),
+                   ==, sizeof (TestLegacyHeader));
+  g_assert_cmpuint (header.icid,     ==, 1);
+  g_assert_cmpuint (header.data_len, ==, 0);
+
+  return header.type;
+}
+
+static void
+test_legacy_one_way (GSocket         *client,
+                     GSocket         *server,
+                     guint32          legacy_type,
+                     guint32          legacy_reply_type,
+                     NimfMessageType  type,
+                     gconstpointer    data,
+                     guint16          data_len)
+{
+  NimfMessage *message;
+
+  test_legacy_send (client, legacy_type, data, data_len);
+
+  message = nimf_recv_message (server);
+  g_assert_nonnull (message);
+  g_assert_cmpuint (message->header.icid,     ==, 1);
+  g_assert_cmpuint (message->header.type,     ==, type);
+  g_assert_cmpuint (message->header.data_len, ==, data_len);
+
+  if (data_len > 0)
+    g_assert_cmpmem (message->data, data_len, data, data_len);
+
+  g_assert_true (nimf_send_reply (server, 1,
+                                  nimf_message_get_legacy_reply_type (type),
+                                  message->header.seq, NULL, 0, NULL));
+  g_assert_cmpuint (test_legacy_recv (client), ==, legacy_reply_type);
+
+  nimf_message_unref (message);
+}
+
+static void
+test_legacy_round_trip (void)
+{
+  GSocket       *client;
+  GSocket       *server;
+  NimfRectangle  area = { 10, 20, 1, 16 };
+
+  test_socket_pair (&client, &server);
+  nimf_socket_allow_legacy (server);
+
+  test_legacy_one_way (client, server,
+                       TEST_LEGACY_FOCUS_IN,
+                       TEST_LEGACY_FOCUS_IN_REPLY,
+                       NIMF_MESSAGE_FOCUS_IN, NULL, 0);
+  g_assert_true (nimf_socket_is_legacy (server));
+
+  test_legacy_one_way (client, server,
+                       TEST_LEGACY_SET_CURSOR_LOCATION,
+                       TEST_LEGACY_SET_CURSOR_LOCATION_REPLY,
+                       NIMF_MESSAGE_SET_CURSOR_LOCATION,
+                       &area, sizeof (NimfRectangle));
+
+  g_object_unref (client);
+  g_object_unref (server);
+}
+
+static void
+test_ring_round_trip (void)
+{
+  NimfRing      *ring;
+  NimfRing      *peer;
+  GOutputVector  vectors[2];
+  gchar          data[3000];
+  gchar          buffer[4096];
+  gint           i;
+
+  ring = nimf_ring_new (4096);
+
+  if (ring == NULL)
+  {
+    g_test_skip ("no memfd_create");
+    return;
+  }
+
+  /* the peer maps the same memory through its own fd */
+  peer = nimf_ring_new_from_fd (dup (nimf_ring_get_fd (ring)));
+  g_assert_nonnull (peer);
+  g_assert_cmpuint (nimf_ring_get_size (ring), ==, 4096);
+  g_assert_cmpuint (nimf_ring_get_size (peer), ==, 4096);
+  g_assert_true (nimf_ring_is_empty (peer));
+
+  for (i = 0; i < (gint) sizeof data; i++)
+    data[i] = i % 251;
+
+  vectors[0].buffer = data;
+  vectors[0].size   = 1000;
+  vectors[1].buffer = data + 1000;
+  vectors[1].size   = 2000;
+
+  /* the second round wraps around the end */
+  for (i = 0; i < 2; i++)
+  {
+    g_assert_true (nimf_ring_write (ring, vectors, 2));
+    g_assert_false (nimf_ring_is_empty (peer));
+    /* all or nothing */
+    g_assert_false (nimf_ring_write (ring, vectors, 2));
+
+    g_assert_cmpint (nimf_ring_read (peer, buffer, sizeof buffer), ==,
+                     sizeof data);
+    g_assert_cmpmem (buffer, sizeof data, data, sizeof data);
+    g_assert_true (nimf_ring_is_empty (ring));
+  }
+
+  g_assert_false (nimf_ring_steal_waiting (peer));
+  nimf_ring_set_waiting (ring, TRUE);
+  g_assert_true  (nimf_ring_steal_waiting (peer));
+  g_assert_false (nimf_ring_steal_waiting (peer));
+
+  nimf_ring_free (peer);
+  nimf_ring_free (ring);
+}
+
+static void
+test_id_table (void)
+{
+  NimfIdTable table;
+  gpointer    item;
+  guint       id;
+  guint       n;
+
+  nimf_id_table_init (&table);
+
+  /* ids start at 1; 0 means none */
+  g_assert_cmpuint (nimf_id_table_add (&table, "a"), ==, 1);
+  g_assert_cmpuint (nimf_id_table_add (&table, "b"), ==, 2);
+  g_assert_cmpuint (nimf_id_table_add (&table, "c"), ==, 3);
+  g_assert_cmpstr (nimf_id_table_lookup (&table, 2), ==, "b");
+  g_assert_null (nimf_id_table_lookup (&table, 0));
+  g_assert_null (nimf_id_table_lookup (&table, 4));
+  g_assert_null (nimf_id_table_lookup (&table, 1000));
+
+  /* freed ids are taken again, lowest first */
+  g_assert_cmpstr (nimf_id_table_remove (&table, 2), ==, "b");
+  g_assert_null (nimf_id_table_remove (&table, 2));
+  g_assert_cmpuint (table.n_items, ==, 2);
+  g_assert_cmpuint (nimf_id_table_add (&table, "d"), ==, 2);
+
+  /* ids given by peers grow the table and are skipped by add */
+  nimf_id_table_insert (&table, 300, "e");
+  nimf_id_table_insert (&table, 4, "f");
+  g_assert_cmpstr (nimf_id_table_lookup (&table, 300), ==, "e");
+  g_assert_cmpuint (nimf_id_table_add (&table, "g"), ==, 5);
+  nimf_id_table_insert (&table, 4, "h");
+  g_assert_cmpstr (nimf_id_table_lookup (&table, 4), ==, "h");
+  g_assert_cmpuint (table.n_items, ==, 6);
+
+  /* removing the item just returned is allowed */
+  for (id = 0, n = 0; (item = nimf_id_table_next (&table, &id)); n++)
+    if (id % 2)
+      g_assert_true (nimf_id_table_remove (&table, id) == item);
+
+  g_assert_cmpuint (n, ==, 6);
+  g_assert_cmpuint (table.n_items, ==, 3);
+
+  for (id = 0, n = 0; (item = nimf_id_table_next (&table, &id)); n++)
+    g_assert_cmpuint (id % 2, ==, 0);
+
+  g_assert_cmpuint (n, ==, 3);
+
+  nimf_id_table_clear (&table);
+  g_assert_cmpuint (table.n_items, ==, 0);
+  g_assert_null (nimf_id_table_lookup (&table, 4));
+}
+
+static void
+test_key_table (void)
+{
+  NimfKeyTable   table;
+  NimfKey        hangul   = { 0, NIMF_KEY_Hangul };
+  NimfKey        space    = { NIMF_SHIFT_MASK, NIMF_KEY_space };
+  NimfKey        ctrl_a   = { NIMF_CONTROL_MASK, NIMF_KEY_a };
+  const NimfKey *first[]  = { &hangul, &space, NULL };
+  const NimfKey *second[] = { &space, &ctrl_a, NULL };
+  NimfEvent      event;
+
+  nimf_key_table_init (&table, g_free);
+  nimf_key_table_add (&table, first,  g_strdup ("first"));
+  nimf_key_table_add (&table, second, g_strdup ("second"));
+
+  g_assert_cmpstr (nimf_key_table_lookup_key (&table, NIMF_KEY_Hangul, 0),
+                   ==, "first");
+  /* a key bound already keeps its first value */
+  g_assert_cmpstr (nimf_key_table_lookup_key (&table, NIMF_KEY_space,
+                                              NIMF_SHIFT_MASK), ==, "first");
+  g_assert_cmpstr (nimf_key_table_lookup_key (&table, NIMF_KEY_a,
+                                              NIMF_CONTROL_MASK), ==, "second");
+  g_assert_null (nimf_key_table_lookup_key (&table, NIMF_KEY_space, 0));
+  g_assert_null (nimf_key_table_lookup_key (&table, NIMF_KEY_a, 0));
+
+  /* lock modifiers do not matter; others do */
+  memset (&event, 0, sizeof (NimfEvent));
+  event.key.type   = NIMF_EVENT_KEY_PRESS;
+  event.key.keyval = NIMF_KEY_a;
+  event.key.state  = NIMF_CONTROL_MASK | NIMF_LOCK_MASK | NIMF_MOD2_MASK;
+  g_assert_cmpstr (nimf_key_table_lookup (&table, &event), ==, "second");
+  event.key.state  = NIMF_CONTROL_MASK | NIMF_SHIFT_MASK;
+  g_assert_null (nimf_key_table_lookup (&table, &event));
+  event.key.keyval = NIMF_KEY_b;
+  event.key.state  = NIMF_CONTROL_MASK;
+  g_assert_null (nimf_key_table_lookup (&table, &event));
+
+  nimf_key_table_remove_all (&table);
+  g_assert_null (nimf_key_table_lookup_key (&table, NIMF_KEY_Hangul, 0));
+  event.key.keyval = NIMF_KEY_a;
+  g_assert_null (nimf_key_table_lookup (&table, &event));
+
+  nimf_key_table_clear (&table);
+}
+
+static void
+test_message_round_trip (void)
+{
+  GSocket     *client;
+  GSocket     *server;
+  NimfMessage *message;
+  gchar        data[10000];
+  guint32      seq;
+  gint         i;
+
+  test_socket_pair (&client, &server);
+
+  for (i = 0; i < (gint) sizeof data; i++)
+    data[i] = i % 251;
+
+  seq = nimf_send_message (client, 7, NIMF_MESSAGE_GET_SURROUNDING,
+                           NULL, 0, NULL);
+  g_assert_cmpuint (seq, !=, 0);
+
+  message = nimf_recv_message (server);
+  g_assert_nonnull (message);
+  g_assert_cmpuint (message->header.version,  ==, NIMF_PROTOCOL_VERSION);
+  g_assert_cmpuint (message->header.icid,     ==, 7);
+  g_assert_cmpuint (message->header.type,     ==, NIMF_MESSAGE_GET_SURROUNDING);
+  g_assert_cmpuint (message->header.seq,      ==, seq);
+  g_assert_cmpuint (message->header.data_len, ==, 0);
+  g_assert_false (nimf_socket_is_legacy (server));
+
+  /* larger than one read, so the body arrives in parts */
+  g_assert_true (nimf_send_reply (server, 7,
+                                  NIMF_MESSAGE_GET_SURROUNDING_REPLY,
+                                  message->header.seq,
+                                  data, sizeof data, NULL));
+  nimf_message_unref (message);
+
+  message = nimf_recv_message (client);
+  g_assert_nonnull (message);
+  g_assert_cmpuint (message->header.icid,     ==, 7);
+  g_assert_cmpuint (message->header.type,     ==,
+                    NIMF_MESSAGE_GET_SURROUNDING_REPLY);
+  g_assert_cmpuint (message->header.seq,      ==, seq);
+  g_assert_cmpuint (message->header.data_len, ==, sizeof data);
+  g_assert_cmpmem (message->data, message->header.data_len, data, sizeof data);
+  nimf_message_unref (message);
+
+  /* seqs of one socket differ */
+  g_assert_cmpuint (nimf_send_message (client, 7, NIMF_MESSAGE_FOCUS_IN,
+                                       NULL, 0, NULL), !=, seq);
+  message = nimf_recv_message (server);
+  g_assert_nonnull (message);
+  g_assert_cmpuint (message->header.type, ==, NIMF_MESSAGE_FOCUS_IN);
+  nimf_message_unref (message);
+
+  g_object_unref (client);
+  g_object_unref (server);
+}
+
+static void
+test_compound (void)
+{
+  GByteArray        *compound = g_byte_array_new ();
+  NimfMessageHeader  header;
+  const gchar       *data;
+  guint32            offset = 0;
+
+  nimf_compound_append (compound, 1, NIMF_MESSAGE_PREEDIT_START, NULL, 0);
+  nimf_compound_append (compound, 1, NIMF_MESSAGE_COMMIT, "abc", 4);
+  nimf_compound_append (compound, 2, NIMF_MESSAGE_PREEDIT_END, NULL, 0);
+
+  g_assert_true (nimf_compound_next ((gchar *) compound->data, compound->len,
+                                     &offset, &header, &data));
+  g_assert_cmpuint (offset, ==, NIMF_COMPOUND_PREFIX_SIZE +
+                                sizeof (NimfMessageHeader));
+  g_assert_cmpuint (header.icid,     ==, 1);
+  g_assert_cmpuint (header.type,     ==, NIMF_MESSAGE_PREEDIT_START);
+  g_assert_cmpuint (header.data_len, ==, 0);
+
+  g_assert_true (nimf_compound_next ((gchar *) compound->data, compound->len,
+                                     &offset, &header, &data));
+  g_assert_cmpuint (header.type,     ==, NIMF_MESSAGE_COMMIT);
+  g_assert_cmpuint (header.data_len, ==, 4);
+  g_assert_cmpstr (data, ==, "abc");
+
+  /* records are aligned after an odd sized body */
+  g_assert_true (nimf_compound_next ((gchar *) compound->data, compound->len,
+                                     &offset, &header, &data));
+  g_assert_cmpuint ((data - (gchar *) compound->data) % 8, ==, 0);
+  g_assert_cmpuint (header.icid, ==, 2);
+  g_assert_cmpuint (header.type, ==, NIMF_MESSAGE_PREEDIT_END);
+
+  g_assert_false (nimf_compound_next ((gchar *) compound->data, compound->len,
+                                      &offset, &header, &data));
+
+  g_byte_array_unref (compound);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/ring/round-trip",    test_ring_round_trip);
+  g_test_add_func ("/id-table",           test_id_table);
+  g_test_add_func ("/key-table",          test_key_table);
+  g_test_add_func ("/message/round-trip", test_message_round_trip);
+  g_test_add_func ("/message/compound",   test_compound);
+  g_test_add_func ("/legacy/round-trip",  test_legacy_round_trip);
+
+  return g_test_run ();
+}
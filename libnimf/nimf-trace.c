@@ -0,0 +1,178 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * nimf-trace.c
+ * This file is part of Nimf.
+ *
+ * Copyright (C) 2015,2016 Hodong Kim <cogniti@gmail.com>
+ *
+ * Nimf is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nimf is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program;  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nimf-trace.h"
+#include "nimf-message.h"
+#include <unistd.h>
+
+#define NIMF_TRACE_BUFFER_SIZE 8192 /* events per thread */
+
+typedef struct
+{
+  const gchar *name;
+  gint64       time;
+  guint32      seq;
+  guint16      type;
+  gchar        phase;
+} NimfTraceEvent;
+
+/* Each thread records into its own ring, so recording takes no lock; the
+ * oldest events are overwritten once it is full. */
+typedef struct
+{
+  NimfTraceEvent events[NIMF_TRACE_BUFFER_SIZE];
+  guint          head; /* advanced by the owner thread only */
+  gint           tid;
+} NimfTraceBuffer;
+
+gboolean nimf_trace_enabled = FALSE;
+
+/* buffers are kept after their threads exit, so that they can be dumped */
+static GPrivate  nimf_trace_buffer_key;
+static GMutex    nimf_trace_mutex; /* guards nimf_trace_buffers */
+static GSList   *nimf_trace_buffers;
+static gint      nimf_trace_next_tid;
+
+void
+nimf_trace_set_enabled (gboolean enabled)
+{
+  nimf_trace_enabled = enabled;
+}
+
+static NimfTraceBuffer *
+nimf_trace_buffer_new (void)
+{
+  NimfTraceBuffer *buffer;
+
+  buffer = g_new0 (NimfTraceBuffer, 1);
+  buffer->tid = g_atomic_int_add (&nimf_trace_next_tid, 1) + 1;
+  g_private_set (&nimf_trace_buffer_key, buffer);
+
+  g_mutex_lock (&nimf_trace_mutex);
+  nimf_trace_buffers = g_slist_prepend (nimf_trace_buffers, buffer);
+  g_mutex_unlock (&nimf_trace_mutex);
+
+  return buffer;
+}
+
+void
+nimf_trace_record (NimfTracePhase  phase,
+                   const gchar    *name,
+                   guint16         type,
+                   guint32         seq)
+{
+  NimfTraceBuffer *buffer = g_private_get (&nimf_trace_buffer_key);
+  NimfTraceEvent  *event;
+  guint            head;
+
+  if (G_UNLIKELY (buffer == NULL))
+    buffer = nimf_trace_buffer_new ();
+
+  head  = buffer->head;
+  event = &buffer->events[head % NIMF_TRACE_BUFFER_SIZE];
+
+  event->name  = name;
+  event->time  = g_get_monotonic_time ();
+  event->seq   = seq;
+  event->type  = type;
+  event->phase = phase;
+
+  /* publishes the event to nimf_trace_dump() */
+  g_atomic_int_set (&buffer->head, head + 1);
+}
+
+static void
+nimf_trace_append_event (GString              *json,
+                         const NimfTraceEvent *event,
+                         gint                  tid)
+{
+  gchar *name = g_strescape (event->name, NULL);
+
+  if (json->str[json->len - 1] == '}')
+    g_string_append_c (json, ',');
+
+  g_string_append_printf (json,
+    "\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT
+    ",\"pid\":%d,\"tid\":%d", name, event->phase, event->time, getpid (), tid);
+
+  if (event->phase == NIMF_TRACE_INSTANT)
+    g_string_append (json, ",\"s\":\"t\"");
+
+  if (event->type)
+  {
+    const gchar *type_name = nimf_message_get_name_by_type (event->type);
+
+    g_string_append_printf (json, ",\"args\":{\"type\":\"%s\",\"seq\":%u}",
+                            type_name ? type_name : "unknown", event->seq);
+  }
+
+  g_string_append_c (json, '}');
+  g_free (name);
+}
+
+/* Writes the recorded events to @filename in the Trace Event Format,
+ * which chrome://tracing and Perfetto load. */
+gboolean
+nimf_trace_dump (const gchar  *filename,
+                 GError      **error)
+{
+  GString *json;
+  GSList  *l;
+  gboolean retval;
+
+  json = g_string_new ("{\"traceEvents\":[");
+
+  g_mutex_lock (&nimf_trace_mutex);
+
+  for (l = nimf_trace_buffers; l; l = l->next)
+  {
+    NimfTraceBuffer *buffer = l->data;
+    NimfTraceEvent  *events;
+    guint            head, first, last, i;
+
+    head  = g_atomic_int_get (&buffer->head);
+    first = head > NIMF_TRACE_BUFFER_SIZE ? head - NIMF_TRACE_BUFFER_SIZE : 0;
+    events = g_new (NimfTraceEvent, NIMF_TRACE_BUFFER_SIZE);
+
+    for (i = first; i < head; i++)
+      events[i % NIMF_TRACE_BUFFER_SIZE] =
+        buffer->events[i % NIMF_TRACE_BUFFER_SIZE];
+
+    /* skip the events the owner overwrote while they were copied */
+    last = g_atomic_int_get (&buffer->head);
+    if (last >= NIMF_TRACE_BUFFER_SIZE)
+      first = MAX (first, last - NIMF_TRACE_BUFFER_SIZE + 1);
+
+    for (i = first; i < head; i++)
+      nimf_trace_append_event (json, &events[i % NIMF_TRACE_BUFFER_SIZE],
+                               buffer->tid);
+
+    g_free (events);
+  }
+
+  g_mutex_unlock (&nimf_trace_mutex);
+
+  g_string_append (json, "\n]}\n");
+  retval = g_file_set_contents (filename, json->str, json->len, error);
+  g_string_free (json, TRUE);
+
+  return retval;
+}
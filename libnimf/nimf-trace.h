@@ -0,0 +1,78 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * nimf-trace.h
+ * This file is part of Nimf.
+ *
+ * Copyright (C) 2015,2016 Hodong Kim <cogniti@gmail.com>
+ *
+ * Nimf is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nimf is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program;  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NIMF_TRACE_H__
+#define __NIMF_TRACE_H__
+
+#if !defined (__NIMF_H_INSIDE__) && !defined (NIMF_COMPILATION)
+#error "Only <nimf.h> can be included directly."
+#endif
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  NIMF_TRACE_INSTANT = 'i',
+  NIMF_TRACE_BEGIN   = 'B',
+  NIMF_TRACE_END     = 'E'
+} NimfTracePhase;
+
+/* Tracepoints are compiled in with ./configure --enable-tracing, which
+ * defines NIMF_ENABLE_TRACING; otherwise they expand to nothing.  Compiled
+ * in, they cost a branch until nimf_trace_set_enabled() turns them on. */
+#ifdef NIMF_ENABLE_TRACING
+
+#define NIMF_TRACE() \
+  G_STMT_START { \
+    if (G_UNLIKELY (nimf_trace_enabled)) \
+      nimf_trace_record (NIMF_TRACE_INSTANT, G_STRFUNC, 0, 0); \
+  } G_STMT_END
+
+/* @name must be a string literal or otherwise outlive the process' traces;
+ * a message type and seq are recorded as its arguments */
+#define NIMF_TRACE_MESSAGE(phase, name, type, seq) \
+  G_STMT_START { \
+    if (G_UNLIKELY (nimf_trace_enabled)) \
+      nimf_trace_record ((phase), (name), (type), (seq)); \
+  } G_STMT_END
+
+#else
+
+#define NIMF_TRACE()                               G_STMT_START { } G_STMT_END
+#define NIMF_TRACE_MESSAGE(phase, name, type, seq) G_STMT_START { } G_STMT_END
+
+#endif
+
+extern gboolean nimf_trace_enabled;
+
+void     nimf_trace_set_enabled (gboolean        enabled);
+void     nimf_trace_record      (NimfTracePhase  phase,
+                                 const gchar    *name,
+                                 guint16         type,
+                                 guint32         seq);
+gboolean nimf_trace_dump        (const gchar    *filename,
+                                 GError        **error);
+
+G_END_DECLS
+
+#endif /* __NIMF_TRACE_H__ */
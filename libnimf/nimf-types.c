@@ -20,6 +20,7 @@
  */
 
 #include "nimf-types.h"
+#include "nimf-trace.h"
 #include "nimf-enum-types.h"
 
 G_DEFINE_QUARK (nimf-error-quark, nimf_error)
@@ -27,7 +28,7 @@ G_DEFINE_QUARK (nimf-error-quark, nimf_error)
 NimfKey *
 nimf_key_new ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return g_slice_new0 (NimfKey);
 }
@@ -35,7 +36,7 @@ nimf_key_new ()
 NimfKey *
 nimf_key_new_from_nicks (const gchar **nicks)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfKey     *key = g_slice_new0 (NimfKey);
   GEnumValue  *enum_value;  /* Do not free */
@@ -94,7 +95,7 @@ NimfKey **nimf_key_newv (const gchar **keys)
 void
 nimf_key_freev (NimfKey **keys)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (keys)
   {
@@ -109,7 +110,7 @@ nimf_key_freev (NimfKey **keys)
 void
 nimf_key_free (NimfKey *key)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (key != NULL);
 
@@ -120,7 +121,7 @@ NimfPreeditAttr *nimf_preedit_attr_new (NimfPreeditAttrType type,
                                         guint               start_index,
                                         guint               end_index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfPreeditAttr *attr;
 
@@ -134,7 +135,7 @@ NimfPreeditAttr *nimf_preedit_attr_new (NimfPreeditAttrType type,
 
 NimfPreeditAttr **nimf_preedit_attrs_copy (NimfPreeditAttr **attrs)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfPreeditAttr **preedit_attrs;
   gint              i;
@@ -155,14 +156,14 @@ NimfPreeditAttr **nimf_preedit_attrs_copy (NimfPreeditAttr **attrs)
 
 void nimf_preedit_attr_free (NimfPreeditAttr *attr)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_free (attr);
 }
 
 void nimf_preedit_attr_freev (NimfPreeditAttr **attrs)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (attrs)
   {
@@ -117,6 +117,16 @@ typedef struct {
   guint end_index; /* The character at this index is not included */
 } NimfPreeditAttr;
 
+typedef struct _NimfEngine  NimfEngine;
+typedef struct _NimfContext NimfContext;
+
+/* receives the reply of the client to a signal which returns a value;
+ * @context is NULL if it has been destroyed before the reply */
+typedef void (*NimfEngineReplyFunc) (NimfEngine  *engine,
+                                     NimfContext *context,
+                                     gboolean     retval,
+                                     gpointer     user_data);
+
 GQuark    nimf_error_quark        (void);
 NimfKey  *nimf_key_new            (void);
 NimfKey  *nimf_key_new_from_nicks (const gchar **nicks);
@@ -0,0 +1,257 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * nimf-worker.c
+ * This file is part of Nimf.
+ *
+ * Copyright (C) 2015,2016 Hodong Kim <cogniti@gmail.com>
+ *
+ * Nimf is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nimf is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program;  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nimf-worker.h"
+#include "nimf-trace.h"
+
+typedef struct _NimfTask NimfTask;
+
+struct _NimfTask
+{
+  NimfTask       *next;
+  NimfTaskFunc    func;
+  gpointer        data;
+  GDestroyNotify  destroy;
+};
+
+/* Producers push onto a lock-free stack; the consumer takes the whole
+ * stack at once and reverses it. */
+struct _NimfTaskQueue
+{
+  GSource       source;
+  GMainContext *main_context;
+  NimfTask     *head;  /* the last pushed */
+  NimfTask     *ready; /* taken by the consumer, not run yet */
+};
+
+static void
+nimf_task_free (NimfTask *task)
+{
+  if (task->destroy)
+    task->destroy (task->data);
+
+  g_slice_free (NimfTask, task);
+}
+
+/* returns the tasks pushed so far, the first pushed first */
+static NimfTask *
+nimf_task_queue_steal (NimfTaskQueue *queue)
+{
+  NimfTask *head;
+  NimfTask *tasks = NULL;
+
+  do
+    head = g_atomic_pointer_get (&queue->head);
+  while (!g_atomic_pointer_compare_and_exchange (&queue->head, head, NULL));
+
+  while (head)
+  {
+    NimfTask *next = head->next;
+
+    head->next = tasks;
+    tasks = head;
+    head = next;
+  }
+
+  return tasks;
+}
+
+static gboolean
+nimf_task_queue_prepare (GSource *source,
+                         gint    *timeout)
+{
+  NimfTaskQueue *queue = (NimfTaskQueue *) source;
+
+  *timeout = -1;
+
+  return queue->ready || g_atomic_pointer_get (&queue->head) != NULL;
+}
+
+static gboolean
+nimf_task_queue_check (GSource *source)
+{
+  NimfTaskQueue *queue = (NimfTaskQueue *) source;
+
+  return queue->ready || g_atomic_pointer_get (&queue->head) != NULL;
+}
+
+static gboolean
+nimf_task_queue_dispatch (GSource     *source,
+                          GSourceFunc  callback,
+                          gpointer     user_data)
+{
+  NIMF_TRACE ();
+
+  NimfTaskQueue *queue = (NimfTaskQueue *) source;
+  NimfTask      *task;
+
+  if (queue->ready == NULL)
+    queue->ready = nimf_task_queue_steal (queue);
+
+  /* taken one by one, so that a task which iterates the main context, e.g.
+   * to wait for a reply, runs the rest in order in a recursive dispatch */
+  while ((task = queue->ready))
+  {
+    queue->ready = task->next;
+    task->func (task->data);
+    nimf_task_free (task);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+nimf_task_queue_finalize (GSource *source)
+{
+  NIMF_TRACE ();
+
+  NimfTaskQueue *queue = (NimfTaskQueue *) source;
+  NimfTask      *task;
+
+  /* never run; their data is still released */
+  while ((task = queue->ready) ||
+         (task = queue->ready = nimf_task_queue_steal (queue)))
+  {
+    queue->ready = task->next;
+    nimf_task_free (task);
+  }
+
+  g_main_context_unref (queue->main_context);
+}
+
+static GSourceFuncs nimf_task_queue_funcs = {
+  nimf_task_queue_prepare,
+  nimf_task_queue_check,
+  nimf_task_queue_dispatch,
+  nimf_task_queue_finalize
+};
+
+NimfTaskQueue *
+nimf_task_queue_new (GMainContext *main_context)
+{
+  NIMF_TRACE ();
+
+  GSource       *source;
+  NimfTaskQueue *queue;
+
+  source = g_source_new (&nimf_task_queue_funcs, sizeof (NimfTaskQueue));
+  queue  = (NimfTaskQueue *) source;
+  queue->main_context = g_main_context_ref (main_context);
+  g_source_set_name (source, "NimfTaskQueue");
+  g_source_attach (source, main_context);
+
+  return queue;
+}
+
+void
+nimf_task_queue_free (NimfTaskQueue *queue)
+{
+  NIMF_TRACE ();
+
+  g_source_destroy ((GSource *) queue);
+  g_source_unref   ((GSource *) queue);
+}
+
+void
+nimf_task_queue_push (NimfTaskQueue  *queue,
+                      NimfTaskFunc    func,
+                      gpointer        data,
+                      GDestroyNotify  destroy)
+{
+  NIMF_TRACE ();
+
+  NimfTask *task;
+
+  task = g_slice_new (NimfTask);
+  task->func    = func;
+  task->data    = data;
+  task->destroy = destroy;
+
+  do
+    task->next = g_atomic_pointer_get (&queue->head);
+  while (!g_atomic_pointer_compare_and_exchange (&queue->head,
+                                                 task->next, task));
+
+  /* otherwise the push that made the stack non-empty has woken it up, and
+   * the consumer has not taken the stack yet */
+  if (task->next == NULL)
+    g_main_context_wakeup (queue->main_context);
+}
+
+static gpointer
+nimf_worker_run (NimfWorker *worker)
+{
+  NIMF_TRACE ();
+
+  g_main_context_push_thread_default (worker->main_context);
+  g_main_loop_run (worker->loop);
+  g_main_context_pop_thread_default (worker->main_context);
+
+  g_atomic_int_set (&worker->is_done, TRUE);
+  g_main_context_wakeup (worker->creator_context);
+
+  return NULL;
+}
+
+static void
+nimf_worker_quit (gpointer data)
+{
+  g_main_loop_quit (data);
+}
+
+NimfWorker *
+nimf_worker_new (const gchar *name)
+{
+  NIMF_TRACE ();
+
+  NimfWorker *worker;
+
+  worker = g_slice_new0 (NimfWorker);
+  worker->creator_context = g_main_context_ref_thread_default ();
+  worker->main_context = g_main_context_new ();
+  worker->loop   = g_main_loop_new (worker->main_context, FALSE);
+  worker->tasks  = nimf_task_queue_new (worker->main_context);
+  worker->thread = g_thread_new (name, (GThreadFunc) nimf_worker_run, worker);
+
+  return worker;
+}
+
+/* Stops the worker after the tasks pushed so far and waits for it, while
+ * running the main context of the caller, which the worker may be waiting
+ * on, e.g. for the candidate window. */
+void
+nimf_worker_free (NimfWorker *worker)
+{
+  NIMF_TRACE ();
+
+  nimf_task_queue_push (worker->tasks, nimf_worker_quit, worker->loop, NULL);
+
+  while (!g_atomic_int_get (&worker->is_done))
+    g_main_context_iteration (worker->creator_context, TRUE);
+
+  g_thread_join (worker->thread);
+  g_main_context_unref (worker->creator_context);
+
+  nimf_task_queue_free (worker->tasks);
+  g_main_loop_unref (worker->loop);
+  g_main_context_unref (worker->main_context);
+  g_slice_free (NimfWorker, worker);
+}
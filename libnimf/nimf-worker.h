@@ -0,0 +1,59 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * nimf-worker.h
+ * This file is part of Nimf.
+ *
+ * Copyright (C) 2015,2016 Hodong Kim <cogniti@gmail.com>
+ *
+ * Nimf is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nimf is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program;  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NIMF_WORKER_H__
+#define __NIMF_WORKER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef void (* NimfTaskFunc) (gpointer data);
+
+/* A GSource running functions pushed from any thread, in the order they
+ * were pushed, in the thread of the main context it is attached to.
+ * Pushing takes no lock. */
+typedef struct _NimfTaskQueue NimfTaskQueue;
+
+/* A thread with its own main context, which reads and writes the sockets
+ * of the connections assigned to it by the server. */
+typedef struct
+{
+  GThread       *thread;
+  GMainContext  *main_context;
+  GMainLoop     *loop;
+  NimfTaskQueue *tasks;
+  GMainContext  *creator_context; /* of the thread which created it */
+  gint           is_done;
+} NimfWorker;
+
+NimfTaskQueue *nimf_task_queue_new  (GMainContext   *main_context);
+void           nimf_task_queue_free (NimfTaskQueue  *queue);
+void           nimf_task_queue_push (NimfTaskQueue  *queue,
+                                     NimfTaskFunc    func,
+                                     gpointer        data,
+                                     GDestroyNotify  destroy);
+NimfWorker    *nimf_worker_new      (const gchar    *name);
+void           nimf_worker_free     (NimfWorker     *worker);
+
+G_END_DECLS
+
+#endif /* __NIMF_WORKER_H__ */
@@ -31,6 +31,8 @@
 #include "nimf-events.h"
 #include "nimf-im.h"
 #include "nimf-key-syms.h"
+#include "nimf-key-table.h"
+#include "nimf-trace.h"
 #include "nimf-types.h"
 
 #undef __NIMF_H_INSIDE__
@@ -60,7 +60,7 @@ G_DEFINE_DYNAMIC_TYPE (NimfGtkIMContext, nimf_gtk_im_context, GTK_TYPE_IM_CONTEX
 static NimfEvent *
 translate_gdk_event_key (GdkEventKey *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfEvent *nimf_event = nimf_event_new (NIMF_EVENT_NOTHING);
 
@@ -79,7 +79,7 @@ translate_gdk_event_key (GdkEventKey *event)
 static NimfEvent *
 translate_xkey_event (XEvent *xevent)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GdkKeymap *keymap = gdk_keymap_get_default ();
   GdkModifierType consumed, state;
@@ -119,7 +119,7 @@ static gboolean
 nimf_gtk_im_context_filter_keypress (GtkIMContext *context,
                                      GdkEventKey  *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   gboolean retval = FALSE;
   NimfEvent *nimf_event = translate_gdk_event_key (event);
@@ -133,7 +133,7 @@ nimf_gtk_im_context_filter_keypress (GtkIMContext *context,
 static void
 nimf_gtk_im_context_reset (GtkIMContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_im_reset (NIMF_GTK_IM_CONTEXT (context)->im);
 }
@@ -180,7 +180,7 @@ static void
 nimf_gtk_im_context_set_client_window (GtkIMContext *context,
                                        GdkWindow    *window)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfGtkIMContext *a_context = NIMF_GTK_IM_CONTEXT (context);
 
@@ -200,7 +200,7 @@ nimf_gtk_im_context_get_preedit_string (GtkIMContext   *context,
                                         PangoAttrList **attrs,
                                         gint           *cursor_pos)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfPreeditAttr **preedit_attrs;
   gchar *preedit_str;
@@ -255,7 +255,7 @@ nimf_gtk_im_context_get_preedit_string (GtkIMContext   *context,
 static void
 nimf_gtk_im_context_focus_in (GtkIMContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfGtkIMContext *a_context = NIMF_GTK_IM_CONTEXT (context);
   a_context->has_focus = TRUE;
@@ -265,7 +265,7 @@ nimf_gtk_im_context_focus_in (GtkIMContext *context)
 static void
 nimf_gtk_im_context_focus_out (GtkIMContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfGtkIMContext *a_context = NIMF_GTK_IM_CONTEXT (context);
   nimf_im_focus_out (a_context->im);
@@ -276,7 +276,7 @@ static void
 nimf_gtk_im_context_set_cursor_location (GtkIMContext *context,
                                          GdkRectangle *area)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfGtkIMContext *nimf_context = NIMF_GTK_IM_CONTEXT (context);
 
@@ -297,7 +297,7 @@ static void
 nimf_gtk_im_context_set_use_preedit (GtkIMContext *context,
                                      gboolean      use_preedit)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (NIMF_GTK_IM_CONTEXT (context)->always_use_preedit == TRUE)
     nimf_im_set_use_preedit (NIMF_GTK_IM_CONTEXT (context)->im, TRUE);
@@ -310,7 +310,7 @@ nimf_gtk_im_context_get_surrounding (GtkIMContext  *context,
                                      gchar        **text,
                                      gint          *cursor_index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return nimf_im_get_surrounding (NIMF_GTK_IM_CONTEXT (context)->im,
                                   text, cursor_index);
@@ -322,7 +322,7 @@ nimf_gtk_im_context_set_surrounding (GtkIMContext *context,
                                      gint          len,
                                      gint          cursor_index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_im_set_surrounding (NIMF_GTK_IM_CONTEXT (context)->im,
                            text, len, cursor_index);
@@ -331,7 +331,7 @@ nimf_gtk_im_context_set_surrounding (GtkIMContext *context,
 GtkIMContext *
 nimf_gtk_im_context_new (void)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return g_object_new (NIMF_GTK_TYPE_IM_CONTEXT, NULL);
 }
@@ -341,7 +341,7 @@ on_commit (NimfIM           *im,
            const gchar      *text,
            NimfGtkIMContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_signal_emit_by_name (context, "commit", text);
 }
@@ -352,7 +352,7 @@ on_delete_surrounding (NimfIM           *im,
                        gint              n_chars,
                        NimfGtkIMContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   gboolean retval;
   g_signal_emit_by_name (context,
@@ -364,7 +364,7 @@ static void
 on_preedit_changed (NimfIM           *im,
                     NimfGtkIMContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
   g_signal_emit_by_name (context, "preedit-changed");
 }
 
@@ -372,7 +372,7 @@ static void
 on_preedit_end (NimfIM           *im,
                 NimfGtkIMContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
   g_signal_emit_by_name (context, "preedit-end");
 }
 
@@ -380,7 +380,7 @@ static void
 on_preedit_start (NimfIM           *im,
                   NimfGtkIMContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
   g_signal_emit_by_name (context, "preedit-start");
 }
 
@@ -388,7 +388,7 @@ static gboolean
 on_retrieve_surrounding (NimfIM           *im,
                          NimfGtkIMContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   gboolean retval;
   g_signal_emit_by_name (context, "retrieve-surrounding", &retval);
@@ -399,7 +399,7 @@ on_retrieve_surrounding (NimfIM           *im,
 static void
 nimf_gtk_im_context_update_event_filter (NimfGtkIMContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (context->is_reset_on_gdk_button_press_event ||
       context->is_hook_gdk_event_key)
@@ -425,7 +425,7 @@ on_changed_reset_on_gdk_button_press_event (GSettings        *settings,
                                             gchar            *key,
                                             NimfGtkIMContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   context->is_reset_on_gdk_button_press_event =
     g_settings_get_boolean (context->settings, key);
@@ -438,7 +438,7 @@ on_changed_hook_gdk_event_key (GSettings        *settings,
                                gchar            *key,
                                NimfGtkIMContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   context->is_hook_gdk_event_key =
     g_settings_get_boolean (context->settings, key);
@@ -451,7 +451,7 @@ on_changed_always_use_preedit (GSettings        *settings,
                                gchar            *key,
                                NimfGtkIMContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   context->always_use_preedit =
     g_settings_get_boolean (context->settings, key);
@@ -463,7 +463,7 @@ on_changed_always_use_preedit (GSettings        *settings,
 static void
 nimf_gtk_im_context_init (NimfGtkIMContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   context->im = nimf_im_new ();
 
@@ -507,7 +507,7 @@ nimf_gtk_im_context_init (NimfGtkIMContext *context)
 static void
 nimf_gtk_im_context_finalize (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfGtkIMContext *context = NIMF_GTK_IM_CONTEXT (object);
 
@@ -526,7 +526,7 @@ nimf_gtk_im_context_finalize (GObject *object)
 static void
 nimf_gtk_im_context_class_init (NimfGtkIMContextClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GObjectClass *object_class = G_OBJECT_CLASS (class);
   GtkIMContextClass *im_context_class = GTK_IM_CONTEXT_CLASS (class);
@@ -548,7 +548,7 @@ nimf_gtk_im_context_class_init (NimfGtkIMContextClass *class)
 static void
 nimf_gtk_im_context_class_finalize (NimfGtkIMContextClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 static const GtkIMContextInfo nimf_info = {
@@ -565,20 +565,20 @@ static const GtkIMContextInfo *info_list[] = {
 
 G_MODULE_EXPORT void im_module_init (GTypeModule *type_module)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_gtk_im_context_register_type (type_module);
 }
 
 G_MODULE_EXPORT void im_module_exit (void)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 G_MODULE_EXPORT void im_module_list (const GtkIMContextInfo ***contexts,
                                      int                      *n_contexts)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   *contexts = info_list;
   *n_contexts = G_N_ELEMENTS (info_list);
@@ -586,7 +586,7 @@ G_MODULE_EXPORT void im_module_list (const GtkIMContextInfo ***contexts,
 
 G_MODULE_EXPORT GtkIMContext *im_module_create (const gchar *context_id)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (g_strcmp0 (context_id, PACKAGE) == 0)
     return nimf_gtk_im_context_new ();
@@ -73,7 +73,7 @@ private:
 void
 NimfInputContext::on_preedit_start (NimfIM *im, gpointer user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfInputContext *context = static_cast<NimfInputContext *>(user_data);
   context->m_isComposing = true;
@@ -82,7 +82,7 @@ NimfInputContext::on_preedit_start (NimfIM *im, gpointer user_data)
 void
 NimfInputContext::on_preedit_end (NimfIM *im, gpointer user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfInputContext *context = static_cast<NimfInputContext *>(user_data);
   context->m_isComposing = false;
@@ -91,7 +91,7 @@ NimfInputContext::on_preedit_end (NimfIM *im, gpointer user_data)
 void
 NimfInputContext::on_preedit_changed (NimfIM *im, gpointer user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfInputContext *context = static_cast<NimfInputContext *>(user_data);
 
@@ -144,7 +144,7 @@ NimfInputContext::on_commit (NimfIM      *im,
                              const gchar *text,
                              gpointer     user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfInputContext *context = static_cast<NimfInputContext *>(user_data);
   QString str = QString::fromUtf8 (text);
@@ -156,7 +156,7 @@ NimfInputContext::on_commit (NimfIM      *im,
 gboolean
 NimfInputContext::on_retrieve_surrounding (NimfIM *im, gpointer user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   // TODO
   return FALSE;
@@ -168,7 +168,7 @@ NimfInputContext::on_delete_surrounding (NimfIM   *im,
                                          gint      n_chars,
                                          gpointer  user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   // TODO
   return FALSE;
@@ -179,7 +179,7 @@ NimfInputContext::on_changed_disable_fallback_filter (GSettings     *settings,
                                                       gchar         *key,
                                                       gpointer       user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfInputContext *context = static_cast<NimfInputContext *>(user_data);
 
@@ -190,7 +190,7 @@ NimfInputContext::on_changed_disable_fallback_filter (GSettings     *settings,
 NimfInputContext::NimfInputContext ()
   : m_isComposing(false)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   m_settings = g_settings_new ("org.nimf.clients.qt4");
 
@@ -220,7 +220,7 @@ NimfInputContext::NimfInputContext ()
 
 NimfInputContext::~NimfInputContext ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_object_unref (m_im);
   g_object_unref (m_settings);
@@ -229,7 +229,7 @@ NimfInputContext::~NimfInputContext ()
 QString
 NimfInputContext::identifierName ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return QString ("nimf");
 }
@@ -237,7 +237,7 @@ NimfInputContext::identifierName ()
 QString
 NimfInputContext::language ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return QString ("");
 }
@@ -245,7 +245,7 @@ NimfInputContext::language ()
 void
 NimfInputContext::reset ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_im_reset (m_im);
 }
@@ -253,7 +253,7 @@ NimfInputContext::reset ()
 void
 NimfInputContext::update ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   QWidget *widget = focusWidget ();
 
@@ -281,7 +281,7 @@ NimfInputContext::update ()
 bool
 NimfInputContext::isComposing () const
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return m_isComposing;
 }
@@ -289,7 +289,7 @@ NimfInputContext::isComposing () const
 void
 NimfInputContext::setFocusWidget (QWidget *w)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (!w)
     nimf_im_focus_out (m_im);
@@ -305,7 +305,7 @@ NimfInputContext::setFocusWidget (QWidget *w)
 bool
 NimfInputContext::filterEvent (const QEvent *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   gboolean         retval;
   const QKeyEvent *key_event = static_cast<const QKeyEvent *>( event );
@@ -349,45 +349,45 @@ class NimfInputContextPlugin : public QInputContextPlugin
 public:
   NimfInputContextPlugin ()
   {
-    g_debug (G_STRLOC ": %s", G_STRFUNC);
+    NIMF_TRACE ();
   }
 
   ~NimfInputContextPlugin ()
   {
-    g_debug (G_STRLOC ": %s", G_STRFUNC);
+    NIMF_TRACE ();
   }
 
   virtual QStringList keys () const
   {
-    g_debug (G_STRLOC ": %s", G_STRFUNC);
+    NIMF_TRACE ();
 
     return QStringList () << "nimf";
   }
 
   virtual QInputContext *create (const QString &key)
   {
-    g_debug (G_STRLOC ": %s", G_STRFUNC);
+    NIMF_TRACE ();
 
     return new NimfInputContext ();
   }
 
   virtual QStringList languages (const QString &key)
   {
-    g_debug (G_STRLOC ": %s", G_STRFUNC);
+    NIMF_TRACE ();
 
     return QStringList () << "ko" << "zh" << "ja";
   }
 
   virtual QString displayName (const QString &key)
   {
-    g_debug (G_STRLOC ": %s", G_STRFUNC);
+    NIMF_TRACE ();
 
     return QString ("Nimf");
   }
 
   virtual QString description (const QString &key)
   {
-    g_debug (G_STRLOC ": %s", G_STRFUNC);
+    NIMF_TRACE ();
 
     return QString ("nimf Qt4 im module");
   }
@@ -111,19 +111,19 @@ private:
 void
 NimfInputContext::on_preedit_start (NimfIM *im, gpointer user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 void
 NimfInputContext::on_preedit_end (NimfIM *im, gpointer user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 void
 NimfInputContext::on_preedit_changed (NimfIM *im, gpointer user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfPreeditAttr **preedit_attrs;
   gchar            *str;
@@ -180,7 +180,7 @@ NimfInputContext::on_commit (NimfIM      *im,
                              const gchar *text,
                              gpointer     user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   QString str = QString::fromUtf8 (text);
   QInputMethodEvent event;
@@ -197,7 +197,7 @@ NimfInputContext::on_commit (NimfIM      *im,
 gboolean
 NimfInputContext::on_retrieve_surrounding (NimfIM *im, gpointer user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
   return FALSE;
 }
 
@@ -207,7 +207,7 @@ NimfInputContext::on_delete_surrounding (NimfIM   *im,
                                          gint      n_chars,
                                          gpointer  user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
   return FALSE;
 }
 
@@ -216,7 +216,7 @@ NimfInputContext::on_changed_disable_fallback_filter (GSettings *settings,
                                                       gchar     *key,
                                                       gpointer   user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfInputContext *context = static_cast<NimfInputContext *>(user_data);
 
@@ -229,7 +229,7 @@ NimfInputContext::on_changed_reset_on_mouse_button_press (GSettings *settings,
                                                           gchar     *key,
                                                           gpointer   user_data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfInputContext *context = static_cast<NimfInputContext *>(user_data);
 
@@ -254,7 +254,7 @@ NimfInputContext::on_changed_reset_on_mouse_button_press (GSettings *settings,
 
 NimfInputContext::NimfInputContext ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   m_settings = g_settings_new ("org.nimf.clients.qt5");
 
@@ -288,7 +288,7 @@ NimfInputContext::NimfInputContext ()
 
 NimfInputContext::~NimfInputContext ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (m_handler)
     delete m_handler;
@@ -300,28 +300,28 @@ NimfInputContext::~NimfInputContext ()
 bool
 NimfInputContext::isValid () const
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
   return true;
 }
 
 void
 NimfInputContext::reset ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
   nimf_im_reset (m_im);
 }
 
 void
 NimfInputContext::commit ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
   nimf_im_reset (m_im);
 }
 
 void
 NimfInputContext::update (Qt::InputMethodQueries queries) /* FIXME */
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (queries & Qt::ImCursorRectangle)
   {
@@ -352,13 +352,13 @@ NimfInputContext::update (Qt::InputMethodQueries queries) /* FIXME */
 void
 NimfInputContext::invokeAction(QInputMethod::Action, int cursorPosition)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 bool
 NimfInputContext::filterEvent (const QEvent *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (G_UNLIKELY (!qApp->focusObject() || !inputMethodAccepted()))
     return false;
@@ -396,54 +396,54 @@ NimfInputContext::filterEvent (const QEvent *event)
 QRectF
 NimfInputContext::keyboardRect() const
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
   return QRectF ();
 }
 
 bool
 NimfInputContext::isAnimating() const
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
   return false;
 }
 
 void
 NimfInputContext::showInputPanel()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 void
 NimfInputContext::hideInputPanel()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 bool
 NimfInputContext::isInputPanelVisible() const
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
   return false;
 }
 
 QLocale
 NimfInputContext::locale() const
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
   return QLocale ();
 }
 
 Qt::LayoutDirection
 NimfInputContext::inputDirection() const
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
   return Qt::LayoutDirection ();
 }
 
 void
 NimfInputContext::setFocusObject (QObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (!object || !inputMethodAccepted())
     nimf_im_focus_out (m_im);
@@ -469,17 +469,17 @@ class NimfInputContextPlugin : public QPlatformInputContextPlugin
 public:
   NimfInputContextPlugin ()
   {
-    g_debug (G_STRLOC ": %s", G_STRFUNC);
+    NIMF_TRACE ();
   }
 
   ~NimfInputContextPlugin ()
   {
-    g_debug (G_STRLOC ": %s", G_STRFUNC);
+    NIMF_TRACE ();
   }
 
   virtual QStringList keys () const
   {
-    g_debug (G_STRLOC ": %s", G_STRFUNC);
+    NIMF_TRACE ();
 
     return QStringList () <<  "nimf";
   }
@@ -487,7 +487,7 @@ public:
   virtual QPlatformInputContext *create (const QString     &key,
                                          const QStringList &paramList)
   {
-    g_debug (G_STRLOC ": %s", G_STRFUNC);
+    NIMF_TRACE ();
 
     return new NimfInputContext ();
   }
@@ -63,7 +63,7 @@ struct _NimfAnthyClass
 };
 
 static gint        nimf_anthy_ref_count = 0;
-static GHashTable *nimf_anthy_romaji = NULL;;
+static GHashTable *nimf_anthy_romaji = NULL;
 
 G_DEFINE_DYNAMIC_TYPE (NimfAnthy, nimf_anthy, NIMF_TYPE_ENGINE);
 
@@ -72,7 +72,7 @@ static void nimf_anthy_update_preedit (NimfEngine  *engine,
                                        const gchar *new_preedit,
                                        gint         cursor_pos)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfAnthy *anthy = NIMF_ANTHY (engine);
 
@@ -97,7 +97,7 @@ static void nimf_anthy_update_preedit (NimfEngine  *engine,
 void nimf_anthy_reset (NimfEngine  *engine,
                        NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfAnthy *anthy = NIMF_ANTHY (engine);
 
@@ -129,14 +129,14 @@ void
 nimf_anthy_focus_in (NimfEngine  *engine,
                      NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 void
 nimf_anthy_focus_out (NimfEngine  *engine,
                       NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_candidate_hide_window (NIMF_ANTHY (engine)->candidate);
   nimf_anthy_reset (engine, target);
@@ -145,7 +145,7 @@ nimf_anthy_focus_out (NimfEngine  *engine,
 static gint
 nimf_anthy_get_current_page (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return NIMF_ANTHY (engine)->current_page;
 }
@@ -156,7 +156,7 @@ on_candidate_clicked (NimfEngine  *engine,
                       gchar       *text,
                       gint         index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfAnthy *anthy = NIMF_ANTHY (engine);
   gchar     *new_preedit;
@@ -194,7 +194,7 @@ static void
 nimf_anthy_update_page (NimfEngine  *engine,
                         NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfAnthy *anthy = NIMF_ANTHY (engine);
 
@@ -220,7 +220,7 @@ nimf_anthy_update_page (NimfEngine  *engine,
 static gboolean
 nimf_anthy_page_up (NimfEngine *engine, NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfAnthy *anthy = NIMF_ANTHY (engine);
 
@@ -240,7 +240,7 @@ nimf_anthy_page_up (NimfEngine *engine, NimfContext *target)
 static gboolean
 nimf_anthy_page_down (NimfEngine *engine, NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfAnthy *anthy = NIMF_ANTHY (engine);
 
@@ -260,7 +260,7 @@ nimf_anthy_page_down (NimfEngine *engine, NimfContext *target)
 static void
 nimf_anthy_page_home (NimfEngine *engine, NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfAnthy *anthy = NIMF_ANTHY (engine);
 
@@ -278,7 +278,7 @@ nimf_anthy_page_home (NimfEngine *engine, NimfContext *target)
 static void
 nimf_anthy_page_end (NimfEngine *engine, NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfAnthy *anthy = NIMF_ANTHY (engine);
 
@@ -298,7 +298,7 @@ on_candidate_scrolled (NimfEngine  *engine,
                        NimfContext *target,
                        gdouble      value)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfAnthy *anthy = NIMF_ANTHY (engine);
 
@@ -323,7 +323,7 @@ nimf_anthy_update_candidate (NimfEngine  *engine,
                              NimfContext *target,
                              NimfEvent   *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfAnthy *anthy = NIMF_ANTHY (engine);
   gint       i;
@@ -365,7 +365,7 @@ nimf_anthy_romaji_filter_event (NimfEngine  *engine,
                                 NimfContext *target,
                                 NimfEvent   *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfAnthy   *anthy = NIMF_ANTHY (engine);
   const gchar *str;
@@ -456,7 +456,7 @@ nimf_anthy_filter_event (NimfEngine  *engine,
                          NimfContext *target,
                          NimfEvent   *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfAnthy *anthy = NIMF_ANTHY (engine);
   gboolean   retval;
@@ -660,10 +660,185 @@ nimf_anthy_filter_event (NimfEngine  *engine,
   return retval;
 }
 
+/* anthy_init() and the romaji table are the backend, shared by all
+ * instances; each instance is a session with an anthy_context_t of its
+ * own. */
+static void
+nimf_anthy_backend_ref (void)
+{
+  NIMF_TRACE ();
+
+  if (nimf_anthy_ref_count++ > 0)
+    return;
+
+  nimf_anthy_romaji = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                             NULL, g_free);
+  g_hash_table_insert (nimf_anthy_romaji, "a", g_strdup ("あ"));
+  g_hash_table_insert (nimf_anthy_romaji, "b", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "ba", g_strdup ("ば"));
+  g_hash_table_insert (nimf_anthy_romaji, "be", g_strdup ("べ"));
+  g_hash_table_insert (nimf_anthy_romaji, "bi", g_strdup ("び"));
+  g_hash_table_insert (nimf_anthy_romaji, "bo", g_strdup ("ぼ"));
+  g_hash_table_insert (nimf_anthy_romaji, "bu", g_strdup ("ぶ"));
+  g_hash_table_insert (nimf_anthy_romaji, "by", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "bya", g_strdup ("びゃ"));
+  g_hash_table_insert (nimf_anthy_romaji, "byo", g_strdup ("びょ"));
+  g_hash_table_insert (nimf_anthy_romaji, "byu", g_strdup ("びゅ"));
+  g_hash_table_insert (nimf_anthy_romaji, "c", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "ch", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "cha", g_strdup ("ちゃ"));
+  g_hash_table_insert (nimf_anthy_romaji, "chi", g_strdup ("ち"));
+  g_hash_table_insert (nimf_anthy_romaji, "cho", g_strdup ("ちょ"));
+  g_hash_table_insert (nimf_anthy_romaji, "chu", g_strdup ("ちゅ"));
+  g_hash_table_insert (nimf_anthy_romaji, "d", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "da", g_strdup ("だ"));
+  g_hash_table_insert (nimf_anthy_romaji, "de", g_strdup ("で"));
+  g_hash_table_insert (nimf_anthy_romaji, "di", g_strdup ("ぢ"));
+  g_hash_table_insert (nimf_anthy_romaji, "do", g_strdup ("ど"));
+  g_hash_table_insert (nimf_anthy_romaji, "du", g_strdup ("づ"));
+  g_hash_table_insert (nimf_anthy_romaji, "dy", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "dya", g_strdup ("ぢゃ"));
+  g_hash_table_insert (nimf_anthy_romaji, "dyo", g_strdup ("ぢょ"));
+  g_hash_table_insert (nimf_anthy_romaji, "dyu", g_strdup ("ぢゅ"));
+  g_hash_table_insert (nimf_anthy_romaji, "e", g_strdup ("え"));
+  g_hash_table_insert (nimf_anthy_romaji, "f", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "fu", g_strdup ("ふ"));
+  g_hash_table_insert (nimf_anthy_romaji, "g", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "ga", g_strdup ("が"));
+  g_hash_table_insert (nimf_anthy_romaji, "ge", g_strdup ("げ"));
+  g_hash_table_insert (nimf_anthy_romaji, "gi", g_strdup ("ぎ"));
+  g_hash_table_insert (nimf_anthy_romaji, "go", g_strdup ("ご"));
+  g_hash_table_insert (nimf_anthy_romaji, "gu", g_strdup ("ぐ"));
+  g_hash_table_insert (nimf_anthy_romaji, "gy", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "gya", g_strdup ("ぎゃ"));
+  g_hash_table_insert (nimf_anthy_romaji, "gyo", g_strdup ("ぎょ"));
+  g_hash_table_insert (nimf_anthy_romaji, "gyu", g_strdup ("ぎゅ"));
+  g_hash_table_insert (nimf_anthy_romaji, "h", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "ha", g_strdup ("は"));
+  g_hash_table_insert (nimf_anthy_romaji, "he", g_strdup ("へ"));
+  g_hash_table_insert (nimf_anthy_romaji, "hi", g_strdup ("ひ"));
+  g_hash_table_insert (nimf_anthy_romaji, "ho", g_strdup ("ほ"));
+  g_hash_table_insert (nimf_anthy_romaji, "hy", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "hya", g_strdup ("ひゃ"));
+  g_hash_table_insert (nimf_anthy_romaji, "hyo", g_strdup ("ひょ"));
+  g_hash_table_insert (nimf_anthy_romaji, "hyu", g_strdup ("ひゅ"));
+  g_hash_table_insert (nimf_anthy_romaji, "i", g_strdup ("い"));
+  g_hash_table_insert (nimf_anthy_romaji, "j", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "ja", g_strdup ("じゃ"));
+  g_hash_table_insert (nimf_anthy_romaji, "ji", g_strdup ("じ"));
+  g_hash_table_insert (nimf_anthy_romaji, "jo", g_strdup ("じょ"));
+  g_hash_table_insert (nimf_anthy_romaji, "ju", g_strdup ("じゅ"));
+  g_hash_table_insert (nimf_anthy_romaji, "k", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "ka", g_strdup ("か"));
+  g_hash_table_insert (nimf_anthy_romaji, "ke", g_strdup ("け"));
+  g_hash_table_insert (nimf_anthy_romaji, "ki", g_strdup ("き"));
+  g_hash_table_insert (nimf_anthy_romaji, "ko", g_strdup ("こ"));
+  g_hash_table_insert (nimf_anthy_romaji, "ku", g_strdup ("く"));
+  g_hash_table_insert (nimf_anthy_romaji, "ky", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "kya", g_strdup ("きゃ"));
+  g_hash_table_insert (nimf_anthy_romaji, "kyo", g_strdup ("きょ"));
+  g_hash_table_insert (nimf_anthy_romaji, "kyu", g_strdup ("きゅ"));
+  g_hash_table_insert (nimf_anthy_romaji, "m", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "ma", g_strdup ("ま"));
+  g_hash_table_insert (nimf_anthy_romaji, "me", g_strdup ("め"));
+  g_hash_table_insert (nimf_anthy_romaji, "mi", g_strdup ("み"));
+  g_hash_table_insert (nimf_anthy_romaji, "mo", g_strdup ("も"));
+  g_hash_table_insert (nimf_anthy_romaji, "mu", g_strdup ("む"));
+  g_hash_table_insert (nimf_anthy_romaji, "my", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "mya", g_strdup ("みゃ"));
+  g_hash_table_insert (nimf_anthy_romaji, "myo", g_strdup ("みょ"));
+  g_hash_table_insert (nimf_anthy_romaji, "myu", g_strdup ("みゅ"));
+  g_hash_table_insert (nimf_anthy_romaji, "n", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "na", g_strdup ("な"));
+  g_hash_table_insert (nimf_anthy_romaji, "ne", g_strdup ("ね"));
+  g_hash_table_insert (nimf_anthy_romaji, "ni", g_strdup ("に"));
+  g_hash_table_insert (nimf_anthy_romaji, "nn", g_strdup ("ん"));
+  g_hash_table_insert (nimf_anthy_romaji, "no", g_strdup ("の"));
+  g_hash_table_insert (nimf_anthy_romaji, "nu", g_strdup ("ぬ"));
+  g_hash_table_insert (nimf_anthy_romaji, "ny", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "nya", g_strdup ("にゃ"));
+  g_hash_table_insert (nimf_anthy_romaji, "nyo", g_strdup ("にょ"));
+  g_hash_table_insert (nimf_anthy_romaji, "nyu", g_strdup ("にゅ"));
+  g_hash_table_insert (nimf_anthy_romaji, "o", g_strdup ("お"));
+  g_hash_table_insert (nimf_anthy_romaji, "p", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "pa", g_strdup ("ぱ"));
+  g_hash_table_insert (nimf_anthy_romaji, "pe", g_strdup ("ぺ"));
+  g_hash_table_insert (nimf_anthy_romaji, "pi", g_strdup ("ぴ"));
+  g_hash_table_insert (nimf_anthy_romaji, "po", g_strdup ("ぽ"));
+  g_hash_table_insert (nimf_anthy_romaji, "pu", g_strdup ("ぷ"));
+  g_hash_table_insert (nimf_anthy_romaji, "py", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "pya", g_strdup ("ぴゃ"));
+  g_hash_table_insert (nimf_anthy_romaji, "pyo", g_strdup ("ぴょ"));
+  g_hash_table_insert (nimf_anthy_romaji, "pyu", g_strdup ("ぴゅ"));
+  g_hash_table_insert (nimf_anthy_romaji, "r", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "ra", g_strdup ("ら"));
+  g_hash_table_insert (nimf_anthy_romaji, "re", g_strdup ("れ"));
+  g_hash_table_insert (nimf_anthy_romaji, "ri", g_strdup ("り"));
+  g_hash_table_insert (nimf_anthy_romaji, "ro", g_strdup ("ろ"));
+  g_hash_table_insert (nimf_anthy_romaji, "ru", g_strdup ("る"));
+  g_hash_table_insert (nimf_anthy_romaji, "ry", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "rya", g_strdup ("りゃ"));
+  g_hash_table_insert (nimf_anthy_romaji, "ryo", g_strdup ("りょ"));
+  g_hash_table_insert (nimf_anthy_romaji, "ryu", g_strdup ("りゅ"));
+  g_hash_table_insert (nimf_anthy_romaji, "s", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "sa", g_strdup ("さ"));
+  g_hash_table_insert (nimf_anthy_romaji, "se", g_strdup ("せ"));
+  g_hash_table_insert (nimf_anthy_romaji, "sh", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "sha", g_strdup ("しゃ"));
+  g_hash_table_insert (nimf_anthy_romaji, "shi", g_strdup ("し"));
+  g_hash_table_insert (nimf_anthy_romaji, "sho", g_strdup ("しょ"));
+  g_hash_table_insert (nimf_anthy_romaji, "shu", g_strdup ("しゅ"));
+  g_hash_table_insert (nimf_anthy_romaji, "so", g_strdup ("そ"));
+  g_hash_table_insert (nimf_anthy_romaji, "su", g_strdup ("す"));
+  g_hash_table_insert (nimf_anthy_romaji, "t", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "ta", g_strdup ("た"));
+  g_hash_table_insert (nimf_anthy_romaji, "te", g_strdup ("て"));
+  g_hash_table_insert (nimf_anthy_romaji, "to", g_strdup ("と"));
+  g_hash_table_insert (nimf_anthy_romaji, "ts", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "tsu", g_strdup ("つ"));
+  g_hash_table_insert (nimf_anthy_romaji, "u", g_strdup ("う"));
+  g_hash_table_insert (nimf_anthy_romaji, "w", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "wa", g_strdup ("わ"));
+  g_hash_table_insert (nimf_anthy_romaji, "we", g_strdup ("うぇ"));
+  g_hash_table_insert (nimf_anthy_romaji, "wi", g_strdup ("うぃ"));
+  g_hash_table_insert (nimf_anthy_romaji, "wo", g_strdup ("を"));
+  g_hash_table_insert (nimf_anthy_romaji, "wy", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "wye", g_strdup ("ゑ"));
+  g_hash_table_insert (nimf_anthy_romaji, "wyi", g_strdup ("ゐ"));
+  g_hash_table_insert (nimf_anthy_romaji, "y", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "ya", g_strdup ("や"));
+  g_hash_table_insert (nimf_anthy_romaji, "yo", g_strdup ("よ"));
+  g_hash_table_insert (nimf_anthy_romaji, "yu", g_strdup ("ゆ"));
+  g_hash_table_insert (nimf_anthy_romaji, "z", g_strdup ("")); /* dummy */
+  g_hash_table_insert (nimf_anthy_romaji, "za", g_strdup ("ざ"));
+  g_hash_table_insert (nimf_anthy_romaji, "ze", g_strdup ("ぜ"));
+  g_hash_table_insert (nimf_anthy_romaji, "zi", g_strdup ("じ"));
+  g_hash_table_insert (nimf_anthy_romaji, "zo", g_strdup ("ぞ"));
+  g_hash_table_insert (nimf_anthy_romaji, "zu", g_strdup ("ず"));
+  g_hash_table_insert (nimf_anthy_romaji, ",", g_strdup ("、"));
+  g_hash_table_insert (nimf_anthy_romaji, ".", g_strdup ("。"));
+
+  if (anthy_init () < 0)
+    g_error (G_STRLOC ": %s: anthy is not initialized", G_STRFUNC);
+}
+
+static void
+nimf_anthy_backend_unref (void)
+{
+  NIMF_TRACE ();
+
+  if (--nimf_anthy_ref_count > 0)
+    return;
+
+  g_hash_table_unref (nimf_anthy_romaji);
+  nimf_anthy_romaji = NULL;
+  anthy_quit ();
+}
+
 static void
 nimf_anthy_init (NimfAnthy *anthy)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   anthy->candidate = nimf_candidate_get_default ();
   anthy->id       = g_strdup ("nimf-anthy");
@@ -674,174 +849,18 @@ nimf_anthy_init (NimfAnthy *anthy)
   anthy->preedit_attrs[1] = nimf_preedit_attr_new (NIMF_PREEDIT_ATTR_HIGHLIGHT, 0, 0);
   anthy->preedit_attrs[2] = NULL;
 
-  if (nimf_anthy_romaji)
-  {
-    g_hash_table_ref (nimf_anthy_romaji);
-  }
-  else
-  {
-    nimf_anthy_romaji = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                               NULL, g_free);
-    g_hash_table_insert (nimf_anthy_romaji, "a", g_strdup ("あ"));
-    g_hash_table_insert (nimf_anthy_romaji, "b", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "ba", g_strdup ("ば"));
-    g_hash_table_insert (nimf_anthy_romaji, "be", g_strdup ("べ"));
-    g_hash_table_insert (nimf_anthy_romaji, "bi", g_strdup ("び"));
-    g_hash_table_insert (nimf_anthy_romaji, "bo", g_strdup ("ぼ"));
-    g_hash_table_insert (nimf_anthy_romaji, "bu", g_strdup ("ぶ"));
-    g_hash_table_insert (nimf_anthy_romaji, "by", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "bya", g_strdup ("びゃ"));
-    g_hash_table_insert (nimf_anthy_romaji, "byo", g_strdup ("びょ"));
-    g_hash_table_insert (nimf_anthy_romaji, "byu", g_strdup ("びゅ"));
-    g_hash_table_insert (nimf_anthy_romaji, "c", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "ch", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "cha", g_strdup ("ちゃ"));
-    g_hash_table_insert (nimf_anthy_romaji, "chi", g_strdup ("ち"));
-    g_hash_table_insert (nimf_anthy_romaji, "cho", g_strdup ("ちょ"));
-    g_hash_table_insert (nimf_anthy_romaji, "chu", g_strdup ("ちゅ"));
-    g_hash_table_insert (nimf_anthy_romaji, "d", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "da", g_strdup ("だ"));
-    g_hash_table_insert (nimf_anthy_romaji, "de", g_strdup ("で"));
-    g_hash_table_insert (nimf_anthy_romaji, "di", g_strdup ("ぢ"));
-    g_hash_table_insert (nimf_anthy_romaji, "do", g_strdup ("ど"));
-    g_hash_table_insert (nimf_anthy_romaji, "du", g_strdup ("づ"));
-    g_hash_table_insert (nimf_anthy_romaji, "dy", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "dya", g_strdup ("ぢゃ"));
-    g_hash_table_insert (nimf_anthy_romaji, "dyo", g_strdup ("ぢょ"));
-    g_hash_table_insert (nimf_anthy_romaji, "dyu", g_strdup ("ぢゅ"));
-    g_hash_table_insert (nimf_anthy_romaji, "e", g_strdup ("え"));
-    g_hash_table_insert (nimf_anthy_romaji, "f", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "fu", g_strdup ("ふ"));
-    g_hash_table_insert (nimf_anthy_romaji, "g", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "ga", g_strdup ("が"));
-    g_hash_table_insert (nimf_anthy_romaji, "ge", g_strdup ("げ"));
-    g_hash_table_insert (nimf_anthy_romaji, "gi", g_strdup ("ぎ"));
-    g_hash_table_insert (nimf_anthy_romaji, "go", g_strdup ("ご"));
-    g_hash_table_insert (nimf_anthy_romaji, "gu", g_strdup ("ぐ"));
-    g_hash_table_insert (nimf_anthy_romaji, "gy", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "gya", g_strdup ("ぎゃ"));
-    g_hash_table_insert (nimf_anthy_romaji, "gyo", g_strdup ("ぎょ"));
-    g_hash_table_insert (nimf_anthy_romaji, "gyu", g_strdup ("ぎゅ"));
-    g_hash_table_insert (nimf_anthy_romaji, "h", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "ha", g_strdup ("は"));
-    g_hash_table_insert (nimf_anthy_romaji, "he", g_strdup ("へ"));
-    g_hash_table_insert (nimf_anthy_romaji, "hi", g_strdup ("ひ"));
-    g_hash_table_insert (nimf_anthy_romaji, "ho", g_strdup ("ほ"));
-    g_hash_table_insert (nimf_anthy_romaji, "hy", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "hya", g_strdup ("ひゃ"));
-    g_hash_table_insert (nimf_anthy_romaji, "hyo", g_strdup ("ひょ"));
-    g_hash_table_insert (nimf_anthy_romaji, "hyu", g_strdup ("ひゅ"));
-    g_hash_table_insert (nimf_anthy_romaji, "i", g_strdup ("い"));
-    g_hash_table_insert (nimf_anthy_romaji, "j", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "ja", g_strdup ("じゃ"));
-    g_hash_table_insert (nimf_anthy_romaji, "ji", g_strdup ("じ"));
-    g_hash_table_insert (nimf_anthy_romaji, "jo", g_strdup ("じょ"));
-    g_hash_table_insert (nimf_anthy_romaji, "ju", g_strdup ("じゅ"));
-    g_hash_table_insert (nimf_anthy_romaji, "k", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "ka", g_strdup ("か"));
-    g_hash_table_insert (nimf_anthy_romaji, "ke", g_strdup ("け"));
-    g_hash_table_insert (nimf_anthy_romaji, "ki", g_strdup ("き"));
-    g_hash_table_insert (nimf_anthy_romaji, "ko", g_strdup ("こ"));
-    g_hash_table_insert (nimf_anthy_romaji, "ku", g_strdup ("く"));
-    g_hash_table_insert (nimf_anthy_romaji, "ky", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "kya", g_strdup ("きゃ"));
-    g_hash_table_insert (nimf_anthy_romaji, "kyo", g_strdup ("きょ"));
-    g_hash_table_insert (nimf_anthy_romaji, "kyu", g_strdup ("きゅ"));
-    g_hash_table_insert (nimf_anthy_romaji, "m", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "ma", g_strdup ("ま"));
-    g_hash_table_insert (nimf_anthy_romaji, "me", g_strdup ("め"));
-    g_hash_table_insert (nimf_anthy_romaji, "mi", g_strdup ("み"));
-    g_hash_table_insert (nimf_anthy_romaji, "mo", g_strdup ("も"));
-    g_hash_table_insert (nimf_anthy_romaji, "mu", g_strdup ("む"));
-    g_hash_table_insert (nimf_anthy_romaji, "my", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "mya", g_strdup ("みゃ"));
-    g_hash_table_insert (nimf_anthy_romaji, "myo", g_strdup ("みょ"));
-    g_hash_table_insert (nimf_anthy_romaji, "myu", g_strdup ("みゅ"));
-    g_hash_table_insert (nimf_anthy_romaji, "n", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "na", g_strdup ("な"));
-    g_hash_table_insert (nimf_anthy_romaji, "ne", g_strdup ("ね"));
-    g_hash_table_insert (nimf_anthy_romaji, "ni", g_strdup ("に"));
-    g_hash_table_insert (nimf_anthy_romaji, "nn", g_strdup ("ん"));
-    g_hash_table_insert (nimf_anthy_romaji, "no", g_strdup ("の"));
-    g_hash_table_insert (nimf_anthy_romaji, "nu", g_strdup ("ぬ"));
-    g_hash_table_insert (nimf_anthy_romaji, "ny", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "nya", g_strdup ("にゃ"));
-    g_hash_table_insert (nimf_anthy_romaji, "nyo", g_strdup ("にょ"));
-    g_hash_table_insert (nimf_anthy_romaji, "nyu", g_strdup ("にゅ"));
-    g_hash_table_insert (nimf_anthy_romaji, "o", g_strdup ("お"));
-    g_hash_table_insert (nimf_anthy_romaji, "p", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "pa", g_strdup ("ぱ"));
-    g_hash_table_insert (nimf_anthy_romaji, "pe", g_strdup ("ぺ"));
-    g_hash_table_insert (nimf_anthy_romaji, "pi", g_strdup ("ぴ"));
-    g_hash_table_insert (nimf_anthy_romaji, "po", g_strdup ("ぽ"));
-    g_hash_table_insert (nimf_anthy_romaji, "pu", g_strdup ("ぷ"));
-    g_hash_table_insert (nimf_anthy_romaji, "py", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "pya", g_strdup ("ぴゃ"));
-    g_hash_table_insert (nimf_anthy_romaji, "pyo", g_strdup ("ぴょ"));
-    g_hash_table_insert (nimf_anthy_romaji, "pyu", g_strdup ("ぴゅ"));
-    g_hash_table_insert (nimf_anthy_romaji, "r", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "ra", g_strdup ("ら"));
-    g_hash_table_insert (nimf_anthy_romaji, "re", g_strdup ("れ"));
-    g_hash_table_insert (nimf_anthy_romaji, "ri", g_strdup ("り"));
-    g_hash_table_insert (nimf_anthy_romaji, "ro", g_strdup ("ろ"));
-    g_hash_table_insert (nimf_anthy_romaji, "ru", g_strdup ("る"));
-    g_hash_table_insert (nimf_anthy_romaji, "ry", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "rya", g_strdup ("りゃ"));
-    g_hash_table_insert (nimf_anthy_romaji, "ryo", g_strdup ("りょ"));
-    g_hash_table_insert (nimf_anthy_romaji, "ryu", g_strdup ("りゅ"));
-    g_hash_table_insert (nimf_anthy_romaji, "s", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "sa", g_strdup ("さ"));
-    g_hash_table_insert (nimf_anthy_romaji, "se", g_strdup ("せ"));
-    g_hash_table_insert (nimf_anthy_romaji, "sh", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "sha", g_strdup ("しゃ"));
-    g_hash_table_insert (nimf_anthy_romaji, "shi", g_strdup ("し"));
-    g_hash_table_insert (nimf_anthy_romaji, "sho", g_strdup ("しょ"));
-    g_hash_table_insert (nimf_anthy_romaji, "shu", g_strdup ("しゅ"));
-    g_hash_table_insert (nimf_anthy_romaji, "so", g_strdup ("そ"));
-    g_hash_table_insert (nimf_anthy_romaji, "su", g_strdup ("す"));
-    g_hash_table_insert (nimf_anthy_romaji, "t", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "ta", g_strdup ("た"));
-    g_hash_table_insert (nimf_anthy_romaji, "te", g_strdup ("て"));
-    g_hash_table_insert (nimf_anthy_romaji, "to", g_strdup ("と"));
-    g_hash_table_insert (nimf_anthy_romaji, "ts", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "tsu", g_strdup ("つ"));
-    g_hash_table_insert (nimf_anthy_romaji, "u", g_strdup ("う"));
-    g_hash_table_insert (nimf_anthy_romaji, "w", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "wa", g_strdup ("わ"));
-    g_hash_table_insert (nimf_anthy_romaji, "we", g_strdup ("うぇ"));
-    g_hash_table_insert (nimf_anthy_romaji, "wi", g_strdup ("うぃ"));
-    g_hash_table_insert (nimf_anthy_romaji, "wo", g_strdup ("を"));
-    g_hash_table_insert (nimf_anthy_romaji, "wy", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "wye", g_strdup ("ゑ"));
-    g_hash_table_insert (nimf_anthy_romaji, "wyi", g_strdup ("ゐ"));
-    g_hash_table_insert (nimf_anthy_romaji, "y", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "ya", g_strdup ("や"));
-    g_hash_table_insert (nimf_anthy_romaji, "yo", g_strdup ("よ"));
-    g_hash_table_insert (nimf_anthy_romaji, "yu", g_strdup ("ゆ"));
-    g_hash_table_insert (nimf_anthy_romaji, "z", g_strdup ("")); /* dummy */
-    g_hash_table_insert (nimf_anthy_romaji, "za", g_strdup ("ざ"));
-    g_hash_table_insert (nimf_anthy_romaji, "ze", g_strdup ("ぜ"));
-    g_hash_table_insert (nimf_anthy_romaji, "zi", g_strdup ("じ"));
-    g_hash_table_insert (nimf_anthy_romaji, "zo", g_strdup ("ぞ"));
-    g_hash_table_insert (nimf_anthy_romaji, "zu", g_strdup ("ず"));
-    g_hash_table_insert (nimf_anthy_romaji, ",", g_strdup ("、"));
-    g_hash_table_insert (nimf_anthy_romaji, ".", g_strdup ("。"));
-  }
-
-  if (anthy_init () < 0)
-    g_error (G_STRLOC ": %s: anthy is not initialized", G_STRFUNC);
+  nimf_anthy_backend_ref ();
 
   /* FIXME */
   /* anthy_set_personality () */
   anthy->context = anthy_create_context ();
-  nimf_anthy_ref_count++;
   anthy_context_set_encoding (anthy->context, ANTHY_UTF8_ENCODING);
 }
 
 static void
 nimf_anthy_finalize (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfAnthy *anthy = NIMF_ANTHY (object);
 
@@ -849,13 +868,8 @@ nimf_anthy_finalize (GObject *object)
   g_string_free (anthy->preedit2, TRUE);
   nimf_preedit_attr_freev (anthy->preedit_attrs);
   g_free (anthy->id);
-  g_hash_table_unref (nimf_anthy_romaji);
-
-  if (--nimf_anthy_ref_count == 0)
-  {
-    anthy_release_context (anthy->context);
-    anthy_quit ();
-  }
+  anthy_release_context (anthy->context);
+  nimf_anthy_backend_unref ();
 
   G_OBJECT_CLASS (nimf_anthy_parent_class)->finalize (object);
 }
@@ -863,7 +877,7 @@ nimf_anthy_finalize (GObject *object)
 const gchar *
 nimf_anthy_get_id (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_ENGINE (engine), NULL);
 
@@ -873,7 +887,7 @@ nimf_anthy_get_id (NimfEngine *engine)
 const gchar *
 nimf_anthy_get_icon_name (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_ENGINE (engine), NULL);
 
@@ -883,7 +897,7 @@ nimf_anthy_get_icon_name (NimfEngine *engine)
 static void
 nimf_anthy_class_init (NimfAnthyClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GObjectClass *object_class = G_OBJECT_CLASS (class);
   NimfEngineClass *engine_class = NIMF_ENGINE_CLASS (class);
@@ -907,19 +921,19 @@ nimf_anthy_class_init (NimfAnthyClass *class)
 static void
 nimf_anthy_class_finalize (NimfAnthyClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 void module_register_type (GTypeModule *type_module)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_anthy_register_type (type_module);
 }
 
 GType module_get_type ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return nimf_anthy_get_type ();
 }
@@ -57,7 +57,7 @@ void
 nimf_chewing_reset (NimfEngine  *engine,
                     NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfChewing *chewing = NIMF_CHEWING (engine);
 
@@ -81,14 +81,14 @@ void
 nimf_chewing_focus_in (NimfEngine  *engine,
                        NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 void
 nimf_chewing_focus_out (NimfEngine  *engine,
                         NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_candidate_hide_window (NIMF_CHEWING (engine)->candidate);
   nimf_chewing_reset (engine, target);
@@ -97,7 +97,7 @@ nimf_chewing_focus_out (NimfEngine  *engine,
 static void nimf_chewing_update (NimfEngine  *engine,
                                  NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfChewing *chewing = NIMF_CHEWING (engine);
 
@@ -174,7 +174,7 @@ on_candidate_clicked (NimfEngine  *engine,
                       gchar       *text,
                       gint         index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfChewing *chewing = NIMF_CHEWING (engine);
 
@@ -187,7 +187,7 @@ on_candidate_scrolled (NimfEngine  *engine,
                        NimfContext *target,
                        gdouble      value)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfChewing *chewing = NIMF_CHEWING (engine);
 
@@ -214,7 +214,7 @@ nimf_chewing_filter_event (NimfEngine  *engine,
                            NimfContext *target,
                            NimfEvent   *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfChewing *chewing = NIMF_CHEWING (engine);
 
@@ -347,7 +347,7 @@ nimf_chewing_filter_event (NimfEngine  *engine,
 static void
 nimf_chewing_init (NimfChewing *chewing)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   gint keys[10] = {'1', '2', '3', '4', '5', '6', '7', '8', '9', '0'};
   chewing->candidate = nimf_candidate_get_default ();
@@ -372,7 +372,7 @@ nimf_chewing_init (NimfChewing *chewing)
 static void
 nimf_chewing_finalize (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfChewing *chewing = NIMF_CHEWING (object);
 
@@ -387,7 +387,7 @@ nimf_chewing_finalize (GObject *object)
 const gchar *
 nimf_chewing_get_id (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_ENGINE (engine), NULL);
 
@@ -397,7 +397,7 @@ nimf_chewing_get_id (NimfEngine *engine)
 const gchar *
 nimf_chewing_get_icon_name (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_ENGINE (engine), NULL);
 
@@ -407,7 +407,7 @@ nimf_chewing_get_icon_name (NimfEngine *engine)
 static void
 nimf_chewing_class_init (NimfChewingClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GObjectClass *object_class = G_OBJECT_CLASS (class);
   NimfEngineClass *engine_class = NIMF_ENGINE_CLASS (class);
@@ -429,19 +429,19 @@ nimf_chewing_class_init (NimfChewingClass *class)
 static void
 nimf_chewing_class_finalize (NimfChewingClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 void module_register_type (GTypeModule *type_module)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_chewing_register_type (type_module);
 }
 
 GType module_get_type ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return nimf_chewing_get_type ();
 }
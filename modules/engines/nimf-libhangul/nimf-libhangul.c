@@ -44,7 +44,7 @@ struct _NimfLibhangul
   NimfPreeditState    preedit_state;
   gchar              *id;
 
-  NimfKey           **hanja_keys;
+  NimfKeyTable        hanja_keys;
   GSettings          *settings;
   gboolean            is_double_consonant_rule;
   gboolean            is_auto_correction;
@@ -67,13 +67,14 @@ struct _NimfLibhangulClass
 static HanjaTable *nimf_libhangul_hanja_table  = NULL;
 static HanjaTable *nimf_libhangul_symbol_table = NULL;
 static gint        nimf_libhangul_hanja_table_ref_count = 0;
+static GSettings  *nimf_libhangul_settings = NULL;
 
 G_DEFINE_DYNAMIC_TYPE (NimfLibhangul, nimf_libhangul, NIMF_TYPE_ENGINE);
 
 /* only for PC keyboards */
 guint nimf_event_keycode_to_qwerty_keyval (const NimfEvent *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   guint keyval = 0;
   gboolean is_shift = event->key.state & NIMF_SHIFT_MASK;
@@ -130,7 +131,7 @@ nimf_libhangul_update_preedit (NimfEngine  *engine,
                                NimfContext *target,
                                gchar       *new_preedit)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfLibhangul *hangul = NIMF_LIBHANGUL (engine);
 
@@ -167,7 +168,7 @@ nimf_libhangul_emit_commit (NimfEngine  *engine,
                             NimfContext *target,
                             const gchar *text)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfLibhangul *hangul = NIMF_LIBHANGUL (engine);
   hangul->is_committing = TRUE;
@@ -179,7 +180,7 @@ void
 nimf_libhangul_reset (NimfEngine  *engine,
                       NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_ENGINE (engine));
 
@@ -208,7 +209,7 @@ void
 nimf_libhangul_focus_in (NimfEngine  *engine,
                          NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_ENGINE (engine));
 }
@@ -217,7 +218,7 @@ void
 nimf_libhangul_focus_out (NimfEngine  *engine,
                           NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_ENGINE (engine));
 
@@ -230,7 +231,7 @@ on_candidate_clicked (NimfEngine  *engine,
                       gchar       *text,
                       gint         index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfLibhangul *hangul = NIMF_LIBHANGUL (engine);
 
@@ -248,7 +249,7 @@ on_candidate_clicked (NimfEngine  *engine,
 static gint
 nimf_libhangul_get_current_page (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return NIMF_LIBHANGUL (engine)->current_page;
 }
@@ -257,7 +258,7 @@ static void
 nimf_libhangul_update_page (NimfEngine  *engine,
                             NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfLibhangul *hangul = NIMF_LIBHANGUL (engine);
 
@@ -284,7 +285,7 @@ nimf_libhangul_update_page (NimfEngine  *engine,
 static gboolean
 nimf_libhangul_page_up (NimfEngine *engine, NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfLibhangul *hangul = NIMF_LIBHANGUL (engine);
 
@@ -307,7 +308,7 @@ nimf_libhangul_page_up (NimfEngine *engine, NimfContext *target)
 static gboolean
 nimf_libhangul_page_down (NimfEngine *engine, NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfLibhangul *hangul = NIMF_LIBHANGUL (engine);
 
@@ -330,7 +331,7 @@ nimf_libhangul_page_down (NimfEngine *engine, NimfContext *target)
 static void
 nimf_libhangul_page_home (NimfEngine *engine, NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfLibhangul *hangul = NIMF_LIBHANGUL (engine);
 
@@ -351,7 +352,7 @@ nimf_libhangul_page_home (NimfEngine *engine, NimfContext *target)
 static void
 nimf_libhangul_page_end (NimfEngine *engine, NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfLibhangul *hangul = NIMF_LIBHANGUL (engine);
 
@@ -374,7 +375,7 @@ on_candidate_scrolled (NimfEngine  *engine,
                        NimfContext *target,
                        gdouble      value)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfLibhangul *hangul = NIMF_LIBHANGUL (engine);
 
@@ -399,7 +400,7 @@ nimf_libhangul_filter_leading_consonant (NimfEngine  *engine,
                                          NimfContext *target,
                                          guint        keyval)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfLibhangul *hangul = NIMF_LIBHANGUL (engine);
 
@@ -431,7 +432,7 @@ nimf_libhangul_filter_event (NimfEngine  *engine,
                              NimfContext *target,
                              NimfEvent   *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   guint    keyval;
   gboolean retval = FALSE;
@@ -449,8 +450,7 @@ nimf_libhangul_filter_event (NimfEngine  *engine,
     return FALSE;
   }
 
-  if (G_UNLIKELY (nimf_event_matches (event,
-                  (const NimfKey **) hangul->hanja_keys)))
+  if (G_UNLIKELY (nimf_key_table_lookup (&hangul->hanja_keys, event)))
   {
     if (nimf_candidate_is_window_visible (hangul->candidate) == FALSE)
     {
@@ -621,7 +621,7 @@ on_libhangul_transition (HangulInputContext *ic,
                          const ucschar      *preedit,
                          void               *data)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if ((hangul_is_choseong (c) && (hangul_ic_has_jungseong (ic) ||
                                   hangul_ic_has_jongseong (ic))) ||
@@ -634,7 +634,7 @@ on_libhangul_transition (HangulInputContext *ic,
 static void
 nimf_libhangul_update_transition_cb (NimfLibhangul *hangul)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if ((g_strcmp0 (hangul->layout, "2") == 0) && !hangul->is_auto_correction)
     hangul_ic_connect_callback (hangul->context, "transition",
@@ -648,7 +648,7 @@ on_changed_layout (GSettings     *settings,
                    gchar         *key,
                    NimfLibhangul *hangul)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_free (hangul->layout);
   hangul->layout = g_settings_get_string (settings, key);
@@ -661,7 +661,7 @@ on_changed_auto_correction (GSettings     *settings,
                             gchar         *key,
                             NimfLibhangul *hangul)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   hangul->is_auto_correction = g_settings_get_boolean (settings, key);
   nimf_libhangul_update_transition_cb (hangul);
@@ -672,14 +672,18 @@ on_changed_keys (GSettings     *settings,
                  gchar         *key,
                  NimfLibhangul *hangul)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   gchar **keys = g_settings_get_strv (settings, key);
 
   if (g_strcmp0 (key, "hanja-keys") == 0)
   {
-    nimf_key_freev (hangul->hanja_keys);
-    hangul->hanja_keys = nimf_key_newv ((const gchar **) keys);
+    NimfKey **hanja_keys = nimf_key_newv ((const gchar **) keys);
+
+    nimf_key_table_remove_all (&hangul->hanja_keys);
+    nimf_key_table_add (&hangul->hanja_keys,
+                        (const NimfKey **) hanja_keys, GINT_TO_POINTER (TRUE));
+    nimf_key_freev (hanja_keys);
   }
 
   g_strfreev (keys);
@@ -690,7 +694,7 @@ on_changed_double_consonant_rule (GSettings     *settings,
                                   gchar         *key,
                                   NimfLibhangul *hangul)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   hangul->is_double_consonant_rule = g_settings_get_boolean (settings, key);
 }
@@ -700,21 +704,54 @@ on_changed_ignore_reset_in_commit_cb (GSettings     *settings,
                                       gchar         *key,
                                       NimfLibhangul *hangul)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   hangul->ignore_reset_in_commit_cb = g_settings_get_boolean (settings, key);
 }
 
+/* The hanja tables and the settings are the backend, shared by all
+ * instances, which are created and run in the main thread; each instance
+ * is a session with a HangulInputContext of its own. */
+static void
+nimf_libhangul_backend_ref (void)
+{
+  NIMF_TRACE ();
+
+  if (nimf_libhangul_hanja_table_ref_count++ > 0)
+    return;
+
+  nimf_libhangul_settings = g_settings_new ("org.nimf.engines.nimf-libhangul");
+  nimf_libhangul_hanja_table  = hanja_table_load (NULL);
+  nimf_libhangul_symbol_table = hanja_table_load ("/usr/share/libhangul/hanja/mssymbol.txt"); /* FIXME */
+}
+
+static void
+nimf_libhangul_backend_unref (void)
+{
+  NIMF_TRACE ();
+
+  if (--nimf_libhangul_hanja_table_ref_count > 0)
+    return;
+
+  hanja_table_delete (nimf_libhangul_hanja_table);
+  hanja_table_delete (nimf_libhangul_symbol_table);
+  g_object_unref (nimf_libhangul_settings);
+  nimf_libhangul_settings = NULL;
+}
+
 static void
 nimf_libhangul_init (NimfLibhangul *hangul)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
-  gchar **trigger_keys;
-  gchar **hanja_keys;
+  gchar   **trigger_keys;
+  gchar   **hanja_keys;
+  NimfKey **keys;
 
   hangul->candidate = nimf_candidate_get_default ();
-  hangul->settings = g_settings_new ("org.nimf.engines.nimf-libhangul");
+
+  nimf_libhangul_backend_ref ();
+  hangul->settings = nimf_libhangul_settings;
 
   hangul->layout = g_settings_get_string (hangul->settings, "layout");
   hangul->is_double_consonant_rule =
@@ -727,7 +764,11 @@ nimf_libhangul_init (NimfLibhangul *hangul)
   trigger_keys = g_settings_get_strv (hangul->settings, "trigger-keys");
   hanja_keys   = g_settings_get_strv (hangul->settings, "hanja-keys");
 
-  hangul->hanja_keys = nimf_key_newv ((const gchar **) hanja_keys);
+  keys = nimf_key_newv ((const gchar **) hanja_keys);
+  nimf_key_table_init (&hangul->hanja_keys, NULL);
+  nimf_key_table_add (&hangul->hanja_keys,
+                      (const NimfKey **) keys, GINT_TO_POINTER (TRUE));
+  nimf_key_freev (keys);
   hangul->context = hangul_ic_new (hangul->layout);
 
   hangul->id = g_strdup ("nimf-libhangul");
@@ -736,14 +777,6 @@ nimf_libhangul_init (NimfLibhangul *hangul)
   hangul->preedit_attrs[0] = nimf_preedit_attr_new (NIMF_PREEDIT_ATTR_UNDERLINE, 0, 0);
   hangul->preedit_attrs[1] = NULL;
 
-  if (nimf_libhangul_hanja_table_ref_count == 0)
-  {
-    nimf_libhangul_hanja_table  = hanja_table_load (NULL);
-    nimf_libhangul_symbol_table = hanja_table_load ("/usr/share/libhangul/hanja/mssymbol.txt"); /* FIXME */
-  }
-
-  nimf_libhangul_hanja_table_ref_count++;
-
   g_strfreev (trigger_keys);
   g_strfreev (hanja_keys);
 
@@ -766,15 +799,12 @@ nimf_libhangul_init (NimfLibhangul *hangul)
 static void
 nimf_libhangul_finalize (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfLibhangul *hangul = NIMF_LIBHANGUL (object);
 
-  if (--nimf_libhangul_hanja_table_ref_count == 0)
-  {
-    hanja_table_delete (nimf_libhangul_hanja_table);
-    hanja_table_delete (nimf_libhangul_symbol_table);
-  }
+  g_signal_handlers_disconnect_by_data (hangul->settings, hangul);
+  nimf_libhangul_backend_unref ();
 
   hanja_list_delete (hangul->hanja_list);
   hangul_ic_delete (hangul->context);
@@ -782,8 +812,7 @@ nimf_libhangul_finalize (GObject *object)
   nimf_preedit_attr_freev (hangul->preedit_attrs);
   g_free (hangul->id);
   g_free (hangul->layout);
-  nimf_key_freev (hangul->hanja_keys);
-  g_object_unref (hangul->settings);
+  nimf_key_table_clear (&hangul->hanja_keys);
 
   G_OBJECT_CLASS (nimf_libhangul_parent_class)->finalize (object);
 }
@@ -791,7 +820,7 @@ nimf_libhangul_finalize (GObject *object)
 const gchar *
 nimf_libhangul_get_id (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_ENGINE (engine), NULL);
 
@@ -801,7 +830,7 @@ nimf_libhangul_get_id (NimfEngine *engine)
 const gchar *
 nimf_libhangul_get_icon_name (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_ENGINE (engine), NULL);
 
@@ -811,7 +840,7 @@ nimf_libhangul_get_icon_name (NimfEngine *engine)
 static void
 nimf_libhangul_class_init (NimfLibhangulClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GObjectClass *object_class = G_OBJECT_CLASS (class);
   NimfEngineClass *engine_class = NIMF_ENGINE_CLASS (class);
@@ -835,19 +864,19 @@ nimf_libhangul_class_init (NimfLibhangulClass *class)
 static void
 nimf_libhangul_class_finalize (NimfLibhangulClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 void module_register_type (GTypeModule *type_module)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_libhangul_register_type (type_module);
 }
 
 GType module_get_type ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return nimf_libhangul_get_type ();
 }
@@ -64,7 +64,7 @@ static void nimf_rime_update_preedit (NimfEngine  *engine,
                                       const gchar *new_preedit,
                                       gint         cursor_pos)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfRime *rime = NIMF_RIME (engine);
 
@@ -91,7 +91,7 @@ static void nimf_rime_update_preedit (NimfEngine  *engine,
 void nimf_rime_reset (NimfEngine  *engine,
                       NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfRime *rime = NIMF_RIME (engine);
 
@@ -104,14 +104,14 @@ void
 nimf_rime_focus_in (NimfEngine  *engine,
                     NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 void
 nimf_rime_focus_out (NimfEngine  *engine,
                      NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_candidate_hide_window (NIMF_RIME (engine)->candidate);
   nimf_rime_reset (engine, target);
@@ -121,7 +121,7 @@ static void
 nimf_rime_update_candidate (NimfEngine  *engine,
                             NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfRime *rime = NIMF_RIME (engine);
   int i;
@@ -161,7 +161,7 @@ nimf_rime_update_candidate (NimfEngine  *engine,
 static void nimf_rime_update_preedit2 (NimfEngine  *engine,
                                        NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfRime *rime = NIMF_RIME (engine);
 
@@ -191,7 +191,7 @@ static void nimf_rime_update_preedit2 (NimfEngine  *engine,
 static void nimf_rime_update (NimfEngine  *engine,
                               NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfRime *rime = NIMF_RIME (engine);
 
@@ -238,7 +238,7 @@ on_candidate_clicked (NimfEngine  *engine,
                       gchar       *text,
                       gint         index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfRime *rime = NIMF_RIME (engine);
   RimeApi  *api  = rime_get_api();
@@ -264,7 +264,7 @@ on_candidate_clicked (NimfEngine  *engine,
 static gboolean
 nimf_rime_page_up (NimfEngine *engine, NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   RimeProcessKey (NIMF_RIME (engine)->session_id, NIMF_KEY_Page_Up, 0);
   nimf_rime_update_candidate (engine, target);
@@ -275,7 +275,7 @@ nimf_rime_page_up (NimfEngine *engine, NimfContext *target)
 static gboolean
 nimf_rime_page_down (NimfEngine *engine, NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   RimeProcessKey (NIMF_RIME (engine)->session_id, NIMF_KEY_Page_Down, 0);
   nimf_rime_update_candidate (engine, target);
@@ -288,7 +288,7 @@ on_candidate_scrolled (NimfEngine  *engine,
                        NimfContext *target,
                        gdouble      value)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfRime *rime = NIMF_RIME (engine);
 
@@ -315,7 +315,7 @@ nimf_rime_filter_event (NimfEngine  *engine,
                         NimfContext *target,
                         NimfEvent   *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfRime *rime = NIMF_RIME (engine);
 
@@ -331,10 +331,50 @@ nimf_rime_filter_event (NimfEngine  *engine,
   return retval;
 }
 
+/* RimeInitialize() sets up the backend, shared by all instances; each
+ * instance is a session of its own. */
+static void
+nimf_rime_backend_ref (void)
+{
+  NIMF_TRACE ();
+
+  gchar *user_data_dir;
+
+  if (nimf_rime_ref_count++ > 0)
+    return;
+
+  user_data_dir = g_strconcat (g_getenv ("HOME"), "/.config/nimf/rime", NULL);
+
+  if (!g_file_test (user_data_dir, G_FILE_TEST_IS_DIR))
+    g_mkdir_with_parents (user_data_dir, 0700);
+
+  RIME_STRUCT (RimeTraits, traits);
+  traits.shared_data_dir        = "/usr/share/rime-data";
+  traits.user_data_dir          = user_data_dir;
+  traits.distribution_name      = _("Rime");
+  traits.distribution_code_name = "nimf-rime";
+  traits.distribution_version   = "1.2";
+  traits.app_name               = "rime.nimf";
+
+  RimeInitialize (&traits);
+  RimeStartMaintenance (False);
+
+  g_free (user_data_dir);
+}
+
+static void
+nimf_rime_backend_unref (void)
+{
+  NIMF_TRACE ();
+
+  if (--nimf_rime_ref_count == 0)
+    RimeFinalize ();
+}
+
 static void
 nimf_rime_init (NimfRime *rime)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   rime->candidate = nimf_candidate_get_default ();
   rime->id        = g_strdup ("nimf-rime");
@@ -343,30 +383,7 @@ nimf_rime_init (NimfRime *rime)
   rime->preedit_attrs[0] = nimf_preedit_attr_new (NIMF_PREEDIT_ATTR_UNDERLINE, 0, 0);
   rime->preedit_attrs[1] = NULL;
 
-  if (nimf_rime_ref_count == 0)
-  {
-    gchar *user_data_dir;
-
-    user_data_dir = g_strconcat (g_getenv ("HOME"), "/.config/nimf/rime", NULL);
-
-    if (!g_file_test (user_data_dir, G_FILE_TEST_IS_DIR))
-      g_mkdir_with_parents (user_data_dir, 0700);
-
-    RIME_STRUCT (RimeTraits, traits);
-    traits.shared_data_dir        = "/usr/share/rime-data";
-    traits.user_data_dir          = user_data_dir;
-    traits.distribution_name      = _("Rime");
-    traits.distribution_code_name = "nimf-rime";
-    traits.distribution_version   = "1.2";
-    traits.app_name               = "rime.nimf";
-
-    RimeInitialize (&traits);
-    RimeStartMaintenance (False);
-
-    g_free (user_data_dir);
-  }
-
-  nimf_rime_ref_count++;
+  nimf_rime_backend_ref ();
 
   rime->session_id = RimeCreateSession();
 }
@@ -374,7 +391,7 @@ nimf_rime_init (NimfRime *rime)
 static void
 nimf_rime_finalize (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfRime *rime = NIMF_RIME (object);
 
@@ -388,8 +405,7 @@ nimf_rime_finalize (GObject *object)
     rime->session_id = 0;
   }
 
-  if (--nimf_rime_ref_count == 0)
-    RimeFinalize ();
+  nimf_rime_backend_unref ();
 
   G_OBJECT_CLASS (nimf_rime_parent_class)->finalize (object);
 }
@@ -397,7 +413,7 @@ nimf_rime_finalize (GObject *object)
 const gchar *
 nimf_rime_get_id (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_ENGINE (engine), NULL);
 
@@ -407,7 +423,7 @@ nimf_rime_get_id (NimfEngine *engine)
 const gchar *
 nimf_rime_get_icon_name (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_ENGINE (engine), NULL);
 
@@ -417,7 +433,7 @@ nimf_rime_get_icon_name (NimfEngine *engine)
 static void
 nimf_rime_class_init (NimfRimeClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GObjectClass *object_class = G_OBJECT_CLASS (class);
   NimfEngineClass *engine_class = NIMF_ENGINE_CLASS (class);
@@ -441,19 +457,19 @@ nimf_rime_class_init (NimfRimeClass *class)
 static void
 nimf_rime_class_finalize (NimfRimeClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 void module_register_type (GTypeModule *type_module)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_rime_register_type (type_module);
 }
 
 GType module_get_type ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return nimf_rime_get_type ();
 }
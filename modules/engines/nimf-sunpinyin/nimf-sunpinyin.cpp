@@ -32,7 +32,7 @@ public:
 
   virtual ~NimfWinHandler()
   {
-    g_debug (G_STRLOC ": %s", G_STRFUNC);
+    NIMF_TRACE ();
   }
 
   virtual void commit(const TWCHAR* wstr);
@@ -86,13 +86,13 @@ GType nimf_sunpinyin_get_type (void) G_GNUC_CONST;
 NimfWinHandler::NimfWinHandler(NimfEngine *engine)
   : m_engine(engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 void
 NimfWinHandler::commit(const TWCHAR* wstr)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfSunpinyin *pinyin = NIMF_SUNPINYIN (m_engine);
 
@@ -106,7 +106,7 @@ nimf_sunpinyin_update_preedit (NimfEngine  *engine,
                                gchar       *new_preedit,
                                int          cursor_pos)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfSunpinyin *pinyin = NIMF_SUNPINYIN (engine);
 
@@ -142,7 +142,7 @@ nimf_sunpinyin_update_preedit (NimfEngine  *engine,
 void
 NimfWinHandler::updatePreedit(const IPreeditString* ppd)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   if (ppd)
     NIMF_SUNPINYIN (m_engine)->ppd = ppd;
@@ -153,7 +153,7 @@ NimfWinHandler::updatePreedit(const IPreeditString* ppd)
 void
 NimfWinHandler::updateCandidates(const ICandidateList* pcl)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NIMF_SUNPINYIN (m_engine)->pcl = pcl;
 }
@@ -161,7 +161,7 @@ NimfWinHandler::updateCandidates(const ICandidateList* pcl)
 void
 NimfWinHandler::updateStatus(int key, int value)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 G_DEFINE_DYNAMIC_TYPE (NimfSunpinyin, nimf_sunpinyin, NIMF_TYPE_ENGINE);
@@ -169,7 +169,7 @@ G_DEFINE_DYNAMIC_TYPE (NimfSunpinyin, nimf_sunpinyin, NIMF_TYPE_ENGINE);
 static void
 nimf_sunpinyin_init (NimfSunpinyin *pinyin)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   pinyin->candidate = nimf_candidate_get_default ();
   pinyin->id = g_strdup ("nimf-sunpinyin");
@@ -178,6 +178,8 @@ nimf_sunpinyin_init (NimfSunpinyin *pinyin)
   pinyin->preedit_attrs[0] = nimf_preedit_attr_new (NIMF_PREEDIT_ATTR_UNDERLINE, 0, 0);
   pinyin->preedit_attrs[1] = NULL;
 
+  /* the factory is the backend, which loads the data once for all
+   * instances; each instance is a session of its own */
   CSunpinyinSessionFactory& factory = CSunpinyinSessionFactory::getFactory();
   factory.setPinyinScheme(CSunpinyinSessionFactory::QUANPIN);
   factory.setCandiWindowSize(10);
@@ -200,7 +202,7 @@ nimf_sunpinyin_init (NimfSunpinyin *pinyin)
 static void
 nimf_sunpinyin_finalize (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfSunpinyin *pinyin = NIMF_SUNPINYIN (object);
 
@@ -224,7 +226,7 @@ nimf_sunpinyin_finalize (GObject *object)
 const gchar *
 nimf_sunpinyin_get_id (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_ENGINE (engine), NULL);
 
@@ -234,7 +236,7 @@ nimf_sunpinyin_get_id (NimfEngine *engine)
 const gchar *
 nimf_sunpinyin_get_icon_name (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_ENGINE (engine), NULL);
 
@@ -245,7 +247,7 @@ static void
 nimf_sunpinyin_update_page (NimfEngine  *engine,
                             NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfSunpinyin *pinyin = NIMF_SUNPINYIN (engine);
 
@@ -274,7 +276,7 @@ nimf_sunpinyin_update_page (NimfEngine  *engine,
 void nimf_sunpinyin_update (NimfEngine  *engine,
                             NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfSunpinyin *pinyin = NIMF_SUNPINYIN (engine);
 
@@ -321,7 +323,7 @@ void
 nimf_sunpinyin_reset (NimfEngine  *engine,
                       NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfSunpinyin *pinyin = NIMF_SUNPINYIN (engine);
 
@@ -335,7 +337,7 @@ void
 nimf_sunpinyin_focus_in (NimfEngine  *engine,
                          NimfContext *context)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfSunpinyin *pinyin = NIMF_SUNPINYIN (engine);
 
@@ -355,7 +357,7 @@ void
 nimf_sunpinyin_focus_out (NimfEngine  *engine,
                           NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_if_fail (NIMF_IS_ENGINE (engine));
 
@@ -365,7 +367,7 @@ nimf_sunpinyin_focus_out (NimfEngine  *engine,
 static gint
 nimf_sunpinyin_get_current_page (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return NIMF_SUNPINYIN (engine)->current_page;
 }
@@ -373,7 +375,7 @@ nimf_sunpinyin_get_current_page (NimfEngine *engine)
 static gboolean
 nimf_sunpinyin_page_up (NimfEngine *engine, NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfSunpinyin *pinyin = NIMF_SUNPINYIN (engine);
 
@@ -394,7 +396,7 @@ nimf_sunpinyin_page_up (NimfEngine *engine, NimfContext *target)
 static gboolean
 nimf_sunpinyin_page_down (NimfEngine *engine, NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfSunpinyin *pinyin = NIMF_SUNPINYIN (engine);
 
@@ -415,7 +417,7 @@ nimf_sunpinyin_page_down (NimfEngine *engine, NimfContext *target)
 static void
 nimf_sunpinyin_page_home (NimfEngine *engine, NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfSunpinyin *pinyin = NIMF_SUNPINYIN (engine);
 
@@ -434,7 +436,7 @@ nimf_sunpinyin_page_home (NimfEngine *engine, NimfContext *target)
 static void
 nimf_sunpinyin_page_end (NimfEngine *engine, NimfContext *target)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfSunpinyin *pinyin = NIMF_SUNPINYIN (engine);
 
@@ -455,7 +457,7 @@ on_candidate_scrolled (NimfEngine  *engine,
                        NimfContext *target,
                        gdouble      value)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfSunpinyin *pinyin = NIMF_SUNPINYIN (engine);
 
@@ -480,7 +482,7 @@ nimf_sunpinyin_filter_event (NimfEngine  *engine,
                              NimfContext *target,
                              NimfEvent   *event)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NimfSunpinyin *pinyin = NIMF_SUNPINYIN (engine);
 
@@ -555,7 +557,7 @@ on_candidate_clicked (NimfEngine  *engine,
                       gchar       *text,
                       gint         index)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   NIMF_SUNPINYIN (engine)->view->onCandidateSelectRequest(index);
   nimf_sunpinyin_update (engine, target);
@@ -564,7 +566,7 @@ on_candidate_clicked (NimfEngine  *engine,
 static void
 nimf_sunpinyin_class_init (NimfSunpinyinClass *klass)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GObjectClass    *object_class    = G_OBJECT_CLASS (klass);
   NimfEngineClass *engine_class    = NIMF_ENGINE_CLASS (klass);
@@ -586,19 +588,19 @@ nimf_sunpinyin_class_init (NimfSunpinyinClass *klass)
 static void
 nimf_sunpinyin_class_finalize (NimfSunpinyinClass *klass)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 void module_register_type (GTypeModule *type_module)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_sunpinyin_register_type (type_module);
 }
 
 GType module_get_type ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return nimf_sunpinyin_get_type ();
 }
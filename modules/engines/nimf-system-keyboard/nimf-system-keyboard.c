@@ -51,7 +51,7 @@ G_DEFINE_DYNAMIC_TYPE (NimfSystemKeyboard, nimf_system_keyboard, NIMF_TYPE_ENGIN
 const gchar *
 nimf_system_keyboard_get_id (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_ENGINE (engine), NULL);
 
@@ -61,7 +61,7 @@ nimf_system_keyboard_get_id (NimfEngine *engine)
 const gchar *
 nimf_system_keyboard_get_icon_name (NimfEngine *engine)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_return_val_if_fail (NIMF_IS_ENGINE (engine), NULL);
 
@@ -71,7 +71,7 @@ nimf_system_keyboard_get_icon_name (NimfEngine *engine)
 static void
 nimf_system_keyboard_init (NimfSystemKeyboard *keyboard)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   keyboard->id = g_strdup ("nimf-system-keyboard");
 }
@@ -79,7 +79,7 @@ nimf_system_keyboard_init (NimfSystemKeyboard *keyboard)
 static void
 nimf_system_keyboard_finalize (GObject *object)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   g_free (NIMF_SYSTEM_KEYBOARD (object)->id);
 
@@ -89,7 +89,7 @@ nimf_system_keyboard_finalize (GObject *object)
 static void
 nimf_system_keyboard_class_init (NimfSystemKeyboardClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   GObjectClass    *object_class = G_OBJECT_CLASS (class);
   NimfEngineClass *engine_class = NIMF_ENGINE_CLASS (class);
@@ -103,19 +103,19 @@ nimf_system_keyboard_class_init (NimfSystemKeyboardClass *class)
 static void
 nimf_system_keyboard_class_finalize (NimfSystemKeyboardClass *class)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 }
 
 void module_register_type (GTypeModule *type_module)
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   nimf_system_keyboard_register_type (type_module);
 }
 
 GType module_get_type ()
 {
-  g_debug (G_STRLOC ": %s", G_STRFUNC);
+  NIMF_TRACE ();
 
   return nimf_system_keyboard_get_type ();
 }